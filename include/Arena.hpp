@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Monotonic arena. Objects are bump-allocated from a few large blocks and
+// released all at once when the arena dies; destructors are never run, so only
+// trivially destructible types may be created in it.
+
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 1 << 16) : head(nullptr), cursor(nullptr), end(nullptr), blockSize(blockSize) {}
+    ~Arena() { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template<class T, class... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void* allocate(size_t bytes, size_t align) {
+        char* p = align_up(cursor, align);
+        if (p == nullptr || p + bytes > end) {
+            grow(bytes + align);
+            p = align_up(cursor, align);
+        }
+        cursor = p + bytes;
+        return p;
+    }
+
+    /// Make sure the next `bytes` of allocations come from a single block.
+    void reserve(size_t bytes) {
+        if (cursor == nullptr || static_cast<size_t>(end - cursor) < bytes) grow(bytes);
+    }
+
+    /// Free every block in O(blocks).
+    void release() {
+        while (head) {
+            Block* next = head->next;
+            std::free(head);
+            head = next;
+        }
+        cursor = end = nullptr;
+    }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    Block* head;
+    char* cursor;
+    char* end;
+    size_t blockSize;
+
+    static char* align_up(char* p, size_t align) {
+        return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    void grow(size_t minBytes) {
+        size_t size = minBytes > blockSize ? minBytes : blockSize;
+        Block* block = static_cast<Block*>(std::malloc(sizeof(Block) + size));
+        if (block == nullptr) throw std::bad_alloc();
+        block->next = head;
+        head = block;
+        cursor = reinterpret_cast<char*>(block + 1);
+        end = cursor + size;
+    }
+};
@@ -63,7 +63,7 @@ public:
         return projInv;
     }
 
-    void draw(Shader* shader) final {}
+    void draw(Shader*) final {}
 
     viewer::ObjectType getType() final { return viewer::CAMERA; }
 
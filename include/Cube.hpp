@@ -13,14 +13,14 @@ class Cube : public Mesh {
 public:
     explicit Cube(const std::string& name, const glm::vec3& cubeMin, const glm::vec3& cubeMax) : Mesh(name) {
         verts = {
-            new Vertex(glm::vec4(cubeMax.x, cubeMax.y, cubeMin.z, 1)),
-            new Vertex(glm::vec4(cubeMax.x, cubeMin.y, cubeMin.z, 1)),
-            new Vertex(glm::vec4(cubeMax.x, cubeMax.y, cubeMax.z, 1)),
-            new Vertex(glm::vec4(cubeMax.x, cubeMin.y, cubeMax.z, 1)),
-            new Vertex(glm::vec4(cubeMin.x, cubeMax.y, cubeMin.z, 1)),
-            new Vertex(glm::vec4(cubeMin.x, cubeMin.y, cubeMin.z, 1)),
-            new Vertex(glm::vec4(cubeMin.x, cubeMax.y, cubeMax.z, 1)),
-            new Vertex(glm::vec4(cubeMin.x, cubeMin.y, cubeMax.z, 1))
+            arena.create<Vertex>(glm::vec4(cubeMax.x, cubeMax.y, cubeMin.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMax.x, cubeMin.y, cubeMin.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMax.x, cubeMax.y, cubeMax.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMax.x, cubeMin.y, cubeMax.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMin.x, cubeMax.y, cubeMin.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMin.x, cubeMin.y, cubeMin.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMin.x, cubeMax.y, cubeMax.z, 1)),
+            arena.create<Vertex>(glm::vec4(cubeMin.x, cubeMin.y, cubeMax.z, 1))
         };
         GLuints indices = {
             5, 3, 1,    3, 8, 4,
@@ -31,7 +31,7 @@ public:
             1, 3, 4,    5, 1, 2
         };
         for (size_t i = 0; i < indices.size(); i += 3) {
-            faces.push_back(new Face(verts[indices[i] - 1], verts[indices[i + 1] - 1], verts[indices[i + 2] - 1]));
+            faces.push_back(arena.create<Face>(verts[indices[i] - 1], verts[indices[i + 1] - 1], verts[indices[i + 2] - 1]));
         }
         vec4s _verts;
         vec4s _normals;
@@ -46,26 +46,7 @@ public:
             }
         }
 
-        glGenVertexArrays(1, &VAO);
-        buffers.resize(3);  // v, n, vt
-        glGenBuffers(3, buffers.data());
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-        glBufferData(GL_ARRAY_BUFFER, _verts.size() * sizeof(glm::vec4), _verts.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-        glBufferData(GL_ARRAY_BUFFER, _normals.size() * sizeof(glm::vec4), _normals.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(GLuint), _indices.data(), GL_STATIC_DRAW);
-
-        glBindVertexArray(0);
-
+        uploadBuffers(_verts, _normals, _indices);
     }
     
     void update() final {
@@ -8,7 +8,12 @@
 #pragma once
 
 #include "Object.hpp"
+#include "Arena.hpp"
+#include "ThreadPool.hpp"
 #include <tiny_obj_loader.h>
+#include <memory>
+
+class MeshCache;
 
 struct Vertex {
     glm::vec4 position;
@@ -35,16 +40,95 @@ class Mesh : public Object {
 public:
     GLuint VAO;
     GLuints buffers;
-    
+    GLsizei indexCount = 0;
+
+    /// Owns every Vertex/Edge/Face (and whatever subclasses build); freed with the mesh.
+    Arena arena;
+
+    /// CPU-side topology. Left empty by GPU-only meshes (e.g. Cloth), which keep
+    /// their own topology and only need the buffers and indexCount to draw.
     std::vector<Vertex*> verts;
     std::vector<Edge*> edges;
     std::vector<Face*> faces;
 
+    /// Set on meshes uploaded from a mapped cache; keeps the mapping, and with
+    /// it the flat arrays the buffers came from, alive and readable.
+    std::shared_ptr<const MeshCache> cache;
+
     /// Dummy constructor
     explicit Mesh(const std::string& name) : Object(name) {
         matrix_world = glm::mat4(1);
     }
 
+    /// Create the VAO with position (0), normal (1) and index buffers.
+    void uploadBuffers(const vec4s& positions, const vec4s& normals, const GLuints& indices, GLenum usage = GL_STATIC_DRAW) {
+        uploadBuffers(positions.data(), normals.data(), positions.size(), indices.data(), indices.size(), usage);
+    }
+
+    /// Same, from raw arrays (e.g. a mapped file), with vertexCount positions and normals.
+    void uploadBuffers(const glm::vec4* positions, const glm::vec4* normals, size_t vertexCount,
+                       const GLuint* indices, size_t count, GLenum usage = GL_STATIC_DRAW) {
+        glGenVertexArrays(1, &VAO);
+        buffers.resize(3);  // v, n, vt
+        glGenBuffers(3, buffers.data());
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec4), positions, usage);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec4), normals, usage);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint), indices, usage);
+
+        glBindVertexArray(0);
+        indexCount = static_cast<GLsizei>(count);
+    }
+
+    /// Construct a mesh from flat arrays, 3 indices per triangle. The CPU
+    /// topology is placed in three contiguous arena blocks and filled in parallel.
+    explicit Mesh(const std::string& name, const vec4s& positions, const vec4s& normals, const GLuints& indices) : Object(name) {
+        matrix_world = glm::mat4(1);
+
+        const size_t numVerts = positions.size();
+        const size_t numFaces = indices.size() / 3;
+        Vertex* vertexBlock = static_cast<Vertex*>(arena.allocate(numVerts * sizeof(Vertex), alignof(Vertex)));
+        Edge* edgeBlock = static_cast<Edge*>(arena.allocate(3 * numFaces * sizeof(Edge), alignof(Edge)));
+        Face* faceBlock = static_cast<Face*>(arena.allocate(numFaces * sizeof(Face), alignof(Face)));
+        verts.resize(numVerts);
+        edges.resize(3 * numFaces);
+        faces.resize(numFaces);
+
+        ThreadPool& pool = ThreadPool::shared();
+        pool.parallelFor(0, static_cast<int>(numVerts), [&](int v0, int v1) {
+            for (int v = v0; v < v1; v++) {
+                verts[v] = new (vertexBlock + v) Vertex(positions[v], normals[v]);
+            }
+        });
+        // same corner order as the tinyobjloader constructor
+        pool.parallelFor(0, static_cast<int>(numFaces), [&](int f0, int f1) {
+            for (int f = f0; f < f1; f++) {
+                Vertex* v1 = verts[indices[3 * f + 2]];
+                Vertex* v2 = verts[indices[3 * f + 1]];
+                Vertex* v3 = verts[indices[3 * f]];
+                edges[3 * f]     = new (edgeBlock + 3 * f) Edge(v1, v2);
+                edges[3 * f + 1] = new (edgeBlock + 3 * f + 1) Edge(v2, v3);
+                edges[3 * f + 2] = new (edgeBlock + 3 * f + 2) Edge(v3, v1);
+                faces[f] = new (faceBlock + f) Face(v1, v2, v3);
+            }
+        });
+
+        std::cout << "Loaded " << name << "; ";
+        std::cout << verts.size() << " vertices, " << faces.size() << " faces. " << std::endl;
+
+        uploadBuffers(positions, normals, indices);
+    }
+
     /// Construct a mesh from tinyobjloader values.
     explicit Mesh(const std::string& name,
                   const tinyobj::attrib_t& attrib,
@@ -58,12 +142,19 @@ public:
         vec4s _normals;
         GLuints _indices;
 
+        const size_t numVerts = attrib.vertices.size() / 3;
+        const size_t numFaces = mesh.num_face_vertices.size();
+        arena.reserve(numVerts * sizeof(Vertex) + numFaces * (3 * sizeof(Edge) + sizeof(Face)) + 64);
+        verts.reserve(numVerts);
+        edges.reserve(3 * numFaces);
+        faces.reserve(numFaces);
+
         for (size_t v = 0; v < attrib.vertices.size(); v += 3) {
             const GLfloat vx = attrib.vertices[v];
             const GLfloat vy = attrib.vertices[v + 1];
             const GLfloat vz = attrib.vertices[v + 2];
             _verts.push_back(glm::vec4(vx, vy, vz, 1));
-            verts.push_back(new Vertex(_verts.back()));
+            verts.push_back(arena.create<Vertex>(_verts.back()));
         }
 
         // Loop-add, triangulated
@@ -85,10 +176,10 @@ public:
             auto v1 = verts[*(_indices.end() - 1)];
             auto v2 = verts[*(_indices.end() - 2)];
             auto v3 = verts[*(_indices.end() - 3)];
-            edges.push_back(new Edge(v1, v2));
-            edges.push_back(new Edge(v2, v3));
-            edges.push_back(new Edge(v3, v1));
-            faces.push_back(new Face(v1, v2, v3));
+            edges.push_back(arena.create<Edge>(v1, v2));
+            edges.push_back(arena.create<Edge>(v2, v3));
+            edges.push_back(arena.create<Edge>(v3, v1));
+            faces.push_back(arena.create<Face>(v1, v2, v3));
             index_offset += fv;
         }
 
@@ -99,45 +190,21 @@ public:
         std::cout << "Loaded " << name << "; ";
         std::cout << verts.size() << " vertices, " << faces.size() << " faces. " << std::endl;
         
-        glGenVertexArrays(1, &VAO);
-        buffers.resize(3);  // v, n, vt
-        glGenBuffers(3, buffers.data());
-        glBindVertexArray(VAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-        glBufferData(GL_ARRAY_BUFFER, _verts.size() * sizeof(glm::vec4), _verts.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-        glBufferData(GL_ARRAY_BUFFER, _normals.size() * sizeof(glm::vec4), _normals.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(GLuint), _indices.data(), GL_STATIC_DRAW);
-
-        glBindVertexArray(0);
-        
+        uploadBuffers(_verts, _normals, _indices);
     }
     
     ~Mesh() {
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(3, buffers.data());
-        verts.clear();
-        edges.clear();
-        faces.clear();
+        if (!buffers.empty()) {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+        }
+        // verts/edges/faces live in the arena, which releases its blocks here
     }
     
-    void draw(Shader* shader) final {
-        glm::mat4 invT = glm::inverse(glm::transpose(matrix_world));
-
-        GLuint program = shader->program;
-        glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(matrix_world));
-        glUniformMatrix4fv(glGetUniformLocation(program, "invT"), 1, GL_FALSE, glm::value_ptr(invT));
-
+    /// Expects the scene to have bound the object's model block.
+    void draw(Shader*) override {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<int>(faces.size()) * 3, GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
     }
     
     virtual void update() {}
@@ -24,4 +24,17 @@ public:
     
     virtual viewer::ObjectType getType() = 0;
     
+    /// The inverse transpose of matrix_world, for normals. Only recomputed
+    /// when matrix_world has changed since the last call.
+    const glm::mat4& normalMatrix() {
+        if (matrix_world != normalSource) {
+            normalSource = matrix_world;
+            normalCache = glm::inverse(glm::transpose(matrix_world));
+        }
+        return normalCache;
+    }
+    
+private:
+    glm::mat4 normalSource = glm::mat4(0);
+    glm::mat4 normalCache = glm::mat4(1);
 }; 
@@ -8,11 +8,12 @@
 #pragma once
 
 #include "core.hpp"
+#include "UniformBlocks.hpp"
 
 class Shader {
 private:
-    GLuint vs;
-    GLuint fs;
+    GLuint vs = 0;
+    GLuint fs = 0;
     GLint vscs = 0;
     GLint fscs = 0;
     GLint linked = 0;
@@ -20,6 +21,7 @@ private:
     std::string fsf;
     std::string vsfn;
     std::string fsfn;
+    bool owned = true;   // false while borrowing another shader's program
     
     std::string read(const std::string& fn) {
         std::ifstream in(fn);
@@ -60,10 +62,35 @@ public:
         compile();
     }
     
+    /// Adopts a linked program, e.g. one restored from a program binary. A
+    /// borrowed program, like a fallback's while this one still compiles, is
+    /// not deleted with the shader and leaves it not ready().
+    Shader(const std::string& name, GLuint program, bool owned = true) : owned(owned), name(name), program(program) {
+        linked = owned;
+        if (owned) {
+            bindBlocks();
+        }
+    }
+    
     ~Shader() {
-        glDeleteProgram(program);
+        if (owned) {
+            glDeleteProgram(program);
+        }
     }
     
+    /// Takes over a newly linked program in place of the current one.
+    void adopt(GLuint linkedProgram) {
+        if (owned) {
+            glDeleteProgram(program);
+        }
+        program = linkedProgram;
+        owned = true;
+        linked = 1;
+        bindBlocks();
+    }
+    
+    bool ready() const { return linked != 0; }
+    
     void read (const std::string& vsfn, const std::string& fsfn) {
         this->vsfn = vsfn;
         this->fsfn = fsfn;
@@ -101,11 +128,24 @@ public:
             glDetachShader(program, fs);
             glDeleteShader(vs);
             glDeleteShader(fs);
+            bindBlocks();
         } else {
             getShaderProgramErrors(program);
             throw std::runtime_error("Shader program linking failed");
         }
     }
+    /// Points the program's uniform blocks at the bindings the scene fills,
+    /// once per link rather than by name on every draw.
+    void bindBlocks() {
+        const GLuint camera = glGetUniformBlockIndex(program, "Camera");
+        if (camera != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, camera, CAMERA_BLOCK_BINDING);
+        }
+        const GLuint model = glGetUniformBlockIndex(program, "Model");
+        if (model != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, model, MODEL_BLOCK_BINDING);
+        }
+    }
     GLint getVertexShaderCompileStatus() { return vscs; }
     GLint getFragmentShaderCompileStatus() { return fscs; }
     GLint getLinkStatus() { return linked; }
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small persistent worker pool. parallelFor splits an index range into one
+// contiguous slab per thread (the caller runs one too) and returns when all are
+// done; while waiting, the caller helps with queued tasks so nested use from
+// inside a task cannot deadlock.
+
+class ThreadPool {
+public:
+    /// threads = 0 uses one worker per hardware thread beyond the caller's.
+    explicit ThreadPool(unsigned threads = 0) : stopping(false) {
+        if (threads == 0) {
+            unsigned hw = std::thread::hardware_concurrency();
+            threads = hw > 1 ? hw - 1 : 0;
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    /// Number of threads a parallelFor can use, including the caller.
+    int concurrency() const { return static_cast<int>(workers.size()) + 1; }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    /// fn(slabBegin, slabEnd) over disjoint slabs covering [begin, end).
+    void parallelFor(int begin, int end, const std::function<void(int, int)>& fn) {
+        const int n = end - begin;
+        if (n <= 0) return;
+        const int slabs = std::min(n, concurrency());
+        if (slabs == 1) {
+            fn(begin, end);
+            return;
+        }
+
+        std::atomic<int> remaining(slabs - 1);
+        auto slab = [=](int s) { return begin + int((long long)n * s / slabs); };
+        for (int s = 1; s < slabs; s++) {
+            submit([&, s] {
+                fn(slab(s), slab(s + 1));
+                remaining--;
+            });
+        }
+        fn(slab(0), slab(1));
+        while (remaining > 0) {
+            if (!runOne()) std::this_thread::yield();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+
+    bool runOne() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
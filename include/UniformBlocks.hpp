@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Uniform blocks the shaders share, so a frame sets the camera once and each
+// object's matrices with one buffer range bind, instead of looking uniforms
+// up by name on every draw. The structs follow the std140 layout of the
+// blocks declared in shaders/.
+
+enum UniformBinding : GLuint {
+    CAMERA_BLOCK_BINDING = 0,
+    MODEL_BLOCK_BINDING = 1
+};
+
+struct CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewInv;
+    glm::mat4 projInv;
+    float zNear;
+    float zFar;
+    float padding[2];
+};
+static_assert(sizeof(CameraBlock) == 272, "CameraBlock follows std140");
+
+struct ModelBlock {
+    glm::mat4 model;
+    glm::mat4 invT;   // for the normals
+};
+static_assert(sizeof(ModelBlock) == 128, "ModelBlock follows std140");
+
+// One uniform buffer holding a few frames of per-object blocks. Each frame
+// writes all of its blocks into the next segment with a single unsynchronized
+// map, after a fence shows the GPU is done with what that segment held three
+// frames ago, and draws bind ranges of it. The buffer grows with the number
+// of objects.
+class UniformRing {
+public:
+    static constexpr int FRAMES = 3;
+
+    explicit UniformRing(size_t blockSize) : blockSize(blockSize) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = (blockSize + size_t(alignment) - 1) / size_t(alignment) * size_t(alignment);
+        glGenBuffers(1, &buffer);
+    }
+
+    ~UniformRing() {
+        for (GLsync& fence : fences) {
+            if (fence) { glDeleteSync(fence); }
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    /// Starts a frame with count packed blocks.
+    void upload(const void* blocks, size_t count) {
+        segment = (segment + 1) % FRAMES;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (count > capacity) {
+            // a new store; the old one lives on until the GPU is done with it
+            for (GLsync& fence : fences) {
+                if (fence) { glDeleteSync(fence); }
+                fence = nullptr;
+            }
+            capacity = std::max(count, 2 * capacity);
+            glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(FRAMES * capacity * stride), nullptr, GL_STREAM_DRAW);
+        }
+        if (fences[segment]) {
+            glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            glDeleteSync(fences[segment]);
+            fences[segment] = nullptr;
+        }
+        if (count == 0) { return; }
+
+        char* out = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, GLintptr(segment * capacity * stride),
+                                                        GLsizeiptr(count * stride),
+                                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (!out) { return; }
+        const char* in = static_cast<const char*>(blocks);
+        for (size_t i = 0; i < count; i++) {
+            memcpy(out + i * stride, in + i * blockSize, blockSize);
+        }
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+
+    /// Points binding at this frame's block index.
+    void bind(GLuint binding, size_t index) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, GLintptr((segment * capacity + index) * stride), GLsizeiptr(blockSize));
+    }
+
+    /// Ends the frame once its draws are issued.
+    void finish() {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    GLuint buffer = 0;
+    size_t blockSize;
+    size_t stride;
+    size_t capacity = 0;   // blocks per segment
+    size_t segment = 0;
+    GLsync fences[FRAMES] = {};
+};
@@ -1,9 +1,13 @@
 #version 330 core
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform float zNear;
-uniform float zFar;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewInv;
+    mat4 projInv;
+    float zNear;
+    float zFar;
+};
 
 in vec3 near;
 in vec3 far;
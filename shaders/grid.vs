@@ -1,10 +1,14 @@
 #version 330 core
 
 layout (location = 0) in vec4 position;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 viewInv;
-uniform mat4 projInv;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewInv;
+    mat4 projInv;
+    float zNear;
+    float zFar;
+};
 
 out vec3 near;
 out vec3 far;
@@ -2,10 +2,6 @@
 
 in vec3 normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
 // uniforms used for lighting
 // You can change these colors, or even pass them in from the cpu side.
 uniform vec3 AmbientColor = vec3(0.2);
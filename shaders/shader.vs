@@ -3,10 +3,19 @@
 layout (location = 0) in vec4 position_in;
 layout (location = 1) in vec4 normal_in;
 
-uniform mat4 model;
-uniform mat4 invT;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    mat4 viewInv;
+    mat4 projInv;
+    float zNear;
+    float zFar;
+};
+
+layout (std140) uniform Model {
+    mat4 model;
+    mat4 invT;
+};
 
 out vec3 normal;
 
@@ -0,0 +1,354 @@
+#include "AirSolver.hpp"
+#include "Cloth.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // where each face grid sits, in cells, relative to the domain origin
+    const glm::vec3 uOffset(0.0f, 0.5f, 0.5f);
+    const glm::vec3 vOffset(0.5f, 0.0f, 0.5f);
+    const glm::vec3 wOffset(0.5f, 0.5f, 0.0f);
+
+    inline size_t index(const glm::ivec3& d, int i, int j, int k) { return (size_t(k) * d.y + j) * d.x + i; }
+
+    // trilinear lookup in grid coordinates, clamped to the grid
+    inline float lerpGrid(const std::vector<float>& f, const glm::ivec3& d, glm::vec3 g) {
+        g = glm::clamp(g, glm::vec3(0), glm::vec3(d - 1) - 1e-4f);
+        const glm::ivec3 c = glm::ivec3(g);
+        const glm::vec3 t = g - glm::vec3(c);
+        const size_t sy = size_t(d.x), sz = size_t(d.x) * d.y;
+        const size_t b = index(d, c.x, c.y, c.z);
+        const float x00 = glm::mix(f[b],           f[b + 1],           t.x);
+        const float x10 = glm::mix(f[b + sy],      f[b + sy + 1],      t.x);
+        const float x01 = glm::mix(f[b + sz],      f[b + sz + 1],      t.x);
+        const float x11 = glm::mix(f[b + sz + sy], f[b + sz + sy + 1], t.x);
+        return glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+    }
+
+    // transpose of lerpGrid: spread value over the 8 surrounding samples
+    inline void splat(std::vector<float>& f, const glm::ivec3& d, glm::vec3 g, float value) {
+        const glm::vec3 maxCoord = glm::vec3(d - 1) - 1e-4f;
+        g.x = std::min(std::max(0.0f, g.x), maxCoord.x);  // NaN-safe clamp
+        g.y = std::min(std::max(0.0f, g.y), maxCoord.y);
+        g.z = std::min(std::max(0.0f, g.z), maxCoord.z);
+        const glm::ivec3 c = glm::ivec3(g);
+        const glm::vec3 t = g - glm::vec3(c);
+        const glm::vec3 s = 1.0f - t;
+        const size_t sy = size_t(d.x), sz = size_t(d.x) * d.y;
+        const size_t b = index(d, c.x, c.y, c.z);
+        f[b]               += s.x * s.y * s.z * value;
+        f[b + 1]           += t.x * s.y * s.z * value;
+        f[b + sy]          += s.x * t.y * s.z * value;
+        f[b + sy + 1]      += t.x * t.y * s.z * value;
+        f[b + sz]          += s.x * s.y * t.z * value;
+        f[b + sz + 1]      += t.x * s.y * t.z * value;
+        f[b + sz + sy]     += s.x * t.y * t.z * value;
+        f[b + sz + sy + 1] += t.x * t.y * t.z * value;
+    }
+
+    void fillShell(std::vector<float>& f, const glm::ivec3& d, float value) {
+        for (int k = 0; k < d.z; k++) {
+            for (int j = 0; j < d.y; j++) {
+                const bool face = k == 0 || k == d.z - 1 || j == 0 || j == d.y - 1;
+                const int stride = face ? 1 : d.x - 1;
+                for (int i = 0; i < d.x; i += stride) {
+                    f[index(d, i, j, k)] = value;
+                }
+            }
+        }
+    }
+
+    // neighbours inside the domain; the walls carry no pressure gradient
+    inline float diagonal(const glm::ivec3& c, int i, int j, int k) {
+        return float(6 - (i == 1) - (i == c.x) - (j == 1) - (j == c.y) - (k == 1) - (k == c.z));
+    }
+}
+
+AirSolver::AirSolver(glm::vec3 origin, glm::vec3 extent, float cellSize, glm::vec3 ambientWind)
+    : ambientWind(ambientWind), origin(origin), extent(extent), cellSize(cellSize) {
+    vCycles = 2;
+    smoothingSweeps = 2;
+    resize();
+}
+
+void AirSolver::setCellSize(float size) {
+    cellSize = size;
+    resize();
+}
+
+void AirSolver::resize() {
+    // cells per axis rounded up to a multiple of 4 so there are at least three levels
+    cells = glm::ivec3(glm::ceil(extent / cellSize));
+    cells = glm::max((cells + 3) / 4 * 4, glm::ivec3(4));
+
+    const glm::ivec3 du = cells + glm::ivec3(1, 0, 0);
+    const glm::ivec3 dv = cells + glm::ivec3(0, 1, 0);
+    const glm::ivec3 dw = cells + glm::ivec3(0, 0, 1);
+    u.assign(size_t(du.x) * du.y * du.z, ambientWind.x);
+    v.assign(size_t(dv.x) * dv.y * dv.z, ambientWind.y);
+    w.assign(size_t(dw.x) * dw.y * dw.z, ambientWind.z);
+    u0.resize(u.size()); v0.resize(v.size()); w0.resize(w.size());
+    au.assign(u.size(), 0.0f); av.assign(v.size(), 0.0f); aw.assign(w.size(), 0.0f);
+
+    const glm::ivec3 dn = cells + 1;
+    nodeU.assign(size_t(dn.x) * dn.y * dn.z, ambientWind.x);
+    nodeV.assign(nodeU.size(), ambientWind.y);
+    nodeW.assign(nodeU.size(), ambientWind.z);
+
+    levels.clear();
+    glm::ivec3 c = cells;
+    float h = cellSize;
+    for (;;) {
+        Level level;
+        level.cells = c;
+        level.h = h;
+        const glm::ivec3 d = c + 2;
+        const size_t n = size_t(d.x) * d.y * d.z;
+        level.p.assign(n, 0.0f);
+        level.rhs.assign(n, 0.0f);
+        level.residual.assign(n, 0.0f);
+        levels.push_back(std::move(level));
+
+        if (c.x % 2 || c.y % 2 || c.z % 2 || glm::min(c.x, glm::min(c.y, c.z)) < 4) break;
+        c /= 2;
+        h *= 2.0f;
+    }
+}
+
+void AirSolver::sample(const float* x, const float* y, const float* z, size_t n,
+                       float* outX, float* outY, float* outZ) const {
+    sampleLattice(nodeU.data(), nodeV.data(), nodeW.data(), cells + 1, origin, 1.0f / cellSize,
+                  x, y, z, n, outX, outY, outZ);
+}
+
+void AirSolver::addForce(const float* x, const float* y, const float* z,
+                         const float* fx, const float* fy, const float* fz,
+                         size_t n, float scale) {
+    // force -> acceleration of the air in one cell
+    const float toAccel = scale / (AIR_DENSITY * cellSize * cellSize * cellSize);
+    const float invCellSize = 1.0f / cellSize;
+    const glm::ivec3 du = cells + glm::ivec3(1, 0, 0);
+    const glm::ivec3 dv = cells + glm::ivec3(0, 1, 0);
+    const glm::ivec3 dw = cells + glm::ivec3(0, 0, 1);
+    for (size_t p = 0; p < n; p++) {
+        const glm::vec3 g = (glm::vec3(x[p], y[p], z[p]) - origin) * invCellSize;
+        splat(au, du, g - uOffset, toAccel * fx[p]);
+        splat(av, dv, g - vOffset, toAccel * fy[p]);
+        splat(aw, dw, g - wOffset, toAccel * fz[p]);
+    }
+}
+
+void AirSolver::step(float timestep) {
+    auto accelerate = [timestep](std::vector<float>& f, std::vector<float>& a) {
+        for (size_t n = 0; n < f.size(); n++) {
+            f[n] += timestep * a[n];
+            a[n] = 0.0f;
+        }
+    };
+    accelerate(u, au);
+    accelerate(v, av);
+    accelerate(w, aw);
+
+    enforceBoundary();
+    advect(timestep);
+    enforceBoundary();
+    project();
+    updateNodes();
+}
+
+void AirSolver::enforceBoundary() {
+    // open domain: the outermost faces carry the ambient wind
+    fillShell(u, cells + glm::ivec3(1, 0, 0), ambientWind.x);
+    fillShell(v, cells + glm::ivec3(0, 1, 0), ambientWind.y);
+    fillShell(w, cells + glm::ivec3(0, 0, 1), ambientWind.z);
+}
+
+void AirSolver::advect(float timestep) {
+    u0.swap(u); v0.swap(v); w0.swap(w);
+    const float scale = timestep / cellSize;
+    const glm::ivec3 du = cells + glm::ivec3(1, 0, 0);
+    const glm::ivec3 dv = cells + glm::ivec3(0, 1, 0);
+    const glm::ivec3 dw = cells + glm::ivec3(0, 0, 1);
+
+    // trace each face back along the velocity and fetch the old value there
+    auto advectGrid = [&](std::vector<float>& dst, const std::vector<float>& src,
+                          const glm::ivec3& d, const glm::vec3& offset) {
+        ThreadPool::shared().parallelFor(0, d.z, [&](int k0, int k1) {
+            for (int k = k0; k < k1; k++) {
+                for (int j = 0; j < d.y; j++) {
+                    for (int i = 0; i < d.x; i++) {
+                        const glm::vec3 g = glm::vec3(i, j, k) + offset;
+                        const glm::vec3 velocity(lerpGrid(u0, du, g - uOffset),
+                                                 lerpGrid(v0, dv, g - vOffset),
+                                                 lerpGrid(w0, dw, g - wOffset));
+                        dst[index(d, i, j, k)] = lerpGrid(src, d, g - scale * velocity - offset);
+                    }
+                }
+            }
+        });
+    };
+    advectGrid(u, u0, du, uOffset);
+    advectGrid(v, v0, dv, vOffset);
+    advectGrid(w, w0, dw, wOffset);
+}
+
+void AirSolver::project() {
+    Level& fine = levels[0];
+    const glm::ivec3 c = cells;
+    const glm::ivec3 dp = c + 2;
+    const glm::ivec3 du = c + glm::ivec3(1, 0, 0);
+    const glm::ivec3 dv = c + glm::ivec3(0, 1, 0);
+    const glm::ivec3 dw = c + glm::ivec3(0, 0, 1);
+    const float invH = 1.0f / cellSize;
+
+    ThreadPool::shared().parallelFor(0, c.z, [&](int k0, int k1) {
+        for (int k = k0; k < k1; k++) {
+            for (int j = 0; j < c.y; j++) {
+                for (int i = 0; i < c.x; i++) {
+                    fine.rhs[index(dp, i + 1, j + 1, k + 1)] = invH * (u[index(du, i + 1, j, k)] - u[index(du, i, j, k)] +
+                                                                       v[index(dv, i, j + 1, k)] - v[index(dv, i, j, k)] +
+                                                                       w[index(dw, i, j, k + 1)] - w[index(dw, i, j, k)]);
+                }
+            }
+        }
+    });
+
+    // fine.p keeps last step's pressure as the initial guess
+    for (int cycle = 0; cycle < vCycles; cycle++) {
+        vCycle(0);
+    }
+
+    // subtract the gradient on interior faces; wall faces keep the ambient wind
+    ThreadPool::shared().parallelFor(0, c.z, [&](int k0, int k1) {
+        const float* p = fine.p.data();
+        const size_t sz = size_t(dp.x) * dp.y;
+        for (int k = k0; k < k1; k++) {
+            for (int j = 0; j < c.y; j++) {
+                for (int i = 0; i < c.x; i++) {
+                    const size_t n = index(dp, i + 1, j + 1, k + 1);
+                    if (i > 0) u[index(du, i, j, k)] -= invH * (p[n] - p[n - 1]);
+                    if (j > 0) v[index(dv, i, j, k)] -= invH * (p[n] - p[n - dp.x]);
+                    if (k > 0) w[index(dw, i, j, k)] -= invH * (p[n] - p[n - sz]);
+                }
+            }
+        }
+    });
+}
+
+void AirSolver::updateNodes() {
+    const glm::ivec3 dn = cells + 1;
+    const glm::ivec3 du = cells + glm::ivec3(1, 0, 0);
+    const glm::ivec3 dv = cells + glm::ivec3(0, 1, 0);
+    const glm::ivec3 dw = cells + glm::ivec3(0, 0, 1);
+    ThreadPool::shared().parallelFor(0, dn.z, [&](int k0, int k1) {
+        for (int k = k0; k < k1; k++) {
+            for (int j = 0; j < dn.y; j++) {
+                for (int i = 0; i < dn.x; i++) {
+                    const glm::vec3 g(i, j, k);
+                    const size_t n = index(dn, i, j, k);
+                    nodeU[n] = lerpGrid(u, du, g - uOffset);
+                    nodeV[n] = lerpGrid(v, dv, g - vOffset);
+                    nodeW[n] = lerpGrid(w, dw, g - wOffset);
+                }
+            }
+        }
+    });
+}
+
+void AirSolver::vCycle(size_t l) {
+    Level& level = levels[l];
+    if (l + 1 == levels.size()) {
+        smooth(level, 16 * smoothingSweeps);
+        return;
+    }
+    Level& coarse = levels[l + 1];
+
+    smooth(level, smoothingSweeps);
+    computeResidual(level);
+    restrictResidual(level, coarse);
+    std::fill(coarse.p.begin(), coarse.p.end(), 0.0f);
+    vCycle(l + 1);
+    prolongCorrection(coarse, level);
+    smooth(level, smoothingSweeps);
+}
+
+void AirSolver::smooth(Level& level, int sweeps) {
+    // red-black Gauss-Seidel on the 7-point Laplacian; cells of one colour only
+    // read the other, so slabs run in parallel
+    const glm::ivec3 c = level.cells;
+    const glm::ivec3 d = c + 2;
+    const float h2 = level.h * level.h;
+    const size_t sy = size_t(d.x), sz = size_t(d.x) * d.y;
+    for (int s = 0; s < sweeps; s++) {
+        for (int colour = 0; colour < 2; colour++) {
+            ThreadPool::shared().parallelFor(1, c.z + 1, [&](int k0, int k1) {
+                float* p = level.p.data();
+                const float* rhs = level.rhs.data();
+                for (int k = k0; k < k1; k++) {
+                    for (int j = 1; j <= c.y; j++) {
+                        for (int i = 1 + ((j + k + colour) & 1); i <= c.x; i += 2) {
+                            const size_t n = index(d, i, j, k);
+                            p[n] = (p[n - 1] + p[n + 1] + p[n - sy] + p[n + sy] + p[n - sz] + p[n + sz] - h2 * rhs[n]) / diagonal(c, i, j, k);
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+void AirSolver::computeResidual(Level& level) {
+    const glm::ivec3 c = level.cells;
+    const glm::ivec3 d = c + 2;
+    const float invH2 = 1.0f / (level.h * level.h);
+    const size_t sy = size_t(d.x), sz = size_t(d.x) * d.y;
+    ThreadPool::shared().parallelFor(1, c.z + 1, [&](int k0, int k1) {
+        const float* p = level.p.data();
+        for (int k = k0; k < k1; k++) {
+            for (int j = 1; j <= c.y; j++) {
+                for (int i = 1; i <= c.x; i++) {
+                    const size_t n = index(d, i, j, k);
+                    const float lap = (p[n - 1] + p[n + 1] + p[n - sy] + p[n + sy] + p[n - sz] + p[n + sz] - diagonal(c, i, j, k) * p[n]) * invH2;
+                    level.residual[n] = level.rhs[n] - lap;
+                }
+            }
+        }
+    });
+}
+
+void AirSolver::restrictResidual(const Level& fine, Level& coarse) {
+    // each coarse cell averages its 8 children
+    const glm::ivec3 fd = fine.cells + 2;
+    const glm::ivec3 cc = coarse.cells, cd = cc + 2;
+    const size_t sy = size_t(fd.x), sz = size_t(fd.x) * fd.y;
+    ThreadPool::shared().parallelFor(1, cc.z + 1, [&](int k0, int k1) {
+        const float* r = fine.residual.data();
+        for (int k = k0; k < k1; k++) {
+            for (int j = 1; j <= cc.y; j++) {
+                for (int i = 1; i <= cc.x; i++) {
+                    const size_t n = index(fd, 2 * i - 1, 2 * j - 1, 2 * k - 1);
+                    coarse.rhs[index(cd, i, j, k)] = 0.125f * (r[n] + r[n + 1] + r[n + sy] + r[n + sy + 1] +
+                                                               r[n + sz] + r[n + sz + 1] + r[n + sz + sy] + r[n + sz + sy + 1]);
+                }
+            }
+        }
+    });
+}
+
+void AirSolver::prolongCorrection(const Level& coarse, Level& fine) {
+    // trilinear between coarse cell centres, held flat in the outer half cell
+    const glm::ivec3 fc = fine.cells, fd = fc + 2;
+    const glm::ivec3 cc = coarse.cells, cd = cc + 2;
+    ThreadPool::shared().parallelFor(1, fc.z + 1, [&](int k0, int k1) {
+        for (int k = k0; k < k1; k++) {
+            for (int j = 1; j <= fc.y; j++) {
+                for (int i = 1; i <= fc.x; i++) {
+                    const glm::vec3 g = glm::clamp(0.5f * glm::vec3(i, j, k) + 0.25f, glm::vec3(1), glm::vec3(cc));
+                    fine.p[index(fd, i, j, k)] += lerpGrid(coarse.p, cd, g);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Airflow.hpp"
+
+// Coarse Eulerian air around the cloth (Stam's stable fluids) on a staggered
+// MAC grid: forces splatted from the cloth, semi-Lagrangian advection and a
+// multigrid pressure projection. The outer layer of faces is held at
+// ambientWind. Each pass is split into z slabs over ThreadPool::shared().
+
+class AirSolver : public Airflow {
+public:
+    glm::vec3 ambientWind;
+    int vCycles;           // multigrid V-cycles per projection
+    int smoothingSweeps;   // red-black Gauss-Seidel sweeps before/after each coarsening
+
+    // the domain [origin, origin + extent] is divided into cells of cellSize
+    AirSolver(glm::vec3 origin, glm::vec3 extent, float cellSize, glm::vec3 ambientWind);
+
+    /// Resolution knob; cost grows as (extent / cellSize)^3. Resets the flow to ambient.
+    void setCellSize(float cellSize);
+    float getCellSize() const { return cellSize; }
+    glm::ivec3 getCells() const { return cells; }
+
+    /// Apply the forces gathered since the last step, advect and project.
+    void step(float timestep);
+
+    void sample(const float* x, const float* y, const float* z, size_t n,
+                float* outX, float* outY, float* outZ) const override;
+
+    bool isCoupled() const override { return true; }
+
+    void addForce(const float* x, const float* y, const float* z,
+                  const float* fx, const float* fy, const float* fz,
+                  size_t n, float scale) override;
+
+private:
+    // pressure hierarchy; arrays carry one ghost cell per side that stays zero
+    struct Level {
+        glm::ivec3 cells;
+        float h;
+        std::vector<float> p, rhs, residual;
+    };
+
+    glm::vec3 origin;
+    glm::vec3 extent;
+    glm::ivec3 cells;
+    float cellSize;
+
+    // face velocities: u on x-faces, v on y-faces, w on z-faces, x fastest
+    std::vector<float> u, v, w;
+    std::vector<float> u0, v0, w0;   // advection source
+    std::vector<float> au, av, aw;   // accelerations gathered from the cloth
+    // velocities at cell corners, rebuilt every step for sample()
+    std::vector<float> nodeU, nodeV, nodeW;
+    std::vector<Level> levels;       // [0] matches the velocity grid
+
+    void resize();
+    void enforceBoundary();
+    void advect(float timestep);
+    void project();
+    void updateNodes();
+
+    void smooth(Level& level, int sweeps);
+    void computeResidual(Level& level);
+    void restrictResidual(const Level& fine, Level& coarse);
+    void prolongCorrection(const Level& coarse, Level& fine);
+    void vCycle(size_t l);
+};
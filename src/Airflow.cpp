@@ -0,0 +1,48 @@
+#include "Airflow.hpp"
+
+#include <algorithm>
+
+void sampleLattice(const float* u, const float* v, const float* w,
+                   glm::ivec3 dims, glm::vec3 origin, float invCellSize,
+                   const float* x, const float* y, const float* z, size_t n,
+                   float* outX, float* outY, float* outZ) {
+    const glm::vec3 maxCoord = glm::vec3(dims - 1) - 1e-4f;
+    size_t cached = size_t(-1);
+    float cu[8], cv[8], cw[8];
+
+    for (size_t p = 0; p < n; p++) {
+        // max(0, NaN) is 0, so a blown-up cloth still samples inside the lattice
+        glm::vec3 g = (glm::vec3(x[p], y[p], z[p]) - origin) * invCellSize;
+        g.x = std::min(std::max(0.0f, g.x), maxCoord.x);
+        g.y = std::min(std::max(0.0f, g.y), maxCoord.y);
+        g.z = std::min(std::max(0.0f, g.z), maxCoord.z);
+        const glm::ivec3 c = glm::ivec3(g);
+        const glm::vec3 f = g - glm::vec3(c);
+
+        const size_t base = (size_t(c.z) * dims.y + c.y) * dims.x + c.x;
+        if (base != cached) {
+            const size_t sy = size_t(dims.x), sz = size_t(dims.x) * dims.y;
+            const size_t corner[8] = { base, base + 1, base + sy, base + sy + 1,
+                                       base + sz, base + sz + 1, base + sz + sy, base + sz + sy + 1 };
+            for (int q = 0; q < 8; q++) {
+                cu[q] = u[corner[q]];
+                cv[q] = v[corner[q]];
+                cw[q] = w[corner[q]];
+            }
+            cached = base;
+        }
+
+        const float wx0 = 1.0f - f.x, wy0 = 1.0f - f.y, wz0 = 1.0f - f.z;
+        const float weight[8] = { wx0 * wy0 * wz0, f.x * wy0 * wz0, wx0 * f.y * wz0, f.x * f.y * wz0,
+                                  wx0 * wy0 * f.z, f.x * wy0 * f.z, wx0 * f.y * f.z, f.x * f.y * f.z };
+        float su = 0.0f, sv = 0.0f, sw = 0.0f;
+        for (int q = 0; q < 8; q++) {
+            su += weight[q] * cu[q];
+            sv += weight[q] * cv[q];
+            sw += weight[q] * cw[q];
+        }
+        outX[p] = su;
+        outY[p] = sv;
+        outZ[p] = sw;
+    }
+}
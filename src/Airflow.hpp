@@ -0,0 +1,30 @@
+#pragma once
+
+#include "core.hpp"
+
+// Anything cloth triangles can read wind from. Two-way coupled media also take
+// the reaction of the aerodynamic force back.
+
+class Airflow {
+public:
+    virtual ~Airflow() {}
+
+    /// Air velocity at n points (SoA).
+    virtual void sample(const float* x, const float* y, const float* z, size_t n,
+                        float* outX, float* outY, float* outZ) const = 0;
+
+    virtual bool isCoupled() const { return false; }
+
+    /// Add scale * f (newtons) at n points (SoA). Only called when isCoupled().
+    virtual void addForce(const float* /*x*/, const float* /*y*/, const float* /*z*/,
+                          const float* /*fx*/, const float* /*fy*/, const float* /*fz*/,
+                          size_t /*n*/, float /*scale*/) {}
+};
+
+/// Trilinear batch sample of node values u, v, w on a lattice (x fastest) with
+/// the given origin and spacing, clamped to its bounds. Consecutive points in
+/// the same cell reuse its corner values.
+void sampleLattice(const float* u, const float* v, const float* w,
+                   glm::ivec3 dims, glm::vec3 origin, float invCellSize,
+                   const float* x, const float* y, const float* z, size_t n,
+                   float* outX, float* outY, float* outZ);
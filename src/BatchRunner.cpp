@@ -0,0 +1,110 @@
+#include "BatchRunner.hpp"
+#include "MeshCache.hpp"
+#include "SceneFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+    struct SceneResult {
+        bool ok = false;
+        std::string error;
+        size_t particles = 0;
+        int frames = 0;
+        double seconds = 0.0;
+        uint64_t checksum = 0;
+    };
+
+    SceneResult runScene(const std::string& path) {
+        SceneResult result;
+        SceneDesc scene;
+        if(!loadSceneFile(path, scene, result.error)) return result;
+
+        std::vector<Cloth*> cloths;
+        for(const ClothDesc& desc : scene.cloths) {
+            cloths.push_back(buildCloth(scene, desc, true));
+            result.particles += cloths.back()->particles.size();
+        }
+        WindField* wind = buildWind(scene);
+
+        const auto start = std::chrono::steady_clock::now();
+        for(int frame = 0; frame < scene.frames; frame++) {
+            if(wind) {
+                wind->update(TIME_STEP);
+                for(Cloth* cloth : cloths) cloth->update(*wind);
+            } else {
+                for(Cloth* cloth : cloths) cloth->update(glm::vec3(0));
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.frames = scene.frames;
+
+        // the final positions of every cloth, in declaration order
+        std::vector<glm::vec3> positions;
+        bool finite = true;
+        for(Cloth* cloth : cloths) {
+            for(const Particle* p : cloth->particles) {
+                positions.push_back(p->position);
+                finite = finite && std::isfinite(p->position.x) && std::isfinite(p->position.y) &&
+                         std::isfinite(p->position.z);
+            }
+            delete cloth;
+        }
+        delete wind;
+        result.checksum = MeshCache::hash(reinterpret_cast<const char*>(positions.data()),
+                                          positions.size() * sizeof(glm::vec3));
+
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%016" PRIx64, scene.checksum);
+        if(!finite) {
+            result.error = "positions are no longer finite";
+        } else if(scene.hasChecksum && result.checksum != scene.checksum) {
+            result.error = std::string("checksum differs from ") + expected;
+        } else {
+            result.ok = true;
+        }
+        return result;
+    }
+}
+
+int runBatch(const std::vector<std::string>& paths, unsigned jobs) {
+    if(jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min<unsigned>(jobs, std::max<size_t>(paths.size(), 1));
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    std::mutex printing;
+    auto worker = [&](int, int) {
+        for(size_t i = next++; i < paths.size(); i = next++) {
+            const SceneResult r = runScene(paths[i]);
+            std::lock_guard<std::mutex> lock(printing);
+            if(!r.error.empty() && r.frames == 0) {
+                printf("%s: FAILED, %s\n", paths[i].c_str(), r.error.c_str());
+            } else {
+                printf("%s: %d frames, %zu particles, %.2f s (%.1f frames/s), checksum %016" PRIx64 "%s%s\n",
+                       paths[i].c_str(), r.frames, r.particles, r.seconds,
+                       r.seconds > 0.0 ? r.frames / r.seconds : 0.0, r.checksum,
+                       r.ok ? "" : ", FAILED: ", r.error.c_str());
+            }
+            fflush(stdout);
+            if(!r.ok) failed++;
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    if(jobs == 1) {
+        worker(0, 1);
+    } else {
+        // the scenes get their own threads, so a scene waiting in a pass's
+        // parallelFor on the shared pool never picks up another whole scene
+        ThreadPool pool(jobs - 1);
+        pool.parallelFor(0, int(jobs), worker);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu scenes, %d failed, %.2f s on %u jobs\n", paths.size(), failed.load(), seconds, jobs);
+    return failed;
+}
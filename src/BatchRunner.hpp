@@ -0,0 +1,20 @@
+#pragma once
+
+#include "core.hpp"
+
+// Headless batch runs of scene files (see SceneFile.hpp), for regression and
+// throughput suites. Each scene is built without GL, run for its frame count
+// and reported on one line: the particle count, the wall time, frames per
+// second and a 64-bit checksum of the final particle positions. A scene that
+// declares a checksum fails if the run doesn't reproduce it, and any scene
+// fails if it can't be loaded or its positions stop being finite.
+//
+// Scenes run jobs at a time on a pool of their own, each pulling the next file
+// when it finishes, so long and short scenes balance out. The passes inside a
+// scene still split their loops over ThreadPool::shared(). A checksum holds
+// for one build on one machine: another compiler, or a different thread
+// count, can change the rounding.
+
+/// Runs every scene, printing a line per scene and a summary. Returns the
+/// number of scenes that failed. jobs = 0 runs one scene per hardware thread.
+int runBatch(const std::vector<std::string>& paths, unsigned jobs = 0);
@@ -0,0 +1,209 @@
+#include "BendingPass.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+    // signed sin(theta / 2) of the dihedral angle between N1 and N2 about E
+    float sinHalfAngle(glm::vec3 n1, glm::vec3 n2, glm::vec3 e) {
+        n1 = glm::normalize(n1);
+        n2 = glm::normalize(n2);
+        const float s = std::sqrt(std::max(0.0f, 0.5f * (1.0f - glm::dot(n1, n2))));
+        return glm::dot(glm::cross(n1, n2), e) < 0.0f ? -s : s;
+    }
+}
+
+void BendingPass::build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles,
+                        float stiffness, float damping) {
+    i1.clear(); i2.clear(); i3.clear(); i4.clear();
+    tri1.clear(); tri2.clear(); slot1.clear(); slot2.clear();
+    weight.clear(); restSinHalf.clear(); dampingEdge.clear(); minNormSq.clear();
+
+    // directed edge a -> b of the first triangle seen, as triangle * 3 + edge slot;
+    // the neighbour walks the same edge as b -> a
+    std::unordered_map<uint64_t, GLuint> open;
+    open.reserve(3 * triangles.size());
+    auto key = [](GLuint a, GLuint b) { return (uint64_t(std::min(a, b)) << 32) | std::max(a, b); };
+    auto corner = [&](GLuint t, int k) {
+        const Triangle* tri = triangles[t];
+        return (k == 0 ? tri->p1 : k == 1 ? tri->p2 : tri->p3)->particleID;
+    };
+
+    for(size_t t = 0; t < triangles.size(); t++) {
+        for(int k = 0; k < 3; k++) {
+            const GLuint a = corner(GLuint(t), k), b = corner(GLuint(t), (k + 1) % 3);
+            auto found = open.find(key(a, b));
+            if(found == open.end()) {
+                open.emplace(key(a, b), GLuint(3 * t + k));
+                continue;
+            }
+            // first triangle walked the edge as b -> a, so x3 = b, x4 = a
+            const GLuint first = found->second / 3;
+            const int firstSlot = int(found->second % 3);
+            i1.push_back(corner(first, (firstSlot + 2) % 3));
+            i2.push_back(corner(GLuint(t), (k + 2) % 3));
+            i3.push_back(b);
+            i4.push_back(a);
+            tri1.push_back(first);
+            tri2.push_back(GLuint(t));
+            slot1.push_back((unsigned char)firstSlot);
+            slot2.push_back((unsigned char)k);
+            open.erase(found);
+        }
+    }
+
+    // triangle -> its (up to 3) elements, for update()
+    triangleElements.assign(3 * triangles.size(), -1);
+    for(size_t e = 0; e < i1.size(); e++) {
+        for(GLuint t : { tri1[e], tri2[e] }) {
+            int* slots = &triangleElements[3 * t];
+            *std::find(slots, slots + 3, -1) = int(e);
+        }
+    }
+
+    const size_t ne = i1.size();
+    weight.resize(ne);
+    restSinHalf.resize(ne);
+    dampingEdge.resize(ne);
+    minNormSq.resize(ne);
+    for(size_t e = 0; e < ne; e++) {
+        const glm::vec3 x1 = particles[i1[e]]->position, x2 = particles[i2[e]]->position;
+        const glm::vec3 x3 = particles[i3[e]]->position, x4 = particles[i4[e]]->position;
+        const glm::vec3 E = x4 - x3;
+        const glm::vec3 N1 = glm::cross(x1 - x3, x1 - x4);
+        const glm::vec3 N2 = glm::cross(x2 - x4, x2 - x3);
+        weight[e] = stiffness * glm::dot(E, E) / (glm::length(N1) + glm::length(N2));
+        restSinHalf[e] = sinHalfAngle(N1, N2, E);
+        dampingEdge[e] = damping * glm::length(E);
+        minNormSq[e] = 0.0625f * std::min(glm::dot(N1, N1), glm::dot(N2, N2));
+    }
+}
+
+void BendingPass::update(const std::vector<Triangle*>& triangles, const std::vector<GLuint>& changed) {
+    auto corner = [&](GLuint t, int k) {
+        const Triangle* tri = triangles[t];
+        return (k == 0 ? tri->p1 : k == 1 ? tri->p2 : tri->p3)->particleID;
+    };
+
+    for(GLuint t : changed) {
+        for(int j = 0; j < 3; j++) {
+            const int e = triangleElements[3 * t + j];
+            if(e < 0 || weight[e] == 0.0f) continue;
+
+            // re-take the corners from the triangles; an edge the two triangles
+            // no longer share has been torn open and stops bending
+            // (tri1 walks the edge as x3 -> x4, tri2 as x4 -> x3)
+            const GLuint a = corner(tri1[e], slot1[e]), b = corner(tri1[e], (slot1[e] + 1) % 3);
+            if(corner(tri2[e], slot2[e]) != b || corner(tri2[e], (slot2[e] + 1) % 3) != a) {
+                weight[e] = 0.0f;
+                dampingEdge[e] = 0.0f;
+                continue;
+            }
+            i1[e] = corner(tri1[e], (slot1[e] + 2) % 3);
+            i2[e] = corner(tri2[e], (slot2[e] + 2) % 3);
+            i3[e] = a;
+            i4[e] = b;
+        }
+    }
+}
+
+template<bool Damped>
+void BendingPass::run(const std::vector<Particle*>& particles) {
+    const size_t ne = i1.size();
+
+    // corner positions (and velocities) gathered per block into lanes
+    float x1x[BLOCK], x1y[BLOCK], x1z[BLOCK], x2x[BLOCK], x2y[BLOCK], x2z[BLOCK];
+    float x3x[BLOCK], x3y[BLOCK], x3z[BLOCK], x4x[BLOCK], x4y[BLOCK], x4z[BLOCK];
+    float v1x[BLOCK], v1y[BLOCK], v1z[BLOCK], v2x[BLOCK], v2y[BLOCK], v2z[BLOCK];
+    float v3x[BLOCK], v3y[BLOCK], v3z[BLOCK], v4x[BLOCK], v4y[BLOCK], v4z[BLOCK];
+    // per-corner forces
+    float f1x[BLOCK], f1y[BLOCK], f1z[BLOCK], f2x[BLOCK], f2y[BLOCK], f2z[BLOCK];
+    float f3x[BLOCK], f3y[BLOCK], f3z[BLOCK], f4x[BLOCK], f4y[BLOCK], f4z[BLOCK];
+
+    for(size_t base = 0; base < ne; base += BLOCK) {
+        const int n = int(std::min<size_t>(BLOCK, ne - base));
+
+        for(int k = 0; k < n; k++) {
+            const Particle* a = particles[i1[base + k]];
+            const Particle* b = particles[i2[base + k]];
+            const Particle* c = particles[i3[base + k]];
+            const Particle* d = particles[i4[base + k]];
+            x1x[k] = a->position.x; x1y[k] = a->position.y; x1z[k] = a->position.z;
+            x2x[k] = b->position.x; x2y[k] = b->position.y; x2z[k] = b->position.z;
+            x3x[k] = c->position.x; x3y[k] = c->position.y; x3z[k] = c->position.z;
+            x4x[k] = d->position.x; x4y[k] = d->position.y; x4z[k] = d->position.z;
+            if constexpr (Damped) {
+                v1x[k] = a->velocity.x; v1y[k] = a->velocity.y; v1z[k] = a->velocity.z;
+                v2x[k] = b->velocity.x; v2y[k] = b->velocity.y; v2z[k] = b->velocity.z;
+                v3x[k] = c->velocity.x; v3y[k] = c->velocity.y; v3z[k] = c->velocity.z;
+                v4x[k] = d->velocity.x; v4y[k] = d->velocity.y; v4z[k] = d->velocity.z;
+            }
+        }
+
+        const float* __restrict w = weight.data() + base;
+        const float* __restrict rest = restSinHalf.data() + base;
+        const float* __restrict kd = dampingEdge.data() + base;
+        const float* __restrict minSq = minNormSq.data() + base;
+        for(int k = 0; k < n; k++) {
+            const float ex = x4x[k] - x3x[k], ey = x4y[k] - x3y[k], ez = x4z[k] - x3z[k];
+            // N1 = (x1 - x3) x (x1 - x4), N2 = (x2 - x4) x (x2 - x3)
+            const float a3x = x1x[k] - x3x[k], a3y = x1y[k] - x3y[k], a3z = x1z[k] - x3z[k];
+            const float a4x = x1x[k] - x4x[k], a4y = x1y[k] - x4y[k], a4z = x1z[k] - x4z[k];
+            const float b3x = x2x[k] - x3x[k], b3y = x2y[k] - x3y[k], b3z = x2z[k] - x3z[k];
+            const float b4x = x2x[k] - x4x[k], b4y = x2y[k] - x4y[k], b4z = x2z[k] - x4z[k];
+            const float n1x = a3y * a4z - a3z * a4y, n1y = a3z * a4x - a3x * a4z, n1z = a3x * a4y - a3y * a4x;
+            const float n2x = b4y * b3z - b4z * b3y, n2y = b4z * b3x - b4x * b3z, n2z = b4x * b3y - b4y * b3x;
+
+            // softened rather than clamped so the loop stays branch-free: squashed
+            // triangles stop steepening the gradient below ~1/4 of their rest height
+            const float n1sq = n1x * n1x + n1y * n1y + n1z * n1z + minSq[k];
+            const float n2sq = n2x * n2x + n2y * n2y + n2z * n2z + minSq[k];
+            const float esq = ex * ex + ey * ey + ez * ez + 1e-20f;
+            const float invN1 = 1.0f / std::sqrt(n1sq), invN2 = 1.0f / std::sqrt(n2sq);
+            const float eLen = std::sqrt(esq), invE = 1.0f / eLen;
+
+            // signed sin(theta / 2)
+            const float cosTheta = (n1x * n2x + n1y * n2y + n1z * n2z) * invN1 * invN2;
+            const float cx = n1y * n2z - n1z * n2y, cy = n1z * n2x - n1x * n2z, cz = n1x * n2y - n1y * n2x;
+            const float sinHalf = std::copysign(std::sqrt(std::abs(0.5f * (1.0f - cosTheta))),
+                                                cx * ex + cy * ey + cz * ez);
+
+            // angle gradients u1..u4 as multiples of N1 / |N1|^2 and N2 / |N2|^2
+            const float s1 = 1.0f / n1sq, s2 = 1.0f / n2sq;
+            const float u1 = eLen * s1, u2 = eLen * s2;
+            const float u31 = (a4x * ex + a4y * ey + a4z * ez) * invE * s1;
+            const float u32 = (b4x * ex + b4y * ey + b4z * ez) * invE * s2;
+            const float u41 = -(a3x * ex + a3y * ey + a3z * ez) * invE * s1;
+            const float u42 = -(b3x * ex + b3y * ey + b3z * ez) * invE * s2;
+
+            float f = w[k] * (sinHalf - rest[k]);
+            if constexpr (Damped) {
+                const float rate = u1  * (n1x * v1x[k] + n1y * v1y[k] + n1z * v1z[k]) +
+                                   u2  * (n2x * v2x[k] + n2y * v2y[k] + n2z * v2z[k]) +
+                                   u31 * (n1x * v3x[k] + n1y * v3y[k] + n1z * v3z[k]) +
+                                   u32 * (n2x * v3x[k] + n2y * v3y[k] + n2z * v3z[k]) +
+                                   u41 * (n1x * v4x[k] + n1y * v4y[k] + n1z * v4z[k]) +
+                                   u42 * (n2x * v4x[k] + n2y * v4y[k] + n2z * v4z[k]);
+                f -= kd[k] * rate;
+            }
+
+            f1x[k] = f * u1 * n1x; f1y[k] = f * u1 * n1y; f1z[k] = f * u1 * n1z;
+            f2x[k] = f * u2 * n2x; f2y[k] = f * u2 * n2y; f2z[k] = f * u2 * n2z;
+            f3x[k] = f * (u31 * n1x + u32 * n2x); f3y[k] = f * (u31 * n1y + u32 * n2y); f3z[k] = f * (u31 * n1z + u32 * n2z);
+            f4x[k] = f * (u41 * n1x + u42 * n2x); f4y[k] = f * (u41 * n1y + u42 * n2y); f4z[k] = f * (u41 * n1z + u42 * n2z);
+        }
+
+        // corners are shared between elements, so the scatter stays serial
+        for(int k = 0; k < n; k++) {
+            particles[i1[base + k]]->force += glm::vec3(f1x[k], f1y[k], f1z[k]);
+            particles[i2[base + k]]->force += glm::vec3(f2x[k], f2y[k], f2z[k]);
+            particles[i3[base + k]]->force += glm::vec3(f3x[k], f3y[k], f3z[k]);
+            particles[i4[base + k]]->force += glm::vec3(f4x[k], f4y[k], f4z[k]);
+        }
+    }
+}
+
+template void BendingPass::run<true>(const std::vector<Particle*>&);
+template void BendingPass::run<false>(const std::vector<Particle*>&);
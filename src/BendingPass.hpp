@@ -0,0 +1,46 @@
+#pragma once
+
+#include "core.hpp"
+
+struct Particle;
+struct Triangle;
+
+// Discrete dihedral bending (Bridson et al. 2003) over every pair of triangles
+// sharing an edge. Each element holds the two opposite corners x1, x2 and the
+// shared edge x3 -> x4. The rest angle and the stiffness-weighted edge factor
+// k * |E|^2 / (|N1| + |N2|) are taken from the construction pose, so the
+// per-step kernel is pure blocked SoA math plus a 4-corner scatter.
+
+class BendingPass {
+public:
+    static constexpr int BLOCK = 64;
+
+    void build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles,
+               float stiffness, float damping);
+
+    // Re-reads the corners of the elements on the changed triangles after a
+    // topology edit; elements whose edge was split apart are switched off.
+    void update(const std::vector<Triangle*>& triangles, const std::vector<GLuint>& changed);
+
+    // Adds the bending force, and with Damped the damping along the angle rate.
+    template<bool Damped>
+    void run(const std::vector<Particle*>& particles);
+
+    size_t size() const { return i1.size(); }
+
+private:
+    // element corners
+    std::vector<GLuint> i1, i2, i3, i4;
+
+    // the two triangles of each element and the slot of the shared edge in each
+    // (edge slot k runs from corner k to corner k + 1)
+    std::vector<GLuint> tri1, tri2;
+    std::vector<unsigned char> slot1, slot2;
+    std::vector<int> triangleElements;   // 3 per triangle, -1 if unused
+
+    // cached per element
+    std::vector<float> weight;        // k * |E0|^2 / (|N1_0| + |N2_0|)
+    std::vector<float> restSinHalf;   // sin(theta0 / 2), signed
+    std::vector<float> dampingEdge;   // kd * |E0|
+    std::vector<float> minNormSq;     // softening for |N|^2, (1/4 of the smaller rest |N|)^2
+};
@@ -0,0 +1,460 @@
+#include "Checkpoint.hpp"
+#include "Cloth.hpp"
+#include "FileView.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    constexpr char MAGIC[8] = { 'C', 'L', 'T', 'H', 'S', 'N', 'A', 'P' };
+    constexpr uint32_t VERSION = 2;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t pinCurves;   // the cloth restored into needs at least this many
+        uint64_t fileSize;
+        uint64_t particleCount;
+        uint64_t springCount;
+        uint64_t triangleCount;
+        uint64_t pinCount;
+        uint64_t shadeCount;   // wind occlusion transmittance per triangle
+    };
+
+    struct Parameters {
+        int32_t gridSize;
+        int32_t substeps;
+        uint32_t topologyVersion;
+        float simTime;
+        uint8_t groundCollision, dragEnabled, bendingEnabled, windOcclusion;
+        uint8_t strainLimiting, tearingEnabled, remeshing, reserved;
+        int32_t dampingModel;
+        int32_t stretchModel;
+        // bending and membrane material
+        float bendingStiffness, bendingDamping;
+        float youngModulus, poissonRatio, membraneDamping;
+        // strain limiter
+        float maxStretch, tolerance;
+        int32_t iterations;
+        // tearing
+        float tearStretch;
+        int32_t maxSplitsPerStep;
+        // remesher
+        int32_t interval;
+        float refineAngle, refineRate, coarsenFactor;
+        float minMass;
+        int32_t maxSubsteps;
+        float baseStiffness;
+        uint64_t maxParticles;
+        // wind occlusion
+        float extinction;
+        int32_t resolution, refreshInterval;
+        glm::vec3 frameD, frameE1, frameE2;
+        glm::vec3 boxMin, boxMax, invCell;
+        int32_t gridResolution, stepsSinceRefresh;
+        glm::mat4 matrixWorld;
+    };
+
+    struct ParticleRecord {
+        glm::vec3 position, previous, velocity, normal, rest;
+        float mass;
+    };
+
+    struct SpringRecord {
+        uint32_t p1, p2;
+        float stiffness, damping, restLength;
+    };
+
+    struct TriangleRecord {
+        uint32_t p1, p2, p3;
+        glm::vec4 geometry;   // last step's normal and area, for the wind occlusion
+        glm::vec3 tracked;    // the membrane element's tracked normal
+    };
+
+    struct PinRecord {
+        uint32_t particle;
+        int32_t curve;
+        glm::vec3 anchor;
+        glm::mat4 transform;
+    };
+
+    template<class T>
+    void put(char*& out, const T& value) {
+        memcpy(out, &value, sizeof(T));
+        out += sizeof(T);
+    }
+
+    template<class T>
+    T get(const char*& in) {
+        T value;
+        memcpy(&value, in, sizeof(T));
+        in += sizeof(T);
+        return value;
+    }
+}
+
+CheckpointWriter::CheckpointWriter() {
+    worker = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void CheckpointWriter::save(const Cloth& cloth, const std::string& path) {
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.pinCurves = uint32_t(cloth.pinCurves.size());
+    header.particleCount = cloth.particles.size();
+    header.springCount = cloth.springDampers.size();
+    header.triangleCount = cloth.triangles.size();
+    header.pinCount = cloth.pinnedIndices.size();
+    const WindOcclusion& occlusion = cloth.trianglePass.occlusion;
+    const WindOcclusion::State shading = occlusion.state();
+    header.shadeCount = shading.shade.size();
+    header.fileSize = sizeof(Header) + sizeof(Parameters) +
+                      header.particleCount * sizeof(ParticleRecord) +
+                      header.springCount * sizeof(SpringRecord) +
+                      header.triangleCount * sizeof(TriangleRecord) +
+                      header.pinCount * sizeof(PinRecord) +
+                      header.shadeCount * sizeof(float);
+
+    Parameters params = {};
+    params.gridSize = cloth.gridSize;
+    params.substeps = cloth.substeps;
+    params.topologyVersion = cloth.topologyVersion;
+    params.simTime = cloth.simTime;
+    params.groundCollision = cloth.groundCollision;
+    params.dragEnabled = cloth.dragEnabled;
+    params.bendingEnabled = cloth.bendingEnabled;
+    params.windOcclusion = cloth.windOcclusion;
+    params.strainLimiting = cloth.strainLimiting;
+    params.tearingEnabled = cloth.tearingEnabled;
+    params.remeshing = cloth.remeshing;
+    params.dampingModel = cloth.dampingModel;
+    params.stretchModel = cloth.stretchModel;
+    params.bendingStiffness = cloth.bendingStiffness;
+    params.bendingDamping = cloth.bendingDamping;
+    params.youngModulus = cloth.youngModulus;
+    params.poissonRatio = cloth.poissonRatio;
+    params.membraneDamping = cloth.membraneDamping;
+    params.maxStretch = cloth.strainLimiter.maxStretch;
+    params.tolerance = cloth.strainLimiter.tolerance;
+    params.iterations = cloth.strainLimiter.iterations;
+    params.tearStretch = cloth.tearing.tearStretch;
+    params.maxSplitsPerStep = cloth.tearing.maxSplitsPerStep;
+    params.interval = cloth.remesher.interval;
+    params.refineAngle = cloth.remesher.refineAngle;
+    params.refineRate = cloth.remesher.refineRate;
+    params.coarsenFactor = cloth.remesher.coarsenFactor;
+    params.minMass = cloth.remesher.minMass;
+    params.maxSubsteps = cloth.remesher.maxSubsteps;
+    params.baseStiffness = cloth.remesher.baseStiffness();
+    params.maxParticles = cloth.remesher.maxParticles;
+    params.extinction = occlusion.extinction;
+    params.resolution = occlusion.resolution;
+    params.refreshInterval = occlusion.refreshInterval;
+    params.frameD = shading.d;
+    params.frameE1 = shading.e1;
+    params.frameE2 = shading.e2;
+    params.boxMin = shading.boxMin;
+    params.boxMax = shading.boxMax;
+    params.invCell = shading.invCell;
+    params.gridResolution = shading.gridResolution;
+    params.stepsSinceRefresh = shading.stepsSinceRefresh;
+    params.matrixWorld = cloth.matrix_world;
+
+    // the buffer keeps its capacity across saves, so steady saving doesn't allocate
+    snapshot.resize(size_t(header.fileSize));
+    char* out = snapshot.data();
+    put(out, header);
+    put(out, params);
+    for(const Particle* p : cloth.particles) {
+        put(out, ParticleRecord{ p->position, p->position_prev, p->velocity, p->normal,
+                                 cloth.restPositions[p->particleID], p->mass });
+    }
+    for(const SpringDamper* s : cloth.springDampers) {
+        put(out, SpringRecord{ s->p1->particleID, s->p2->particleID, s->springConstant, s->dampingConstant, s->restLength });
+    }
+    for(size_t t = 0; t < cloth.triangles.size(); t++) {
+        const Triangle* tri = cloth.triangles[t];
+        put(out, TriangleRecord{ tri->p1->particleID, tri->p2->particleID, tri->p3->particleID,
+                                 cloth.trianglePass.lastGeometry(t), cloth.membranePass.lastNormal(t) });
+    }
+    for(size_t k = 0; k < cloth.pinnedIndices.size(); k++) {
+        put(out, PinRecord{ cloth.pinnedIndices[k], cloth.pinCurveIDs[k], cloth.pinAnchors[k], cloth.pinTransforms[k] });
+    }
+    memcpy(out, shading.shade.data(), shading.shade.size() * sizeof(float));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(hasQueued) droppedCount++;
+        snapshot.swap(queued);
+        queuedPath = path;
+        hasQueued = true;
+    }
+    wake.notify_one();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !hasQueued && !writing; });
+}
+
+size_t CheckpointWriter::written() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writtenCount;
+}
+
+size_t CheckpointWriter::dropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedCount;
+}
+
+std::string CheckpointWriter::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastError;
+}
+
+void CheckpointWriter::run() {
+    std::vector<char> buffer;
+    std::string path;
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        wake.wait(lock, [this] { return hasQueued || stopping; });
+        if(!hasQueued) break;   // stopping, nothing left to write
+        buffer.swap(queued);
+        path.swap(queuedPath);
+        hasQueued = false;
+        writing = true;
+        lock.unlock();
+
+        const std::string temporary = path + ".tmp";
+        std::string failure;
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(buffer.data(), std::streamsize(buffer.size()));
+            out.close();
+            if(!out) failure = "can't write '" + temporary + "'";
+        }
+        if(failure.empty()) {
+#ifdef _WIN32
+            std::remove(path.c_str());
+#endif
+            if(std::rename(temporary.c_str(), path.c_str()) != 0) failure = "can't replace '" + path + "'";
+        }
+        if(!failure.empty()) std::remove(temporary.c_str());
+
+        lock.lock();
+        writing = false;
+        if(failure.empty()) {
+            writtenCount++;
+        } else {
+            lastError = failure;
+        }
+        idle.notify_all();
+    }
+}
+
+bool restoreCheckpoint(Cloth& cloth, const std::string& path, std::string& error) {
+    FileView file(path);
+    if(!file.ok()) {
+        error = "can't open '" + path + "'";
+        return false;
+    }
+
+    // check everything before the cloth is touched
+    const size_t size = file.size();
+    if(size < sizeof(Header) + sizeof(Parameters)) {
+        error = "'" + path + "' is not a checkpoint";
+        return false;
+    }
+    const char* in = file.data();
+    const Header header = get<Header>(in);
+    const Parameters params = get<Parameters>(in);
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        error = "'" + path + "' is not a version " + std::to_string(VERSION) + " checkpoint";
+        return false;
+    }
+    const uint64_t available = size - sizeof(Header) - sizeof(Parameters);
+    const bool fits = header.fileSize == size &&
+                      header.particleCount <= available / sizeof(ParticleRecord) &&
+                      header.springCount <= available / sizeof(SpringRecord) &&
+                      header.triangleCount <= available / sizeof(TriangleRecord) &&
+                      header.pinCount <= available / sizeof(PinRecord) &&
+                      header.shadeCount <= available / sizeof(float) &&
+                      header.particleCount * sizeof(ParticleRecord) + header.springCount * sizeof(SpringRecord) +
+                      header.triangleCount * sizeof(TriangleRecord) + header.pinCount * sizeof(PinRecord) +
+                      header.shadeCount * sizeof(float) == available &&
+                      params.resolution > 0 && params.resolution <= WindOcclusion::MAX_RESOLUTION &&
+                      params.gridResolution >= 0 && params.gridResolution <= WindOcclusion::MAX_RESOLUTION;
+    if(!fits) {
+        error = "'" + path + "' is truncated or malformed";
+        return false;
+    }
+    if(header.pinCurves > cloth.pinCurves.size()) {
+        error = "'" + path + "' needs " + std::to_string(header.pinCurves) + " pin curves, the cloth has " +
+                std::to_string(cloth.pinCurves.size());
+        return false;
+    }
+
+    const size_t np = size_t(header.particleCount);
+    const char* particleRecords = in;
+    const char* springRecords = particleRecords + np * sizeof(ParticleRecord);
+    const char* triangleRecords = springRecords + header.springCount * sizeof(SpringRecord);
+    const char* pinRecords = triangleRecords + header.triangleCount * sizeof(TriangleRecord);
+    const char* shadeRecords = pinRecords + header.pinCount * sizeof(PinRecord);
+    {
+        const char* s = springRecords;
+        for(uint64_t i = 0; i < header.springCount; i++) {
+            const SpringRecord r = get<SpringRecord>(s);
+            if(r.p1 >= np || r.p2 >= np) {
+                error = "'" + path + "' has a spring past the particles";
+                return false;
+            }
+        }
+        const char* t = triangleRecords;
+        for(uint64_t i = 0; i < header.triangleCount; i++) {
+            const TriangleRecord r = get<TriangleRecord>(t);
+            if(r.p1 >= np || r.p2 >= np || r.p3 >= np) {
+                error = "'" + path + "' has a triangle past the particles";
+                return false;
+            }
+        }
+        const char* k = pinRecords;
+        for(uint64_t i = 0; i < header.pinCount; i++) {
+            const PinRecord r = get<PinRecord>(k);
+            if(r.particle >= np || r.curve < 0 || uint32_t(r.curve) > header.pinCurves) {
+                error = "'" + path + "' has a pin past the particles or curves";
+                return false;
+            }
+        }
+    }
+
+    // rebuild the topology in a fresh arena, as the constructor lays it out
+    cloth.arena.release();
+    cloth.arena.reserve(np * sizeof(Particle) +
+                        size_t(header.springCount) * sizeof(SpringDamper) +
+                        size_t(header.triangleCount) * sizeof(Triangle) + 64);
+    cloth.particles.clear();
+    cloth.springDampers.clear();
+    cloth.triangles.clear();
+    cloth.restPositions.clear();
+
+    const char* p = particleRecords;
+    for(size_t i = 0; i < np; i++) {
+        const ParticleRecord r = get<ParticleRecord>(p);
+        Particle* particle = cloth.arena.create<Particle>(r.position, r.mass, GLuint(i));
+        particle->position_prev = r.previous;
+        particle->velocity = r.velocity;
+        particle->normal = r.normal;
+        cloth.particles.push_back(particle);
+        cloth.restPositions.push_back(r.rest);
+    }
+    const char* s = springRecords;
+    for(uint64_t i = 0; i < header.springCount; i++) {
+        const SpringRecord r = get<SpringRecord>(s);
+        SpringDamper* spring = cloth.arena.create<SpringDamper>(cloth.particles[r.p1], cloth.particles[r.p2], false);
+        spring->springConstant = r.stiffness;
+        spring->dampingConstant = r.damping;
+        spring->restLength = r.restLength;
+        cloth.springDampers.push_back(spring);
+    }
+    const char* t = triangleRecords;
+    for(uint64_t i = 0; i < header.triangleCount; i++) {
+        const TriangleRecord r = get<TriangleRecord>(t);
+        cloth.triangles.push_back(cloth.arena.create<Triangle>(cloth.particles[r.p1], cloth.particles[r.p2], cloth.particles[r.p3]));
+    }
+
+    cloth.pinnedIndices.clear();
+    cloth.pinAnchors.clear();
+    cloth.pinTransforms.clear();
+    cloth.pinCurveIDs.clear();
+    const char* k = pinRecords;
+    for(uint64_t i = 0; i < header.pinCount; i++) {
+        const PinRecord r = get<PinRecord>(k);
+        cloth.pinnedIndices.push_back(r.particle);
+        cloth.pinAnchors.push_back(r.anchor);
+        cloth.pinTransforms.push_back(r.transform);
+        cloth.pinCurveIDs.push_back(r.curve);
+    }
+
+    cloth.gridSize = params.gridSize;
+    cloth.simTime = params.simTime;
+    cloth.groundCollision = params.groundCollision != 0;
+    cloth.dragEnabled = params.dragEnabled != 0;
+    cloth.bendingEnabled = params.bendingEnabled != 0;
+    cloth.windOcclusion = params.windOcclusion != 0;
+    cloth.strainLimiting = params.strainLimiting != 0;
+    cloth.tearingEnabled = params.tearingEnabled != 0;
+    cloth.remeshing = params.remeshing != 0;
+    cloth.dampingModel = DampingModel(params.dampingModel);
+    cloth.stretchModel = StretchModel(params.stretchModel);
+    cloth.bendingStiffness = params.bendingStiffness;
+    cloth.bendingDamping = params.bendingDamping;
+    cloth.youngModulus = params.youngModulus;
+    cloth.poissonRatio = params.poissonRatio;
+    cloth.membraneDamping = params.membraneDamping;
+    cloth.strainLimiter.maxStretch = params.maxStretch;
+    cloth.strainLimiter.tolerance = params.tolerance;
+    cloth.strainLimiter.iterations = params.iterations;
+    cloth.tearing.tearStretch = params.tearStretch;
+    cloth.tearing.maxSplitsPerStep = params.maxSplitsPerStep;
+    cloth.remesher.interval = params.interval;
+    cloth.remesher.refineAngle = params.refineAngle;
+    cloth.remesher.refineRate = params.refineRate;
+    cloth.remesher.coarsenFactor = params.coarsenFactor;
+    cloth.remesher.maxSubsteps = params.maxSubsteps;
+    cloth.matrix_world = params.matrixWorld;
+
+    cloth.buildPasses();
+    t = triangleRecords;
+    for(size_t i = 0; i < cloth.triangles.size(); i++) {
+        const TriangleRecord r = get<TriangleRecord>(t);
+        cloth.trianglePass.setLastGeometry(i, r.geometry);
+        cloth.membranePass.setLastNormal(i, r.tracked);
+    }
+    WindOcclusion& occlusion = cloth.trianglePass.occlusion;
+    occlusion.extinction = params.extinction;
+    occlusion.resolution = params.resolution;
+    occlusion.refreshInterval = params.refreshInterval;
+    WindOcclusion::State shading = { params.frameD, params.frameE1, params.frameE2,
+                                     params.boxMin, params.boxMax, params.invCell,
+                                     params.gridResolution, params.stepsSinceRefresh,
+                                     std::vector<float>(size_t(header.shadeCount)) };
+    memcpy(shading.shade.data(), shadeRecords, shading.shade.size() * sizeof(float));
+    occlusion.restore(shading);
+    cloth.tearing.reset();
+    // build measures budgets from the mesh at hand; the saved ones refer to the original
+    cloth.remesher.build(cloth);
+    cloth.remesher.minMass = params.minMass;
+    cloth.remesher.maxParticles = size_t(params.maxParticles);
+    cloth.remesher.rebase(params.baseStiffness);
+    cloth.substeps = params.substeps;
+    // a new version either way, so the render levels rebuild
+    cloth.topologyVersion = std::max(cloth.topologyVersion, params.topologyVersion) + 1;
+
+    if(!cloth.headless) {
+        GLuints indices;
+        indices.reserve(3 * cloth.triangles.size());
+        for(const Triangle* tri : cloth.triangles) {
+            indices.push_back(tri->p1->particleID);
+            indices.push_back(tri->p2->particleID);
+            indices.push_back(tri->p3->particleID);
+        }
+        glBindVertexArray(cloth.VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cloth.buffers[2]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+        glBindVertexArray(0);
+    }
+    cloth.indexCount = GLsizei(3 * cloth.triangles.size());
+    cloth.upload();
+    return true;
+}
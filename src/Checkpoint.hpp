@@ -0,0 +1,72 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class Cloth;
+
+// Binary checkpoints of a Cloth: every particle (positions, previous
+// positions, velocities, normals, masses, rest positions), the springs and
+// triangles as they stand after any tearing or remeshing, the pins, and the
+// solver toggles and parameters. Restoring rebuilds the cloth's topology and
+// passes from the file, so a run can start from a settled pose.
+//
+// Saving copies the state into a snapshot buffer on the calling thread, one
+// pass over the particles and elements, and swaps it with the buffer queued
+// for the writer thread. The writer swaps that out into a buffer of its own
+// before touching the disk, so the simulation never waits on a write; if the
+// writer falls behind, a snapshot still queued is replaced by the newer one.
+// Files are written aside and renamed into place.
+//
+// The state the passes carry between steps (lagged triangle normals and areas,
+// the wind occlusion cache, tracked membrane normals) is saved too, so a
+// restored run continues bit for bit as the original would have. The one
+// exception is a cloth that has torn or been remeshed: its passes are rebuilt
+// rather than patched, which reorders the strain limiter's projections, and
+// remesher splits from before the checkpoint are kept but can't be collapsed.
+//
+// Pin curves are code, not data: a checkpoint records which curve drives each
+// pin, and the cloth it is restored into must have at least as many curves.
+
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();   // writes what is queued
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    /// Snapshots the cloth and queues it for writing to path.
+    void save(const Cloth& cloth, const std::string& path);
+
+    /// Waits until every queued snapshot is on disk.
+    void flush();
+
+    size_t written() const;   // snapshots written so far
+    size_t dropped() const;   // snapshots replaced before they were written
+    std::string error() const;   // the last write error, empty if none
+
+private:
+    std::vector<char> snapshot;   // filled by save, on the caller's thread
+
+    mutable std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::vector<char> queued;     // handed over by save, swapped out by the writer
+    std::string queuedPath;
+    bool hasQueued = false;
+    bool writing = false;
+    bool stopping = false;
+    size_t writtenCount = 0, droppedCount = 0;
+    std::string lastError;
+    std::thread worker;
+
+    void run();
+};
+
+/// Replaces the cloth's state with a checkpoint. Returns false and sets error,
+/// leaving the cloth untouched, if the file can't be read, is malformed or
+/// needs more pin curves than the cloth has.
+bool restoreCheckpoint(Cloth& cloth, const std::string& path, std::string& error);
@@ -1,80 +1,114 @@
 #include "Cloth.hpp"
 
-Cloth::Cloth(const std::string& name, int size, float mass) : Mesh(name) {
+#include <array>
+#include <utility>
+
+Cloth::Cloth(const std::string& name, int size, float mass, float spacing, glm::vec3 origin, bool headless,
+             const ClothMaterial& material)
+    : Mesh(name) {
 
     matrix_world = glm::mat4(1);
 
-    particles.reserve(size);
+    groundCollision = true;
+    dragEnabled = true;
+    bendingEnabled = true;
+    windOcclusion = true;
+    strainLimiting = true;
+    tearingEnabled = false;
+    remeshing = false;
+    substeps = 1;
+    topologyVersion = 0;
+    this->headless = headless;
+    bendingStiffness = material.bendingStiffness;
+    bendingDamping = material.bendingDamping;
+    youngModulus = material.youngModulus;
+    poissonRatio = material.poissonRatio;
+    membraneDamping = material.membraneDamping;
+    strainLimiter.maxStretch = material.maxStretch;
+    tearing.tearStretch = material.tearStretch;
+    dampingModel = DAMPING_SPRING;
+    stretchModel = STRETCH_SPRINGS;
+    simTime = 0.0f;
+    curveMatrices.push_back(glm::mat4(1));
+
+    gridSize = size;
+
+    // everything below is carved out of one arena block
+    const size_t numParticles = size_t(size) * size;
+    const size_t numSprings = 4 * numParticles;
+    const size_t numTriangles = 2 * numParticles;
+    arena.reserve(numParticles * sizeof(Particle) +
+                  numSprings * sizeof(SpringDamper) +
+                  numTriangles * sizeof(Triangle) + 64);
+    particles.reserve(numParticles);
+    springDampers.reserve(numSprings);
+    triangles.reserve(numTriangles);
     glm::vec3 tmpPos;
-    tmpPos.y = INITIAL_HEIGHT;
-    bool fixed = false;
+    tmpPos.y = origin.y;
     unsigned int particleCount = 0;
     for(int i = 0; i < size; i++) {
-        std::vector<Particle*> nextvec;
-        particles.push_back(nextvec);
-        particles.back().reserve(size);
         for(int j = 0; j < size; j++) {
-            tmpPos.x = j * PARTICLE_SPACING;
-            tmpPos.z = i * PARTICLE_SPACING;
+            tmpPos.x = origin.x + j * spacing;
+            tmpPos.z = origin.z + i * spacing;
+
+            particles.push_back(arena.create<Particle>(tmpPos, mass, particleCount));
+            particleCount++;
+
             // only 2 corners are fixed
             //if(i == 0 && (j == 0 || j == size - 1))
             // row of vertices are fixed
             if(i == 0)
-                fixed = true;
-            else
-                fixed = false;
-
-            particles.back().push_back(new Particle(tmpPos, mass, fixed, particleCount));
-            particleCount++;
+                pin(particles.back()->particleID);
 
             // create and connect SpringDampers
             if(j > 0 && i > 0 && j < size-1) {
-                springDampers.push_back(new SpringDamper(
-                    particles[i][j-1], particles[i][j], false));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j], particles[i][j], false));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j-1], particles[i][j], true));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j+1], particles[i][j], true));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i, j-1), particleAt(i, j), false, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j), particleAt(i, j), false, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j-1), particleAt(i, j), true, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j+1), particleAt(i, j), true, spacing));
             } else if (j > 0 && i > 0) {
-                springDampers.push_back(new SpringDamper(
-                    particles[i][j-1], particles[i][j], false));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j], particles[i][j], false));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j-1], particles[i][j], true));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i, j-1), particleAt(i, j), false, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j), particleAt(i, j), false, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j-1), particleAt(i, j), true, spacing));
             } else if (i > 0 && j < size-1) {
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j], particles[i][j], false));
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j+1], particles[i][j], true));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j), particleAt(i, j), false, spacing));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j+1), particleAt(i, j), true, spacing));
             } else if (i > 0) {
                 //this block might not be neccessary...
-                springDampers.push_back(new SpringDamper(
-                    particles[i-1][j], particles[i][j], false));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i-1, j), particleAt(i, j), false, spacing));
             } else if (j > 0) {
-                springDampers.push_back(new SpringDamper(
-                    particles[i][j-1], particles[i][j], false));
+                springDampers.push_back(arena.create<SpringDamper>(
+                    particleAt(i, j-1), particleAt(i, j), false, spacing));
             }
 
             // create and connect Triangles
             if(i > 0 && j > 0) {
-                triangles.push_back(new Triangle(
-                    particles[i][j],particles[i][j-1],particles[i-1][j-1]));
-                triangles.push_back(new Triangle(
-                    particles[i][j],particles[i-1][j-1],particles[i-1][j]));
+                triangles.push_back(arena.create<Triangle>(
+                    particleAt(i, j),particleAt(i, j-1),particleAt(i-1, j-1)));
+                triangles.push_back(arena.create<Triangle>(
+                    particleAt(i, j),particleAt(i-1, j-1),particleAt(i-1, j)));
             }
         }
     }
 
-    // set up VAO
+    // set up VAO; the cloth is a GPU-only mesh, particles/triangles are its topology
     vec4s positions;
     vec4s normals;
     GLuints indices;
 
     positions.reserve(particleCount);
     normals.reserve(particleCount);
+    indices.reserve(3 * triangles.size());
 
     for(int i = 0; i < triangles.size(); i++) {
         indices.push_back(triangles[i]->p1->particleID);
@@ -82,132 +116,287 @@ Cloth::Cloth(const std::string& name, int size, float mass) : Mesh(name) {
         indices.push_back(triangles[i]->p3->particleID);
     }
 
-    for(int i = 0; i < size; i++) {
-        for(int j = 0; j < size; j++) {
-            positions.push_back(glm::vec4(particles[i][j]->position, 1));
-            normals.push_back(glm::vec4(particles[i][j]->normal, 0));
-            verts.push_back(new Vertex(positions.back(), normals.back()));
-        }
+    restPositions.reserve(particleCount);
+    for(int i = 0; i < particles.size(); i++) {
+        positions.push_back(glm::vec4(particles[i]->position, 1));
+        normals.push_back(glm::vec4(particles[i]->normal, 0));
+        restPositions.push_back(particles[i]->position);
     }
 
-    for(int i = 0; i < indices.size(); i+=3) {
-        faces.push_back(new Face(verts[indices[i]], verts[indices[i+1]], verts[indices[i+2]]));
+    if(!headless) {
+        uploadBuffers(positions, normals, indices, GL_DYNAMIC_DRAW);
     }
 
-    glGenVertexArrays(1, &VAO);
-    buffers.resize(3);  // v, n, vt
-    glGenBuffers(3, buffers.data());
-    glBindVertexArray(VAO);
+    for(SpringDamper* s : springDampers) {
+        s->springConstant = material.springConstant;
+        s->dampingConstant = material.dampingConstant;
+    }
+    buildPasses();
+    remesher.build(*this);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+void Cloth::buildPasses() {
+    // the passes take their rest state from the current pose, so they are built
+    // with every particle moved to its material position
+    for(Particle* p : particles) {
+        std::swap(p->position, restPositions[p->particleID]);
+    }
+    trianglePass.build(particles, triangles);
+    bendingPass.build(particles, triangles, bendingStiffness, bendingDamping);
+    membranePass.build(particles, triangles, youngModulus, poissonRatio, membraneDamping);
+    for(Particle* p : particles) {
+        std::swap(p->position, restPositions[p->particleID]);
+    }
+    membranePass.orient(particles);
+    strainLimiter.build(particles, springDampers);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec4), normals.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+Cloth::~Cloth() {
+    for(int i = 0; i < pinCurves.size(); i++) {
+        delete pinCurves[i];
+    }
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+namespace {
+    using StepFn = void (Cloth::*)(glm::vec3, Airflow*);
 
-    glBindVertexArray(0);
+    // bit 0: collision, bit 1: drag, bit 2: pinned, bit 3: spring damping
+    template<int Bits>
+    constexpr StepFn stepVariant() {
+        return &Cloth::step<ClothFeatures<(Bits & 1) != 0,
+                                          (Bits & 2) != 0,
+                                          (Bits & 4) != 0,
+                                          (Bits & 8) ? DAMPING_SPRING : DAMPING_NONE>>;
+    }
+
+    template<int... Bits>
+    constexpr std::array<StepFn, sizeof...(Bits)> makeStepTable(std::integer_sequence<int, Bits...>) {
+        return { stepVariant<Bits>()... };
+    }
+
+    constexpr std::array<StepFn, 16> stepTable = makeStepTable(std::make_integer_sequence<int, 16>());
 }
 
 void Cloth::update(glm::vec3 windSpeed) {
+    // pick the specialized step once; drag is skipped entirely in still air
+    int bits = 0;
+    if(groundCollision)                                  bits |= 1;
+    if(dragEnabled && windSpeed != glm::vec3(0))         bits |= 2;
+    if(!pinnedIndices.empty())                           bits |= 4;
+    if(dampingModel == DAMPING_SPRING)                   bits |= 8;
+
+    // remesh between updates, so every substep below runs on the same mesh
+    if(remeshing && remesher.run(*this) > 0) {
+        topologyVersion++;
+    }
+    for(int s = 0; s < substeps; s++) {
+        (this->*stepTable[bits])(windSpeed, nullptr);
+    }
+    upload();
+}
+
+void Cloth::update(Airflow& air) {
+    int bits = 0;
+    if(groundCollision)                                  bits |= 1;
+    if(dragEnabled)                                      bits |= 2;
+    if(!pinnedIndices.empty())                           bits |= 4;
+    if(dampingModel == DAMPING_SPRING)                   bits |= 8;
+
+    if(remeshing && remesher.run(*this) > 0) {
+        topologyVersion++;
+    }
+    for(int s = 0; s < substeps; s++) {
+        (this->*stepTable[bits])(glm::vec3(0), &air);
+    }
+    upload();
+}
+
+template<class Features>
+void Cloth::step(glm::vec3 windSpeed, Airflow* air) {
+    const float timestep = TIME_STEP / substeps;
+
     // zero out forces
     for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            particles[i][j]->force = glm::vec3(0);
-        }
+        particles[i]->force = glm::vec3(0);
     }
 
     // Apply all forces
-    // apply gravity to all particles
-    glm::vec3 gravity = glm::vec3(0, GRAVITY, 0);
+    // apply gravity to all particles; GRAVITY is the weight of a MASS particle,
+    // so particles split off by remeshing weigh their share
+    glm::vec3 gravity = glm::vec3(0, GRAVITY / MASS, 0);
     for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            particles[i][j]->force += gravity;
-        }
+        particles[i]->force += particles[i]->mass * gravity;
     }
 
-    // apply springdamper force
-    for(int i = 0; i < springDampers.size(); i++) {
-        springDampers[i]->computeForce();
+    // in-plane stretch: springs, or membrane elements in their place
+    if(stretchModel == STRETCH_MEMBRANE) {
+        membranePass.template run<Features::damping == DAMPING_SPRING>(particles);
+    } else {
+        for(int i = 0; i < springDampers.size(); i++) {
+            springDampers[i]->template computeForce<Features::damping>();
+        }
     }
 
-    // apply drag force
-    for(int i = 0; i < triangles.size(); i++) {
-        triangles[i]->calcVelocity(windSpeed);
-        triangles[i]->computeForce();
+    // resist folding across interior edges
+    if(bendingEnabled) {
+        bendingPass.template run<Features::damping == DAMPING_SPRING>(particles);
     }
-    
-    // Integrate motion
-    for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            if(particles[i][j]->isFixed == false)
-                particles[i][j]->updatePosition(TIME_STEP);
+
+    // one pass over the triangles gives the normals and, with wind, the drag force;
+    // the normals describe the start-of-step geometry, one step behind the upload
+    trianglePass.template run<Features::drag>(particles, windSpeed, air, windOcclusion, 1.0f / substeps);
+
+    // ground and sphere collisions rewrite position_prev, which applyPins needs
+    // as last step's target, so the pins' start positions are kept aside
+    if constexpr (Features::pinned) {
+        pinStarts.resize(pinnedIndices.size());
+        for(int k = 0; k < pinnedIndices.size(); k++) {
+            pinStarts[k] = particles[pinnedIndices[k]]->position;
         }
     }
 
-    // zero out particle normals
+    // Integrate motion; pinned particles are integrated too and then
+    // overwritten by applyPins, so the loop never checks a per-particle flag
     for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            if(particles[i][j]->isFixed == false)
-                particles[i][j]->normal = glm::vec3(0);
+        particles[i]->template updatePosition<Features::collision>(timestep);
+    }
+    if(!colliders.empty()) {
+        collideSpheres(timestep);
+    }
+    simTime += timestep;
+
+    if constexpr (Features::pinned) {
+        for(int k = 0; k < pinnedIndices.size(); k++) {
+            particles[pinnedIndices[k]]->position_prev = pinStarts[k];
         }
+        applyPins(timestep);
     }
 
-    //Loop through all triangles and add the triangle normal to the normal of each of the three particles it connects
-    for(int i = 0; i < triangles.size(); i++) {
-        triangles[i]->calcNormal();
-        triangles[i]->p1->normal += triangles[i]->normal;
-        triangles[i]->p2->normal += triangles[i]->normal;
-        triangles[i]->p3->normal += triangles[i]->normal;
+    // tear before limiting, which would hide the stretch
+    if(tearingEnabled && tearing.run(*this) > 0) {
+        topologyVersion++;
     }
 
-    //Loop through all the particles again and normalize the normal
-    for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            glm::normalize(particles[i][j]->normal);
-        }
+    // clamp over-stretched springs once the pins are in place
+    if(strainLimiting) {
+        strainLimiter.run(particles, pinnedIndices, timestep);
+    }
+}
+
+void Cloth::draw(Shader* shader) {
+    // a finer level of detail is drawn in place of the simulated mesh
+    if(lod.level() > 0) {
+        lod.draw(shader);
+    } else {
+        Mesh::draw(shader);
+    }
+}
+
+void Cloth::upload() {
+    if(headless) return;
+
+    // only the mesh that will be drawn needs the new state
+    if(lod.level() > 0) {
+        lod.upload(*this);
+        return;
     }
 
     vec4s positions;
     vec4s normals;
-    positions.reserve(verts.size());
-    normals.reserve(verts.size());
+    positions.reserve(particles.size());
+    normals.reserve(particles.size());
 
     for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            positions.push_back(glm::vec4(particles[i][j]->position, 1));
-            normals.push_back(glm::vec4(particles[i][j]->normal, 0));
-        }
+        positions.push_back(glm::vec4(particles[i]->position, 1));
+        normals.push_back(glm::vec4(particles[i]->normal, 0));
     }
 
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec4), normals.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec4), normals.data(), GL_DYNAMIC_DRAW);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
 
     glBindVertexArray(0);
 }
 
+void Cloth::applyPins(float timestep) {
+    // evaluate every curve once per step, then snap each pin to its target
+    for(int c = 0; c < pinCurves.size(); c++) {
+        curveMatrices[c + 1] = pinCurves[c]->evaluate(simTime);
+    }
+
+    for(int k = 0; k < pinnedIndices.size(); k++) {
+        Particle* p = particles[pinnedIndices[k]];
+        glm::vec3 target = glm::vec3(pinTransforms[k] * curveMatrices[pinCurveIDs[k]] * glm::vec4(pinAnchors[k], 1));
+        // position_prev holds last step's target after the Verlet update
+        p->velocity = (target - p->position_prev) / timestep;
+        p->position = target;
+    }
+}
+
+void Cloth::pin(GLuint particleID, int curveID) {
+    pinnedIndices.push_back(particleID);
+    pinAnchors.push_back(particles[particleID]->position);
+    pinTransforms.push_back(glm::mat4(1));
+    pinCurveIDs.push_back(curveID);
+}
+
+void Cloth::unpinAll() {
+    pinnedIndices.clear();
+    pinAnchors.clear();
+    pinTransforms.clear();
+    pinCurveIDs.clear();
+}
+
+int Cloth::addPinCurve(PinCurve* curve) {
+    pinCurves.push_back(curve);
+    curveMatrices.push_back(curve->evaluate(simTime));
+    return static_cast<int>(pinCurves.size());
+}
+
 void Cloth::translateFixed(glm::vec3 translation) {
-    for(int i = 0; i < particles.size(); i++) {
-        for(int j = 0; j < particles[0].size(); j++) {
-            if(particles[i][j]->isFixed) {
-                particles[i][j]->position += translation;
+    glm::mat4 offset = glm::translate(translation);
+    for(int k = 0; k < pinnedIndices.size(); k++) {
+        pinTransforms[k] = offset * pinTransforms[k];
+
+        // teleport rather than drag the pin, so the jump adds no velocity
+        Particle* p = particles[pinnedIndices[k]];
+        p->position += translation;
+        p->position_prev += translation;
+    }
+}
+
+void Cloth::collideSpheres(float timestep) {
+    for(Particle* p : particles) {
+        for(const SphereCollider& sphere : colliders) {
+            glm::vec3 offset = p->position - sphere.center;
+            float distance2 = glm::dot(offset, offset);
+            if(distance2 >= sphere.radius * sphere.radius) continue;
+
+            // push out along the normal, then the same restitution and Coulomb
+            // friction as the ground
+            float distance = std::sqrt(distance2);
+            glm::vec3 normal = distance > 1e-6f ? offset / distance : glm::vec3(0, 1, 0);
+            p->position = sphere.center + sphere.radius * normal;
+
+            float v_close = glm::dot(p->velocity, normal);
+            if(v_close < 0.0f) {
+                glm::vec3 v_tangent = p->velocity - v_close * normal;
+                float v_slide = glm::length(v_tangent);
+                if(v_slide > 1e-6f) {
+                    v_tangent *= 1.0f - glm::min(FRICTION_COFF * (1.0f + RESTITUTION) * -v_close, v_slide) / v_slide;
+                }
+                p->velocity = v_tangent - RESTITUTION * v_close * normal;
             }
+            // Verlet takes its velocity from position_prev
+            p->position_prev = p->position - p->velocity * timestep;
         }
     }
-
-}
\ No newline at end of file
+}
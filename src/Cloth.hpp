@@ -3,6 +3,15 @@
 
 #include "core.hpp"
 #include "Mesh.hpp"
+#include "PinAnimation.hpp"
+#include "TrianglePass.hpp"
+#include "BendingPass.hpp"
+#include "MembranePass.hpp"
+#include "StrainLimiter.hpp"
+#include "Tearing.hpp"
+#include "Remesher.hpp"
+#include "ClothLOD.hpp"
+#include "Airflow.hpp"
 
 #define SQRT2 1.41421356237f
 #define DEFAULT_NORMAL glm::vec3(0, 1, 0)
@@ -14,6 +23,15 @@
 
 #define DEFAULT_SPRING_CONSTANT 1200.0f
 #define DEFAULT_DAMPING_CONSTANT 4.0f
+#define DEFAULT_BENDING_STIFFNESS 1.0f
+#define DEFAULT_BENDING_DAMPING 0.05f
+#define DEFAULT_YOUNG_MODULUS 2000.0f   // E * thickness (N/m)
+#define DEFAULT_POISSON_RATIO 0.3f
+#define DEFAULT_MEMBRANE_DAMPING 0.5f
+#define DEFAULT_MAX_STRETCH 1.1f
+#define DEFAULT_TEAR_STRETCH 1.3f
+#define DEFAULT_REMESH_INTERVAL 10      // updates between remeshes
+#define DEFAULT_REFINE_ANGLE 0.8f       // fold angle across an edge that refines it (rad)
 #define GRAVITY -9.8f
 #define MASS 0.5f
 
@@ -24,6 +42,26 @@
 #define RESTITUTION 0.05f
 #define FRICTION_COFF 0.5f
 
+enum DampingModel {
+    DAMPING_NONE,
+    DAMPING_SPRING   // dashpot along each spring (strain-rate viscosity for membranes)
+};
+
+enum StretchModel {
+    STRETCH_SPRINGS,    // structural + shear springs
+    STRETCH_MEMBRANE    // co-rotated FEM triangle elements, resolution independent
+};
+
+// Compile-time feature set for Cloth::step. Cloth::update picks the matching
+// instantiation once per step so the inner loops carry no dead branches.
+template<bool Collision, bool Drag, bool Pinned, DampingModel Damping>
+struct ClothFeatures {
+    static constexpr bool collision = Collision;
+    static constexpr bool drag = Drag;
+    static constexpr bool pinned = Pinned;
+    static constexpr DampingModel damping = Damping;
+};
+
 struct Particle {
     glm::vec3 position;
     glm::vec3 position_prev;
@@ -31,57 +69,69 @@ struct Particle {
     glm::vec3 force;
     glm::vec3 normal;
     float     mass;
-    bool      isFixed;
     GLuint particleID;
 
     public:
         glm::vec3 acceleration() { return (1 / mass) * force; }
         glm::vec3 momentum()     { return mass * velocity; }
 
-        Particle(glm::vec3 pos, float m, bool fixed, GLuint id) {
+        Particle(glm::vec3 pos, float m, GLuint id) {
             position = pos;
             position_prev = pos;
             velocity = glm::vec3(0);
             force = glm::vec3(0);
             normal = DEFAULT_NORMAL;
             mass = m;
-            isFixed = fixed;
             particleID = id;
         }
 
+        template<bool Collision = true>
         void updatePosition(float timestep) {
-            // Verlet w/ no collision detection and no oversampling
+            // Verlet w/ no oversampling
             glm::vec3 position_new = 2.0f * position - position_prev;
             position_new += acceleration() * timestep * timestep;
             position_prev = position;
             position = position_new;
 
-            if (position.y < 0.0f) { // ground collision detection
-                // collision handle
-                glm::vec3 ground_normal = glm::vec3(0,1,0);
-                float v_close = glm::dot(velocity, ground_normal);
-                glm::vec3 impulse = -1.0f * (1.0f + RESTITUTION) * mass * v_close * ground_normal;
+            if constexpr (Collision) {
+                if (position.y < 0.0f) { // ground collision detection
+                    collideGround(timestep);
+                    return;
+                }
+            }
+            velocity += acceleration() * timestep;
+        }
 
-                // calculate impulse due to friction
-                // start with finding v_tangent
-                glm::vec3 fric_impulse = velocity - (v_close * ground_normal);
-                fric_impulse = -1.0f * glm::normalize(fric_impulse);
-                fric_impulse *= FRICTION_COFF * glm::length(impulse);
+        void collideGround(float timestep) {
+            // collision handle
+            glm::vec3 ground_normal = glm::vec3(0,1,0);
+            float v_close = glm::dot(velocity, ground_normal);
+            glm::vec3 impulse = -1.0f * (1.0f + RESTITUTION) * mass * v_close * ground_normal;
+
+            // calculate impulse due to friction
+            // start with finding v_tangent
+            // (Coulomb: never more than what stops the sliding)
+            glm::vec3 v_tangent = velocity - (v_close * ground_normal);
+            float v_slide = glm::length(v_tangent);
+            if (v_slide > 1e-6f) {
+                glm::vec3 fric_impulse = -1.0f * (v_tangent / v_slide);
+                fric_impulse *= glm::min(FRICTION_COFF * glm::length(impulse), mass * v_slide);
 
                 // add to frictionless impulse for final impulse
                 impulse += fric_impulse;
-                // apply to velocity
-                velocity += impulse / mass;
+            }
+            // apply to velocity
+            velocity += impulse / mass;
 
-                // fix position
-                glm::vec3 contact_point = (position_prev.y * position) - (position.y * position_prev);
+            // fix position; if we were already below ground just project up
+            glm::vec3 contact_point = glm::vec3(position.x, 0.0f, position.z);
+            if (position_prev.y > position.y) {
+                contact_point = (position_prev.y * position) - (position.y * position_prev);
                 contact_point /= position_prev.y - position.y;
-
-                position_prev = contact_point; //maybe not needed??
-                position = contact_point + (velocity * timestep * 0.5f); // approx w/ half a time step
-            } else {
-                velocity += acceleration() * timestep;
             }
+
+            position_prev = contact_point; //maybe not needed??
+            position = contact_point + (velocity * timestep * 0.5f); // approx w/ half a time step
         }
 };
 
@@ -94,26 +144,30 @@ struct SpringDamper {
 public:
     SpringDamper(Particle* particle1,
                  Particle* particle2,
-                 bool diagonal) {
+                 bool diagonal,
+                 float spacing = PARTICLE_SPACING) {
         springConstant = DEFAULT_SPRING_CONSTANT;
         dampingConstant = DEFAULT_DAMPING_CONSTANT;
         if(diagonal)
-            restLength = SQRT2 * PARTICLE_SPACING;
+            restLength = SQRT2 * spacing;
         else
-            restLength = PARTICLE_SPACING;
+            restLength = spacing;
 
         p1 = particle1;
         p2 = particle2;
     }
 
+    template<DampingModel Damping = DAMPING_SPRING>
     void computeForce() {
         glm::vec3 e = p2->position - p1->position;
         float length = glm::length(e);
         e = glm::normalize(e);
 
-        float v_close = glm::dot(p1->velocity - p2->velocity, e);
         float force = -1 * springConstant * (restLength - length);
-        force -= dampingConstant * v_close;
+        if constexpr (Damping == DAMPING_SPRING) {
+            float v_close = glm::dot(p1->velocity - p2->velocity, e);
+            force -= dampingConstant * v_close;
+        }
 
         p1->force += force * e;
         p2->force += -1 * force * e;
@@ -122,8 +176,6 @@ public:
 
 struct Triangle {
     Particle *p1, *p2, *p3;
-    glm::vec3 normal;
-    glm::vec3 velocity;
 
 public:
     Triangle(Particle* particle1,
@@ -132,49 +184,102 @@ public:
         p1 = particle1;
         p2 = particle2;
         p3 = particle3;
-        normal = DEFAULT_NORMAL;
-        velocity = glm::vec3(0);
     }
+};
 
-    void calcVelocity(glm::vec3 windSpeed) {
-        velocity = (p1->velocity + p2->velocity + p3->velocity) / 3.0f;
-        velocity -= windSpeed;
-    }
-
-    void calcNormal() {
-        normal = glm::cross(p2->position - p1->position, p3->position - p1->position);
-        normal = glm::normalize(normal);
-    }
-
-    float getArea() { // cross-sectional
-        float area = 0.5f * glm::length(glm::cross(p2->position - p1->position, p3->position - p1->position));
-
-        area *= glm::dot(glm::normalize(velocity), normal);
-        return area;
-    }
+// A sphere the cloth collides with, besides the ground
+struct SphereCollider {
+    glm::vec3 center;
+    float radius;
+};
 
-    void computeForce() {
-        glm::vec3 dragForce = normal;
-        dragForce *= -0.5f * AIR_DENSITY * DRAG_COFF * glm::dot(velocity, velocity) * getArea();
-        dragForce /= 3.0f;
-
-        // apply force to all 3 particles
-        p1->force += dragForce;
-        p2->force += dragForce;
-        p3->force += dragForce;
-    }
+// Material constants a cloth is built with
+struct ClothMaterial {
+    float springConstant = DEFAULT_SPRING_CONSTANT;
+    float dampingConstant = DEFAULT_DAMPING_CONSTANT;
+    float bendingStiffness = DEFAULT_BENDING_STIFFNESS;
+    float bendingDamping = DEFAULT_BENDING_DAMPING;
+    float youngModulus = DEFAULT_YOUNG_MODULUS;
+    float poissonRatio = DEFAULT_POISSON_RATIO;
+    float membraneDamping = DEFAULT_MEMBRANE_DAMPING;
+    float maxStretch = DEFAULT_MAX_STRETCH;
+    float tearStretch = DEFAULT_TEAR_STRETCH;
 };
 
 class Cloth : public Mesh {
 public:
-    std::vector<std::vector<Particle*>> particles;
+    int gridSize;
+    std::vector<Particle*> particles;   // flat, indexed by particleID
     std::vector<SpringDamper*> springDampers;
     std::vector<Triangle*> triangles;
+    std::vector<glm::vec3> restPositions;   // material coordinates, indexed by particleID
+    TrianglePass trianglePass;   // normals + drag, rebuilt when topology changes
+    BendingPass bendingPass;     // dihedral elements over interior edges
+    MembranePass membranePass;   // FEM stretch on the triangles
+    StrainLimiter strainLimiter; // caps spring stretch after integration
+    Tearing tearing;             // splits particles at over-stretched springs
+    Remesher remesher;           // refines folds, coarsens flat regions
+    ClothLOD lod;                // subdivided render mesh, chosen by camera distance
+
+    // pinned particles as parallel arrays indexed by pin; the target of pin k is
+    // pinTransforms[k] * curve(simTime) * pinAnchors[k]
+    std::vector<GLuint> pinnedIndices;
+    std::vector<glm::vec3> pinAnchors;
+    std::vector<glm::mat4> pinTransforms;
+    std::vector<int> pinCurveIDs;       // 0 means not animated
+    std::vector<PinCurve*> pinCurves;   // owned, curve ID = index + 1
+    std::vector<glm::vec3> pinStarts;   // pin positions at the start of a step
+    float simTime;
+
+    std::vector<SphereCollider> colliders;
+
+    // material of the bending and membrane elements, applied by buildPasses
+    float bendingStiffness, bendingDamping;
+    float youngModulus, poissonRatio, membraneDamping;
+
+    // feature toggles, resolved to a ClothFeatures instantiation once per step
+    bool groundCollision;
+    bool dragEnabled;
+    bool bendingEnabled;
+    bool windOcclusion;   // shadow wind behind other layers of this cloth
+    bool strainLimiting;
+    bool tearingEnabled;
+    bool remeshing;
+    DampingModel dampingModel;
+    StretchModel stretchModel;
+    int substeps;   // steps per update, raised by the remesher for refined particles
+    unsigned topologyVersion;   // bumped by every tear or remesh that changed the triangles
+    bool headless;   // no GL buffers and no uploads, for batch runs without a context
+
+    // constructor for square shaped grid of particles, spaced along x and z from origin
+    explicit Cloth(const std::string& name, int size, float mass, float spacing = PARTICLE_SPACING,
+                   glm::vec3 origin = glm::vec3(0, INITIAL_HEIGHT, 0), bool headless = false,
+                   const ClothMaterial& material = ClothMaterial());
+    ~Cloth();
+
+    void update(glm::vec3 windSpeed);   // uniform wind
+    void update(Airflow& air);          // sampled per triangle (WindField, AirSolver)
+
+    void draw(Shader* shader) override;   // the selected level of detail
+
+    template<class Features>
+    void step(glm::vec3 windSpeed, Airflow* air);
+
+    Particle* particleAt(int row, int col) { return particles[row * gridSize + col]; }
+
+    // rebuilds the per-element passes from restPositions after a topology change
+    void buildPasses();
+
+    void pin(GLuint particleID, int curveID = 0);
+    void unpinAll();
+    int addPinCurve(PinCurve* curve);
+    void translateFixed(glm::vec3 translation);
 
-    // constructor for square shaped grid of particles
-    explicit Cloth(const std::string& name, int size, float mass);
-    
-    void update(glm::vec3 windSpeed);
+    void upload();   // positions and normals to the GPU, once per update
 
-    void translateFixed(glm::vec3 translation);
+private:
+    std::vector<glm::mat4> curveMatrices;   // [0] is identity
+
+    void applyPins(float timestep);
+    void collideSpheres(float timestep);
 };
@@ -0,0 +1,264 @@
+#include "ClothLOD.hpp"
+#include "Cloth.hpp"
+#include "Camera.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // a fine vertex as (particle, weight) pairs
+    using Stencil = std::vector<std::pair<GLuint, float>>;
+
+    void accumulate(Stencil& out, const Stencil& s, float w) {
+        for(const auto& e : s) out.emplace_back(e.first, w * e.second);
+    }
+
+    // sorts by particle and sums repeated particles
+    void merge(Stencil& s) {
+        std::sort(s.begin(), s.end());
+        size_t k = 0;
+        for(size_t e = 0; e < s.size(); e++) {
+            if(k > 0 && s[k - 1].first == s[e].first) {
+                s[k - 1].second += s[e].second;
+            } else {
+                s[k++] = s[e];
+            }
+        }
+        s.resize(k);
+    }
+
+    struct EdgeRef {
+        uint64_t key;
+        GLuint triangle;
+        int slot;   // the edge runs from corner slot to corner slot + 1
+    };
+}
+
+ClothLOD::ClothLOD() {
+    enabled = true;
+    coverage[0] = 0.25f;
+    coverage[1] = 0.6f;
+    hysteresis = 0.1f;
+    current = 0;
+}
+
+ClothLOD::~ClothLOD() {
+    for(Level& lod : levels) {
+        delete lod.mesh;
+    }
+}
+
+int ClothLOD::select(Camera& camera, const std::vector<Particle*>& particles) {
+    if(!enabled || particles.empty()) {
+        current = 0;
+        return current;
+    }
+
+    glm::vec3 center(0);
+    for(const Particle* p : particles) center += p->position;
+    center /= float(particles.size());
+    float radius2 = 0.0f;
+    for(const Particle* p : particles) radius2 = std::max(radius2, glm::dot(p->position - center, p->position - center));
+
+    // projection[1][1] = 1 / tan(fov / 2) turns radius / distance into a
+    // fraction of half the view height
+    const glm::vec3 eye = glm::vec3(camera.getViewInv()[3]);
+    const float distance = std::max(glm::length(center - eye), camera.getNear());
+    const float covered = std::sqrt(radius2) * camera.projection[1][1] / distance;
+
+    // thresholds below the current level need the margin to drop back, the ones
+    // above it to step up
+    int target = 0;
+    for(int k = 0; k < MAX_LEVEL; k++) {
+        const float margin = k < current ? 1.0f - hysteresis : 1.0f + hysteresis;
+        if(covered > coverage[k] * margin) target = k + 1;
+    }
+    current = target;
+    return current;
+}
+
+void ClothLOD::build(Level& lod, int depth, const Cloth& cloth) {
+    const size_t np = cloth.particles.size();
+
+    // every particle starts as its own stencil; the coarse triangles by corner
+    std::vector<Stencil> stencils(np);
+    for(size_t i = 0; i < np; i++) {
+        stencils[i].emplace_back(GLuint(i), 1.0f);
+    }
+    GLuints tris;
+    tris.reserve(3 * cloth.triangles.size());
+    for(const Triangle* t : cloth.triangles) {
+        tris.push_back(t->p1->particleID);
+        tris.push_back(t->p2->particleID);
+        tris.push_back(t->p3->particleID);
+    }
+
+    std::vector<EdgeRef> edges;
+    for(int d = 0; d < depth; d++) {
+        const size_t nv = stencils.size();
+        const size_t nt = tris.size() / 3;
+
+        edges.clear();
+        for(size_t t = 0; t < nt; t++) {
+            for(int slot = 0; slot < 3; slot++) {
+                const uint64_t a = tris[3 * t + slot], b = tris[3 * t + (slot + 1) % 3];
+                edges.push_back({ std::min(a, b) << 32 | std::max(a, b), GLuint(t), slot });
+            }
+        }
+        std::sort(edges.begin(), edges.end(), [](const EdgeRef& x, const EdgeRef& y) { return x.key < y.key; });
+
+        // odd vertices, one per edge: 3/8 of each end and 1/8 of each opposite
+        // corner inside, the midpoint on a boundary (or non-manifold) edge
+        std::vector<Stencil> next(nv);
+        std::vector<std::vector<GLuint>> ring(nv), border(nv);
+        GLuints edgeVertex(3 * nt);
+        for(size_t begin = 0; begin < edges.size();) {
+            size_t end = begin + 1;
+            while(end < edges.size() && edges[end].key == edges[begin].key) end++;
+
+            const GLuint a = GLuint(edges[begin].key >> 32), b = GLuint(edges[begin].key);
+            Stencil s;
+            if(end - begin == 2) {
+                const EdgeRef& e1 = edges[begin];
+                const EdgeRef& e2 = edges[begin + 1];
+                accumulate(s, stencils[a], 3.0f / 8.0f);
+                accumulate(s, stencils[b], 3.0f / 8.0f);
+                accumulate(s, stencils[tris[3 * e1.triangle + (e1.slot + 2) % 3]], 1.0f / 8.0f);
+                accumulate(s, stencils[tris[3 * e2.triangle + (e2.slot + 2) % 3]], 1.0f / 8.0f);
+            } else {
+                accumulate(s, stencils[a], 0.5f);
+                accumulate(s, stencils[b], 0.5f);
+                border[a].push_back(b);
+                border[b].push_back(a);
+            }
+            merge(s);
+            ring[a].push_back(b);
+            ring[b].push_back(a);
+
+            for(size_t e = begin; e < end; e++) {
+                edgeVertex[3 * edges[e].triangle + edges[e].slot] = GLuint(next.size());
+            }
+            next.push_back(std::move(s));
+            begin = end;
+        }
+
+        // even vertices: Warren's beta over the ring inside, 3/4 + 1/8 + 1/8
+        // along a boundary; corners and non-manifold points stay put
+        for(size_t v = 0; v < nv; v++) {
+            Stencil& s = next[v];
+            if(border[v].size() == 2) {
+                accumulate(s, stencils[v], 3.0f / 4.0f);
+                accumulate(s, stencils[border[v][0]], 1.0f / 8.0f);
+                accumulate(s, stencils[border[v][1]], 1.0f / 8.0f);
+            } else if(!border[v].empty() || ring[v].empty()) {
+                s = stencils[v];
+            } else {
+                const float n = float(ring[v].size());
+                const float beta = ring[v].size() == 3 ? 3.0f / 16.0f : 3.0f / (8.0f * n);
+                accumulate(s, stencils[v], 1.0f - n * beta);
+                for(GLuint u : ring[v]) accumulate(s, stencils[u], beta);
+            }
+            merge(s);
+        }
+
+        // each triangle becomes its three corners and the middle, same winding
+        GLuints refined;
+        refined.reserve(4 * tris.size());
+        for(size_t t = 0; t < nt; t++) {
+            const GLuint v0 = tris[3 * t], v1 = tris[3 * t + 1], v2 = tris[3 * t + 2];
+            const GLuint e0 = edgeVertex[3 * t], e1 = edgeVertex[3 * t + 1], e2 = edgeVertex[3 * t + 2];
+            for(GLuint i : { v0, e0, e2,  e0, v1, e1,  e2, e1, v2,  e0, e1, e2 }) {
+                refined.push_back(i);
+            }
+        }
+        tris.swap(refined);
+        stencils.swap(next);
+    }
+
+    // pack column-major, padding with particle 0 at weight 0
+    lod.count = stencils.size();
+    lod.width = 0;
+    for(const Stencil& s : stencils) lod.width = std::max(lod.width, int(s.size()));
+    lod.index.assign(size_t(lod.width) * lod.count, 0);
+    lod.weight.assign(size_t(lod.width) * lod.count, 0.0f);
+    for(size_t v = 0; v < lod.count; v++) {
+        for(size_t j = 0; j < stencils[v].size(); j++) {
+            lod.index[j * lod.count + v] = stencils[v][j].first;
+            lod.weight[j * lod.count + v] = stencils[v][j].second;
+        }
+    }
+
+    delete lod.mesh;
+    lod.mesh = new Mesh("ClothLOD");
+    lod.mesh->uploadBuffers(vec4s(lod.count, glm::vec4(0, 0, 0, 1)), vec4s(lod.count, glm::vec4(0)), tris, GL_DYNAMIC_DRAW);
+    lod.version = cloth.topologyVersion;
+}
+
+void ClothLOD::upload(const Cloth& cloth) {
+    Level& lod = levels[current];
+    if(lod.version != cloth.topologyVersion) {
+        build(lod, current, cloth);
+    }
+
+    const size_t np = cloth.particles.size();
+    px.resize(np); py.resize(np); pz.resize(np);
+    nx.resize(np); ny.resize(np); nz.resize(np);
+    for(size_t i = 0; i < np; i++) {
+        const Particle* p = cloth.particles[i];
+        px[i] = p->position.x; py[i] = p->position.y; pz[i] = p->position.z;
+        nx[i] = p->normal.x; ny[i] = p->normal.y; nz[i] = p->normal.z;
+    }
+
+    // each block sums one stencil column at a time into contiguous lanes, so the
+    // inner loops are straight-line gathers and multiply-adds
+    const size_t count = lod.count;
+    vec4s positions(count);
+    vec4s normals(count);
+    float ax[BLOCK], ay[BLOCK], az[BLOCK];
+    float bx[BLOCK], by[BLOCK], bz[BLOCK];
+
+    for(size_t base = 0; base < count; base += BLOCK) {
+        const int n = int(std::min<size_t>(BLOCK, count - base));
+
+        std::fill(ax, ax + n, 0.0f); std::fill(ay, ay + n, 0.0f); std::fill(az, az + n, 0.0f);
+        std::fill(bx, bx + n, 0.0f); std::fill(by, by + n, 0.0f); std::fill(bz, bz + n, 0.0f);
+        for(int j = 0; j < lod.width; j++) {
+            const GLuint* __restrict index = lod.index.data() + j * count + base;
+            const float* __restrict weight = lod.weight.data() + j * count + base;
+            for(int k = 0; k < n; k++) {
+                const GLuint i = index[k];
+                const float w = weight[k];
+                ax[k] += w * px[i]; ay[k] += w * py[i]; az[k] += w * pz[i];
+                bx[k] += w * nx[i]; by[k] += w * ny[i]; bz[k] += w * nz[i];
+            }
+        }
+
+        for(int k = 0; k < n; k++) {
+            const float invLen = 1.0f / std::sqrt(std::max(bx[k] * bx[k] + by[k] * by[k] + bz[k] * bz[k], 1e-20f));
+            positions[base + k] = glm::vec4(ax[k], ay[k], az[k], 1);
+            normals[base + k] = glm::vec4(bx[k] * invLen, by[k] * invLen, bz[k] * invLen, 0);
+        }
+    }
+
+    Mesh* mesh = lod.mesh;
+    mesh->matrix_world = cloth.matrix_world;
+    glBindVertexArray(mesh->VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec4), normals.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindVertexArray(0);
+}
+
+void ClothLOD::draw(Shader* shader) {
+    if(levels[current].mesh) {
+        levels[current].mesh->draw(shader);
+    }
+}
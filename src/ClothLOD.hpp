@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core.hpp"
+
+class Camera;
+class Cloth;
+class Mesh;
+class Shader;
+struct Particle;
+
+// Render level of detail for a simulated cloth. The simulation stays on the
+// coarse particles; level k draws a fine mesh made by k rounds of Loop
+// subdivision of the cloth's triangles. Loop subdivision is linear, so every
+// fine vertex is a fixed weighted sum of a few nearby particles. The weights
+// are found once per topology by subdividing stencils instead of points, and
+// each update only skins: fine positions and normals are the same weighted
+// sums of particle positions and normals.
+//
+// The level follows how much of the view the cloth covers: its bounding radius
+// over the camera distance, scaled by the camera projection. Level 0 draws the
+// cloth's own mesh.
+
+class ClothLOD {
+public:
+    static constexpr int BLOCK = 64;
+    static constexpr int MAX_LEVEL = 2;
+
+    bool enabled;
+    float coverage[MAX_LEVEL];   // coverage above which level k + 1 is drawn (1 = the full view height)
+    float hysteresis;            // relative margin past a threshold before the level changes
+
+    ClothLOD();
+    ~ClothLOD();
+
+    /// Picks the level from the camera and the current particle bounds.
+    int select(Camera& camera, const std::vector<Particle*>& particles);
+    int level() const { return current; }
+
+    /// Skins the selected level from the particles and uploads it; the weights
+    /// are rebuilt first if the cloth's topology changed since they were made.
+    void upload(const Cloth& cloth);
+    void draw(Shader* shader);
+
+private:
+    // fine vertex v sums weight * particle over its stencil, stored column-major
+    // as [j * count + v] for j < width; shorter stencils are padded with zero
+    // weights, so every vertex runs the same loop
+    struct Level {
+        std::vector<GLuint> index;
+        std::vector<float> weight;
+        int width = 0;
+        size_t count = 0;
+        unsigned version = ~0u;   // cloth topology the weights were built for
+        Mesh* mesh = nullptr;
+    };
+
+    Level levels[MAX_LEVEL + 1];   // [0] is the cloth itself
+    int current;
+
+    // particle state gathered once per upload
+    std::vector<float> px, py, pz, nx, ny, nz;
+
+    void build(Level& lod, int depth, const Cloth& cloth);
+};
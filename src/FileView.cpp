@@ -0,0 +1,36 @@
+#include "FileView.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileView::FileView(const std::string& path) : mapped(nullptr), length(0) {
+#ifndef _WIN32
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd >= 0) {
+        struct stat info;
+        if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data != MAP_FAILED) {
+                mapped = static_cast<const char*>(data);
+                length = size_t(info.st_size);
+            }
+        }
+        close(fd);
+        if(mapped) return;
+    }
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return;
+    copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    readable = true;
+}
+
+FileView::~FileView() {
+#ifndef _WIN32
+    if(mapped) munmap(const_cast<char*>(mapped), length);
+#endif
+}
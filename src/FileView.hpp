@@ -0,0 +1,24 @@
+#pragma once
+
+#include "core.hpp"
+
+// A whole file as read-only bytes: mapped where possible, read into memory
+// otherwise. The bytes stay valid for the view's lifetime.
+class FileView {
+public:
+    explicit FileView(const std::string& path);
+    ~FileView();
+
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    bool ok() const { return mapped != nullptr || readable; }
+    const char* data() const { return mapped ? mapped : copy.data(); }
+    size_t size() const { return mapped ? length : copy.size(); }
+
+private:
+    const char* mapped;
+    size_t length;
+    std::string copy;
+    bool readable = false;
+};
@@ -0,0 +1,556 @@
+#include "FrameCache.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr char MAGIC[8] = { 'C', 'L', 'T', 'H', 'F', 'R', 'M', 'S' };
+    constexpr char INDEX_MAGIC[8] = { 'C', 'L', 'T', 'H', 'F', 'I', 'D', 'X' };
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t FRAME_MARK = 0x454D5246;   // "FRME"
+    constexpr uint32_t KEY_FRAME = 1;
+    constexpr int32_t LATTICE_LIMIT = 1 << 28;   // keeps residuals of extrapolated points in range
+    constexpr uint64_t MAX_PARTICLES = 1 << 28;  // bounds the buffers a corrupt header can ask for
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        int32_t keyInterval;
+        float step;
+        uint32_t reserved;
+    };
+
+    struct FrameHeader {
+        uint32_t mark;
+        uint32_t flags;
+        uint64_t payloadSize;
+        uint64_t particleCount;
+        glm::vec3 boxMin, boxMax;
+        int32_t origin[3];   // lattice point of boxMin
+    };
+
+    struct IndexFooter {
+        uint64_t frameCount;
+        char magic[8];
+    };
+
+    // LZMA-style binary range coder with 11-bit adaptive probabilities
+    constexpr int PROB_BITS = 11;
+    constexpr uint16_t PROB_INIT = 1 << (PROB_BITS - 1);
+    constexpr int ADAPT_SHIFT = 5;
+    constexpr uint32_t TOP = 1u << 24;
+
+    class RangeEncoder {
+    public:
+        explicit RangeEncoder(std::vector<uint8_t>& out) : out(out) {}
+
+        void bit(uint16_t& prob, int value) {
+            const uint32_t bound = (range >> PROB_BITS) * prob;
+            if(value == 0) {
+                range = bound;
+                prob += ((1 << PROB_BITS) - prob) >> ADAPT_SHIFT;
+            } else {
+                low += bound;
+                range -= bound;
+                prob -= prob >> ADAPT_SHIFT;
+            }
+            while(range < TOP) {
+                range <<= 8;
+                shiftLow();
+            }
+        }
+
+        // equiprobable bits, most significant first
+        void direct(uint32_t value, int count) {
+            while(count-- > 0) {
+                range >>= 1;
+                if((value >> count) & 1) low += range;
+                while(range < TOP) {
+                    range <<= 8;
+                    shiftLow();
+                }
+            }
+        }
+
+        void finish() {
+            for(int i = 0; i < 5; i++) shiftLow();
+        }
+
+    private:
+        std::vector<uint8_t>& out;
+        uint64_t low = 0;
+        uint32_t range = 0xFFFFFFFFu;
+        uint8_t cache = 0;
+        uint64_t cacheSize = 1;
+
+        void shiftLow() {
+            if(uint32_t(low) < 0xFF000000u || (low >> 32) != 0) {
+                const uint8_t carry = uint8_t(low >> 32);
+                uint8_t pending = cache;
+                do {
+                    out.push_back(uint8_t(pending + carry));
+                    pending = 0xFF;
+                } while(--cacheSize != 0);
+                cache = uint8_t(low >> 24);
+            }
+            cacheSize++;
+            low = (low & 0x00FFFFFFu) << 8;
+        }
+    };
+
+    class RangeDecoder {
+    public:
+        RangeDecoder(const uint8_t* data, size_t size) : p(data), end(data + size) {
+            for(int i = 0; i < 5; i++) code = (code << 8) | next();
+        }
+
+        int bit(uint16_t& prob) {
+            const uint32_t bound = (range >> PROB_BITS) * prob;
+            int value;
+            if(code < bound) {
+                range = bound;
+                prob += ((1 << PROB_BITS) - prob) >> ADAPT_SHIFT;
+                value = 0;
+            } else {
+                code -= bound;
+                range -= bound;
+                prob -= prob >> ADAPT_SHIFT;
+                value = 1;
+            }
+            while(range < TOP) {
+                range <<= 8;
+                code = (code << 8) | next();
+            }
+            return value;
+        }
+
+        uint32_t direct(int count) {
+            uint32_t value = 0;
+            while(count-- > 0) {
+                range >>= 1;
+                const uint32_t b = code >= range ? 1 : 0;
+                code -= range & (0u - b);
+                value = (value << 1) | b;
+                while(range < TOP) {
+                    range <<= 8;
+                    code = (code << 8) | next();
+                }
+            }
+            return value;
+        }
+
+        bool overrun() const { return p > end + 4; }   // the coder may look 4 bytes past its flush
+
+    private:
+        const uint8_t* p;
+        const uint8_t* end;
+        uint32_t code = 0;
+        uint32_t range = 0xFFFFFFFFu;
+
+        uint32_t next() {
+            const uint32_t byte = p < end ? *p : 0;
+            p++;
+            return byte;
+        }
+    };
+
+    // Residual model: contexts per axis and per size class of the previous
+    // particle's residual on that axis
+    constexpr int CLASSES = 4;
+    constexpr int MAX_EXPONENT = 32;
+    constexpr int CONTEXT_BITS = 2;   // leading mantissa bits that are modeled
+
+    struct ResidualModel {
+        uint16_t zero[3][CLASSES];
+        uint16_t sign[3][CLASSES];
+        uint16_t exponent[3][CLASSES][MAX_EXPONENT];
+        uint16_t mantissa[3][MAX_EXPONENT][1 << CONTEXT_BITS];
+
+        ResidualModel() {
+            std::fill(&zero[0][0], &zero[0][0] + sizeof(zero) / sizeof(uint16_t), PROB_INIT);
+            std::fill(&sign[0][0], &sign[0][0] + sizeof(sign) / sizeof(uint16_t), PROB_INIT);
+            std::fill(&exponent[0][0][0], &exponent[0][0][0] + sizeof(exponent) / sizeof(uint16_t), PROB_INIT);
+            std::fill(&mantissa[0][0][0], &mantissa[0][0][0] + sizeof(mantissa) / sizeof(uint16_t), PROB_INIT);
+        }
+    };
+
+    int sizeClass(uint32_t magnitude) {
+        return magnitude == 0 ? 0 : magnitude < 4 ? 1 : magnitude < 16 ? 2 : 3;
+    }
+
+    int bitLength(uint32_t v) {
+        int n = 0;
+        while(v) {
+            n++;
+            v >>= 1;
+        }
+        return n;
+    }
+
+    // |r| as an Elias gamma code: the exponent in unary, then the bits below the leading one
+    void encodeResidual(RangeEncoder& rc, ResidualModel& m, int axis, int cls, int32_t r) {
+        rc.bit(m.zero[axis][cls], r != 0);
+        if(r == 0) return;
+        rc.bit(m.sign[axis][cls], r < 0);
+        const uint32_t value = uint32_t(r < 0 ? -int64_t(r) : int64_t(r));   // >= 1
+        const int e = bitLength(value) - 1;
+        for(int i = 0; i < e; i++) rc.bit(m.exponent[axis][cls][i], 1);
+        if(e < MAX_EXPONENT - 1) rc.bit(m.exponent[axis][cls][e], 0);
+
+        const uint32_t rest = value - (1u << e);
+        const int modeled = std::min(e, CONTEXT_BITS);
+        uint32_t node = 1;
+        for(int i = 0; i < modeled; i++) {
+            const int b = (rest >> (e - 1 - i)) & 1;
+            rc.bit(m.mantissa[axis][e][node & ((1 << CONTEXT_BITS) - 1)], b);
+            node = (node << 1) | uint32_t(b);
+        }
+        rc.direct(rest & ((1u << (e - modeled)) - 1), e - modeled);
+    }
+
+    int32_t decodeResidual(RangeDecoder& rc, ResidualModel& m, int axis, int cls) {
+        if(!rc.bit(m.zero[axis][cls])) return 0;
+        const bool negative = rc.bit(m.sign[axis][cls]) != 0;
+        int e = 0;
+        while(e < MAX_EXPONENT - 1 && rc.bit(m.exponent[axis][cls][e])) e++;
+
+        const int modeled = std::min(e, CONTEXT_BITS);
+        uint32_t node = 1, high = 0;
+        for(int i = 0; i < modeled; i++) {
+            const int b = rc.bit(m.mantissa[axis][e][node & ((1 << CONTEXT_BITS) - 1)]);
+            node = (node << 1) | uint32_t(b);
+            high = (high << 1) | uint32_t(b);
+        }
+        const uint32_t low = rc.direct(e - modeled);
+        const uint32_t value = (1u << e) + ((high << (e - modeled)) | low);
+        return negative ? int32_t(-int64_t(value)) : int32_t(value);
+    }
+
+    // the frames a prediction draws on; points past the end of one have no history there
+    struct References {
+        const int32_t* q1;   // last frame
+        size_t size1;
+        const int32_t* q2;   // the one before
+        size_t size2;
+        const int32_t* origin;
+    };
+
+    // order 2 extrapolates the last two frames, order 1 repeats the last one, and
+    // points without history (all of them in a key frame) are predicted from the
+    // previous particle, or the origin for the first
+    int64_t predict(int order, const int32_t* q, const References& ref, size_t k) {
+        if(order >= 2 && k < ref.size1 && k < ref.size2) return 2 * int64_t(ref.q1[k]) - ref.q2[k];
+        if(order >= 1 && k < ref.size1) return ref.q1[k];
+        return k < 3 ? ref.origin[k] : q[k - 3];
+    }
+
+    void encodeFrame(const int32_t* q, size_t n, int order, const References& ref, std::vector<uint8_t>& out) {
+        ResidualModel model;
+        RangeEncoder rc(out);
+        uint32_t last[3] = { 0, 0, 0 };
+        for(size_t k = 0; k < 3 * n; k++) {
+            const int axis = int(k % 3);
+            const int32_t r = int32_t(q[k] - predict(order, q, ref, k));
+            encodeResidual(rc, model, axis, sizeClass(last[axis]), r);
+            last[axis] = uint32_t(r < 0 ? -int64_t(r) : int64_t(r));
+        }
+        rc.finish();
+    }
+
+    bool decodeFrame(const uint8_t* data, size_t size, int32_t* q, size_t n, int order, const References& ref) {
+        ResidualModel model;
+        RangeDecoder rc(data, size);
+        uint32_t last[3] = { 0, 0, 0 };
+        for(size_t k = 0; k < 3 * n; k++) {
+            const int axis = int(k % 3);
+            const int32_t r = decodeResidual(rc, model, axis, sizeClass(last[axis]));
+            q[k] = int32_t(predict(order, q, ref, k) + r);
+            last[axis] = uint32_t(r < 0 ? -int64_t(r) : int64_t(r));
+        }
+        return !rc.overrun();
+    }
+
+    // v in lattice units, already rounded
+    int32_t clampLattice(double v) {
+        if(!(v > -double(LATTICE_LIMIT))) return -LATTICE_LIMIT;   // also catches NaN
+        if(v > double(LATTICE_LIMIT)) return LATTICE_LIMIT;
+        return int32_t(v);
+    }
+}
+
+FrameCacheWriter::FrameCacheWriter(const std::string& path, float precision, int keyInterval)
+    : out(path, std::ios::binary | std::ios::trunc), step(2.0f * precision), keyInterval(std::max(keyInterval, 1)) {
+    if(!out) {
+        failure = "can't open '" + path + "'";
+        return;
+    }
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.keyInterval = this->keyInterval;
+    header.step = step;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    worker = std::thread(&FrameCacheWriter::run, this);
+}
+
+FrameCacheWriter::~FrameCacheWriter() {
+    close();
+}
+
+bool FrameCacheWriter::ok() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure.empty();
+}
+
+std::string FrameCacheWriter::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure;
+}
+
+size_t FrameCacheWriter::frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return appended;
+}
+
+size_t FrameCacheWriter::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+void FrameCacheWriter::append(const Cloth& cloth) {
+    std::vector<glm::vec3> positions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // without a worker nothing drains the queue, and a failed cache is lost anyway
+        if(closing || !worker.joinable() || !failure.empty()) return;
+        if(!spare.empty()) {
+            positions.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+    positions.resize(cloth.particles.size());
+    for(size_t i = 0; i < positions.size(); i++) {
+        positions[i] = cloth.particles[i]->position;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    room.wait(lock, [this] { return queued.size() < MAX_QUEUED || closing; });
+    if(closing) return;
+    queued.push_back(std::move(positions));
+    appended++;
+    lock.unlock();
+    wake.notify_one();
+}
+
+void FrameCacheWriter::append(const glm::vec3* positions, size_t count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if(closing || !worker.joinable() || !failure.empty()) return;
+    room.wait(lock, [this] { return queued.size() < MAX_QUEUED || closing; });
+    if(closing) return;
+    std::vector<glm::vec3> frame;
+    if(!spare.empty()) {
+        frame.swap(spare.back());
+        spare.pop_back();
+    }
+    frame.assign(positions, positions + count);
+    queued.push_back(std::move(frame));
+    appended++;
+    lock.unlock();
+    wake.notify_one();
+}
+
+void FrameCacheWriter::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(closing) return;
+        closing = true;
+    }
+    wake.notify_one();
+    room.notify_all();
+    if(worker.joinable()) worker.join();
+
+    if(out.is_open()) {
+        // the index goes last, so a bake cut short still has every frame before it
+        IndexFooter footer = {};
+        footer.frameCount = offsets.size();
+        memcpy(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        out.write(reinterpret_cast<const char*>(offsets.data()), std::streamsize(offsets.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+        out.close();
+        if(!out) fail("can't finish the frame cache");
+    }
+}
+
+void FrameCacheWriter::fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(failure.empty()) failure = message;
+}
+
+void FrameCacheWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        wake.wait(lock, [this] { return !queued.empty() || closing; });
+        if(queued.empty()) break;   // closing, all encoded
+        std::vector<glm::vec3> frame = std::move(queued.front());
+        queued.pop_front();
+        lock.unlock();
+        room.notify_one();
+
+        encode(frame);
+
+        lock.lock();
+        spare.push_back(std::move(frame));
+    }
+}
+
+void FrameCacheWriter::encode(const std::vector<glm::vec3>& positions) {
+    const size_t n = positions.size();
+    const double invStep = 1.0 / step;
+
+    FrameHeader header = {};
+    header.mark = FRAME_MARK;
+    header.particleCount = n;
+    header.boxMin = glm::vec3(INFINITY);
+    header.boxMax = glm::vec3(-INFINITY);
+    current.resize(3 * n);
+    for(size_t i = 0; i < n; i++) {
+        header.boxMin = glm::min(header.boxMin, positions[i]);
+        header.boxMax = glm::max(header.boxMax, positions[i]);
+        for(int a = 0; a < 3; a++) {
+            current[3 * i + a] = clampLattice(std::round(double(positions[i][a]) * invStep));
+        }
+    }
+    for(int a = 0; a < 3; a++) {
+        header.origin[a] = n > 0 ? clampLattice(std::floor(header.boxMin[a] * invStep)) : 0;
+    }
+
+    if(sinceKey >= size_t(keyInterval)) sinceKey = 0;
+    const int order = int(std::min<size_t>(sinceKey, 2));
+    if(order == 0) header.flags |= KEY_FRAME;
+
+    payload.clear();
+    const References ref = { previous.data(), previous.size(), before.data(), before.size(), header.origin };
+    encodeFrame(current.data(), n, order, ref, payload);
+    header.payloadSize = payload.size();
+
+    offsets.push_back(uint64_t(out.tellp()));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(payload.size()));
+    if(!out) fail("can't write the frame cache");
+
+    before.swap(previous);
+    previous.swap(current);
+    sinceKey++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    written += sizeof(header) + payload.size();
+}
+
+FrameCacheReader::FrameCacheReader(const std::string& path) : file(path) {
+    if(!file.ok() || file.size() < sizeof(FileHeader)) return;
+    FileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || !(header.step > 0.0f)) return;
+    step = header.step;
+
+    auto frameFits = [&](uint64_t offset) {
+        if(offset < sizeof(FileHeader) || offset > file.size() || file.size() - offset < sizeof(FrameHeader)) return false;
+        FrameHeader frame;
+        memcpy(&frame, file.data() + offset, sizeof(frame));
+        return frame.mark == FRAME_MARK && frame.payloadSize <= file.size() - offset - sizeof(FrameHeader) &&
+               frame.particleCount <= MAX_PARTICLES;
+    };
+
+    // the footer's index if the writer closed cleanly
+    const size_t size = file.size();
+    if(size >= sizeof(FileHeader) + sizeof(IndexFooter)) {
+        IndexFooter footer;
+        memcpy(&footer, file.data() + size - sizeof(footer), sizeof(footer));
+        const size_t room = size - sizeof(FileHeader) - sizeof(IndexFooter);
+        if(memcmp(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && footer.frameCount <= room / sizeof(uint64_t)) {
+            index.resize(size_t(footer.frameCount));
+            memcpy(index.data(), file.data() + size - sizeof(footer) - index.size() * sizeof(uint64_t),
+                   index.size() * sizeof(uint64_t));
+            if(std::all_of(index.begin(), index.end(), frameFits)) {
+                valid = true;
+                return;
+            }
+        }
+    }
+
+    // otherwise walk the frames up to the first incomplete one
+    index.clear();
+    for(uint64_t offset = sizeof(FileHeader); frameFits(offset);) {
+        index.push_back(offset);
+        FrameHeader frame;
+        memcpy(&frame, file.data() + offset, sizeof(frame));
+        offset += sizeof(FrameHeader) + frame.payloadSize;
+    }
+    valid = true;
+}
+
+size_t FrameCacheReader::particleCount(size_t frame) const {
+    FrameHeader header;
+    memcpy(&header, file.data() + index[frame], sizeof(header));
+    return size_t(header.particleCount);
+}
+
+void FrameCacheReader::bounds(size_t frame, glm::vec3& lo, glm::vec3& hi) const {
+    FrameHeader header;
+    memcpy(&header, file.data() + index[frame], sizeof(header));
+    lo = header.boxMin;
+    hi = header.boxMax;
+}
+
+bool FrameCacheReader::decode(size_t frame) {
+    FrameHeader header;
+    memcpy(&header, file.data() + index[frame], sizeof(header));
+    const size_t n = size_t(header.particleCount);
+
+    if(header.flags & KEY_FRAME) {
+        sinceKey = 0;
+    } else if(decoded != frame - 1) {
+        return false;
+    }
+    const int order = int(std::min<size_t>(sinceKey, 2));
+
+    current.resize(3 * n);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data() + index[frame] + sizeof(FrameHeader));
+    const References ref = { previous.data(), previous.size(), before.data(), before.size(), header.origin };
+    if(!decodeFrame(data, size_t(header.payloadSize), current.data(), n, order, ref)) {
+        decoded = SIZE_MAX;
+        return false;
+    }
+    before.swap(previous);
+    previous.swap(current);
+    decoded = frame;
+    sinceKey++;
+    return true;
+}
+
+bool FrameCacheReader::read(size_t frame, std::vector<glm::vec3>& positions) {
+    if(!valid || frame >= index.size()) return false;
+
+    if(frame != decoded) {
+        // continue from the last decoded frame if it is on the way, else from a key frame
+        size_t start = frame;
+        while(start > 0) {
+            FrameHeader header;
+            memcpy(&header, file.data() + index[start], sizeof(header));
+            if((header.flags & KEY_FRAME) || start == decoded + 1) break;
+            start--;
+        }
+        for(size_t f = start; f <= frame; f++) {
+            if(!decode(f)) return false;
+        }
+    }
+
+    const size_t n = previous.size() / 3;
+    positions.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        positions[i] = glm::vec3(glm::dvec3(previous[3 * i], previous[3 * i + 1], previous[3 * i + 2]) * double(step));
+    }
+    return true;
+}
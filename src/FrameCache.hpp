@@ -0,0 +1,108 @@
+#pragma once
+
+#include "core.hpp"
+#include "FileView.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class Cloth;
+
+// Streaming cache of baked particle positions, one frame per append.
+//
+// Positions are quantized onto a lattice with a step of twice the requested
+// precision, so every coordinate comes back within precision of what was
+// stored. Each frame records its bounding box, and key frames code their
+// lattice points from the box corner and then from the previous particle.
+// Other frames are predicted from the two frames before them (constant
+// velocity), or from one right after a key frame. Only the prediction
+// residuals are stored, with an adaptive binary range coder: a zero flag, a
+// sign and an Elias gamma magnitude whose bits are context modeled per axis
+// and by the size of the previous particle's residual. Smooth motion makes
+// most residuals zero or one and costs one or two bits per coordinate.
+//
+// A key frame every keyInterval frames bounds the work of a seek. Particles
+// added since the last frame (tearing, remeshing) are coded as in a key frame.
+// An index of frame offsets is appended when the writer closes; a file cut
+// short without one is indexed by walking its frame headers instead.
+//
+// Encoding and writing run on a background thread. append only copies the
+// positions, and waits only if the writer is several frames behind.
+
+class FrameCacheWriter {
+public:
+    /// precision is the largest error allowed per coordinate, in meters.
+    explicit FrameCacheWriter(const std::string& path, float precision = 1e-4f, int keyInterval = 30);
+    ~FrameCacheWriter();   // closes
+
+    FrameCacheWriter(const FrameCacheWriter&) = delete;
+    FrameCacheWriter& operator=(const FrameCacheWriter&) = delete;
+
+    bool ok() const;
+    std::string error() const;   // the first failure, empty if none
+
+    void append(const Cloth& cloth);
+    void append(const glm::vec3* positions, size_t count);
+
+    /// Encodes what is queued and writes the index. Later appends are ignored.
+    void close();
+
+    size_t frames() const;   // appended so far
+    size_t bytes() const;    // written so far
+
+private:
+    static constexpr size_t MAX_QUEUED = 8;
+
+    std::ofstream out;
+    float step;
+    int keyInterval;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake, room;
+    std::deque<std::vector<glm::vec3>> queued;
+    std::vector<std::vector<glm::vec3>> spare;   // drained frames, reused by append
+    bool closing = false;
+    size_t appended = 0, written = 0;
+    std::string failure;
+    std::thread worker;
+
+    // encoder state, owned by the worker
+    std::vector<int32_t> current, previous, before;   // lattice points of this and the last two frames
+    size_t sinceKey = 0;
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> payload;
+
+    void run();
+    void encode(const std::vector<glm::vec3>& positions);
+    void fail(const std::string& message);
+};
+
+class FrameCacheReader {
+public:
+    explicit FrameCacheReader(const std::string& path);
+
+    bool ok() const { return valid; }
+    size_t frames() const { return index.size(); }
+    float precision() const { return 0.5f * step; }
+    size_t particleCount(size_t frame) const;
+    void bounds(size_t frame, glm::vec3& lo, glm::vec3& hi) const;
+
+    /// Decodes a frame. Sequential reads decode one frame each; a seek decodes
+    /// forward from the nearest key frame. Returns false past the end.
+    bool read(size_t frame, std::vector<glm::vec3>& positions);
+
+private:
+    FileView file;
+    bool valid = false;
+    float step = 0.0f;
+    std::vector<uint64_t> index;   // frame header offsets
+
+    // the last decoded frame and the one before it, as lattice points
+    std::vector<int32_t> current, previous, before;
+    size_t decoded = SIZE_MAX;
+    size_t sinceKey = 0;
+
+    bool decode(size_t frame);
+};
@@ -0,0 +1,202 @@
+#include "InputLog.hpp"
+#include "FileView.hpp"
+#include "MeshCache.hpp"
+
+#include <cstring>
+
+namespace {
+    constexpr char MAGIC[8] = { 'C', 'L', 'T', 'H', 'I', 'N', 'P', 'T' };
+    constexpr uint32_t VERSION = 2;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t startupLength;
+        uint64_t startupHash;   // of the startup file's bytes, 0 without one
+    };
+
+    // a missing file hashes differently from every readable one
+    uint64_t hashFile(const std::string& path) {
+        if(path.empty()) return 0;
+        FileView file(path);
+        if(!file.ok()) return ~uint64_t(0);
+        return MeshCache::hash(file.data(), file.size());
+    }
+
+    void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while(value >= 0x80) {
+            out.push_back(uint8_t(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+
+    void putSigned(std::vector<uint8_t>& out, int64_t value) {
+        putVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+    }
+
+    // reads from [p, end); every getter leaves p past the end on a short read
+    class Reader {
+    public:
+        Reader(const uint8_t* p, const uint8_t* end) : p(p), end(end) {}
+
+        bool done() const { return p >= end; }
+        bool overran() const { return p > end; }
+
+        uint8_t byte() {
+            return p < end ? *p++ : (p = end + 1, 0);
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for(int shift = 0; shift < 64; shift += 7) {
+                const uint8_t b = byte();
+                value |= uint64_t(b & 0x7F) << shift;
+                if(!(b & 0x80)) return value;
+            }
+            p = end + 1;   // too long to be ours
+            return 0;
+        }
+
+        int64_t signedVarint() {
+            const uint64_t v = varint();
+            return int64_t(v >> 1) ^ -int64_t(v & 1);
+        }
+
+    private:
+        const uint8_t* p;
+        const uint8_t* end;
+    };
+}
+
+InputRecorder::InputRecorder(const std::string& path, const std::string& startup)
+    : out(path, std::ios::binary | std::ios::trunc) {
+    if(!out) {
+        failure = "can't open '" + path + "'";
+        return;
+    }
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.startupLength = uint32_t(startup.size());
+    header.startupHash = hashFile(startup);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(startup.data(), std::streamsize(startup.size()));
+    out.flush();
+    if(!out) failure = "can't write '" + path + "'";
+}
+
+void InputRecorder::begin(uint64_t step, InputEvent::Type type) {
+    record.clear();
+    putVarint(record, step - lastStep);
+    record.push_back(type);
+    lastStep = step;
+}
+
+void InputRecorder::write() {
+    if(!ok()) return;
+    // flushed per event, so the log survives a crash
+    out.write(reinterpret_cast<const char*>(record.data()), std::streamsize(record.size()));
+    out.flush();
+    if(!out) failure = "can't write the input log";
+}
+
+void InputRecorder::key(uint64_t step, unsigned char key) {
+    if(closed) return;
+    begin(step, InputEvent::KEY);
+    record.push_back(key);
+    write();
+}
+
+void InputRecorder::click(uint64_t step, int button, int state, int modifiers, int x, int y) {
+    if(closed) return;
+    begin(step, InputEvent::CLICK);
+    record.push_back(uint8_t(button));
+    record.push_back(uint8_t(state));
+    record.push_back(uint8_t(modifiers));
+    putSigned(record, x);
+    putSigned(record, y);
+    lastX = x;
+    lastY = y;
+    write();
+}
+
+void InputRecorder::drag(uint64_t step, int x, int y) {
+    if(closed) return;
+    begin(step, InputEvent::DRAG);
+    putSigned(record, int64_t(x) - lastX);
+    putSigned(record, int64_t(y) - lastY);
+    lastX = x;
+    lastY = y;
+    write();
+}
+
+void InputRecorder::close(uint64_t step, uint64_t checksum) {
+    if(closed) return;
+    begin(step, InputEvent::END);
+    for(int i = 0; i < 8; i++) record.push_back(uint8_t(checksum >> (8 * i)));
+    write();
+    closed = true;
+    out.close();
+}
+
+bool loadInputLog(const std::string& path, InputLog& log, std::string& error) {
+    log = InputLog();
+    FileView file(path);
+    Header header;
+    if(!file.ok() || file.size() < sizeof(header)) {
+        error = "can't read '" + path + "'";
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+       header.startupLength > file.size() - sizeof(header)) {
+        error = "'" + path + "' is not a version " + std::to_string(VERSION) + " input log";
+        return false;
+    }
+    log.startup.assign(file.data() + sizeof(header), header.startupLength);
+    if(hashFile(log.startup) != header.startupHash) {
+        error = "'" + log.startup + "' has changed since '" + path + "' was recorded";
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+    Reader in(data + sizeof(header) + header.startupLength, data + file.size());
+    uint64_t step = 0;
+    int x = 0, y = 0;
+    while(!in.done()) {
+        InputEvent e = {};
+        step += in.varint();
+        e.step = step;
+        e.type = InputEvent::Type(in.byte());
+        switch(e.type) {
+            case InputEvent::KEY:
+                e.key = in.byte();
+                break;
+            case InputEvent::CLICK:
+                e.button = in.byte();
+                e.state = in.byte();
+                e.modifiers = in.byte();
+                x = int(in.signedVarint());
+                y = int(in.signedVarint());
+                break;
+            case InputEvent::DRAG:
+                x += int(in.signedVarint());
+                y += int(in.signedVarint());
+                break;
+            case InputEvent::END:
+                for(int i = 0; i < 8; i++) e.checksum |= uint64_t(in.byte()) << (8 * i);
+                break;
+            default:
+                if(in.overran()) break;
+                error = "'" + path + "' has an unknown event type";
+                return false;
+        }
+        if(in.overran()) break;   // cut short mid-event, e.g. by a crash
+        e.x = x;
+        e.y = y;
+        log.events.push_back(e);
+        if(e.type == InputEvent::END) break;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "core.hpp"
+
+// Session recordings for reproducing what a user saw. Every key press, mouse
+// click and mouse drag is stamped with the simulation step it arrived before,
+// and a replay hands it back to the same handler just before that step runs.
+// The simulation only depends on its input and its step count, so a replay
+// of the same build repeats the session bit for bit; the camera and LOD only
+// change what is drawn.
+//
+// The log starts with the startup argument (a scene file or checkpoint, or
+// nothing) and a hash of that file, since the replay has to start from the
+// same state; a log whose startup file has changed is refused. Events follow
+// as a varint step delta and a type byte: a key is one byte, a click its
+// button, state, modifiers and position, and a drag the zigzag varint change
+// in position, so a session costs a few bytes per event. Quitting appends an
+// end record with the step and a checksum of the cloth positions, which the
+// replay compares against its own. Each event is flushed as it is recorded,
+// so a session that crashed still replays up to the crash.
+//
+// Checkpoints saved and restored during a session go to a file named after
+// the log rather than the startup file, so a replay saves the same states
+// again and starts from the recorded one. A restore reads the file as it is
+// at replay time, so one that comes before any save in the session matches
+// only if the file has not changed since.
+
+struct InputEvent {
+    enum Type : uint8_t { KEY = 1, CLICK, DRAG, END };
+
+    Type type;
+    uint64_t step;
+    unsigned char key;
+    uint8_t button, state, modifiers;
+    int x, y;
+    uint64_t checksum;   // END only
+};
+
+struct InputLog {
+    std::string startup;
+    std::vector<InputEvent> events;
+};
+
+class InputRecorder {
+public:
+    InputRecorder(const std::string& path, const std::string& startup);
+
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    bool ok() const { return failure.empty(); }
+    const std::string& error() const { return failure; }
+
+    void key(uint64_t step, unsigned char key);
+    void click(uint64_t step, int button, int state, int modifiers, int x, int y);
+    void drag(uint64_t step, int x, int y);
+
+    /// Appends the end record. Later events are ignored.
+    void close(uint64_t step, uint64_t checksum);
+
+private:
+    std::ofstream out;
+    std::string failure;
+    std::vector<uint8_t> record;
+    uint64_t lastStep = 0;
+    int lastX = 0, lastY = 0;
+    bool closed = false;
+
+    void begin(uint64_t step, InputEvent::Type type);
+    void write();
+};
+
+/// Reads a whole log. Returns false and sets error if the file can't be read,
+/// is malformed or its startup file has changed; a log cut short at an event
+/// boundary reads up to there.
+bool loadInputLog(const std::string& path, InputLog& log, std::string& error);
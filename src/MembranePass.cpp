@@ -0,0 +1,176 @@
+#include "MembranePass.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void MembranePass::build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles,
+                         float youngModulus, float poissonRatio, float damping) {
+    // plane stress Lame parameters
+    mu = youngModulus / (2.0f * (1.0f + poissonRatio));
+    lambda = youngModulus * poissonRatio / (1.0f - poissonRatio * poissonRatio);
+    viscosity = damping;
+
+    const size_t nt = triangles.size();
+    const size_t padded = (nt + LANES - 1) / LANES * LANES;
+    i1.assign(padded, 0); i2.assign(padded, 0); i3.assign(padded, 0);
+    a.assign(padded, 0.0f); b.assign(padded, 0.0f);
+    c.assign(padded, 0.0f); d.assign(padded, 0.0f);
+    restArea.assign(padded, 0.0f);
+    normalX.assign(padded, 0.0f); normalY.assign(padded, 0.0f); normalZ.assign(padded, 1.0f);
+
+    for(size_t t = 0; t < nt; t++) {
+        i1[t] = triangles[t]->p1->particleID;
+        i2[t] = triangles[t]->p2->particleID;
+        i3[t] = triangles[t]->p3->particleID;
+
+        // rest edges in the triangle's own plane: e1 along x, e2 in the upper half
+        const glm::vec3 X1 = particles[i1[t]]->position;
+        const glm::vec3 e1 = particles[i2[t]]->position - X1;
+        const glm::vec3 e2 = particles[i3[t]]->position - X1;
+        const float l1 = glm::length(e1);
+        const glm::vec3 u = e1 / l1;
+        const glm::vec3 v = glm::normalize(glm::cross(glm::cross(e1, e2), e1));
+        const float e2u = glm::dot(e2, u), e2v = glm::dot(e2, v);
+
+        // Dm = [l1 e2u; 0 e2v]
+        const float det = l1 * e2v;
+        a[t] = e2v / det;  b[t] = -e2u / det;
+        c[t] = 0.0f;       d[t] = l1 / det;
+        restArea[t] = 0.5f * std::abs(det);
+
+        const glm::vec3 n = glm::normalize(glm::cross(e1, e2));
+        normalX[t] = n.x; normalY[t] = n.y; normalZ[t] = n.z;
+    }
+}
+
+void MembranePass::update(const std::vector<Triangle*>& triangles, const std::vector<GLuint>& changed) {
+    for(GLuint t : changed) {
+        i1[t] = triangles[t]->p1->particleID;
+        i2[t] = triangles[t]->p2->particleID;
+        i3[t] = triangles[t]->p3->particleID;
+    }
+}
+
+void MembranePass::orient(const std::vector<Particle*>& particles) {
+    // padding elements keep their default normal
+    for(size_t t = 0; t < i1.size(); t++) {
+        if(restArea[t] == 0.0f) continue;
+        const glm::vec3 X1 = particles[i1[t]]->position;
+        const glm::vec3 n = glm::cross(particles[i2[t]]->position - X1, particles[i3[t]]->position - X1);
+        const float length = glm::length(n);
+        if(length > 1e-12f) {
+            normalX[t] = n.x / length; normalY[t] = n.y / length; normalZ[t] = n.z / length;
+        }
+    }
+}
+
+template<bool Damped>
+void MembranePass::run(const std::vector<Particle*>& particles) {
+    const size_t ne = i1.size();
+    const float lam = lambda, twoMu = 2.0f * mu, eta = viscosity;
+
+    // edge vectors Ds (and their rates) gathered per block into lanes
+    float s1x[BLOCK], s1y[BLOCK], s1z[BLOCK], s2x[BLOCK], s2y[BLOCK], s2z[BLOCK];
+    float w1x[BLOCK], w1y[BLOCK], w1z[BLOCK], w2x[BLOCK], w2y[BLOCK], w2z[BLOCK];
+    // element normals for the next step, stored after the kernel so it has no read-write streams
+    float nextX[BLOCK], nextY[BLOCK], nextZ[BLOCK];
+    // forces on the second and third corners
+    float g2x[BLOCK], g2y[BLOCK], g2z[BLOCK], g3x[BLOCK], g3y[BLOCK], g3z[BLOCK];
+
+    for(size_t base = 0; base < ne; base += BLOCK) {
+        // a multiple of LANES, since the elements are padded
+        const int n = int(std::min<size_t>(BLOCK, ne - base));
+
+        for(int k = 0; k < n; k++) {
+            const Particle* p1 = particles[i1[base + k]];
+            const Particle* p2 = particles[i2[base + k]];
+            const Particle* p3 = particles[i3[base + k]];
+            s1x[k] = p2->position.x - p1->position.x; s1y[k] = p2->position.y - p1->position.y; s1z[k] = p2->position.z - p1->position.z;
+            s2x[k] = p3->position.x - p1->position.x; s2y[k] = p3->position.y - p1->position.y; s2z[k] = p3->position.z - p1->position.z;
+            if constexpr (Damped) {
+                w1x[k] = p2->velocity.x - p1->velocity.x; w1y[k] = p2->velocity.y - p1->velocity.y; w1z[k] = p2->velocity.z - p1->velocity.z;
+                w2x[k] = p3->velocity.x - p1->velocity.x; w2y[k] = p3->velocity.y - p1->velocity.y; w2z[k] = p3->velocity.z - p1->velocity.z;
+            }
+        }
+
+        const float* __restrict ia = a.data() + base;
+        const float* __restrict ib = b.data() + base;
+        const float* __restrict ic = c.data() + base;
+        const float* __restrict id = d.data() + base;
+        const float* __restrict area = restArea.data() + base;
+        const float* __restrict nx = normalX.data() + base;
+        const float* __restrict ny = normalY.data() + base;
+        const float* __restrict nz = normalZ.data() + base;
+        for(int k = 0; k < n; k++) {
+            // F = Ds Dm^-1, columns f0 and f1
+            const float f0x = s1x[k] * ia[k] + s2x[k] * ic[k], f0y = s1y[k] * ia[k] + s2y[k] * ic[k], f0z = s1z[k] * ia[k] + s2z[k] * ic[k];
+            const float f1x = s1x[k] * ib[k] + s2x[k] * id[k], f1y = s1y[k] * ib[k] + s2y[k] * id[k], f1z = s1z[k] * ib[k] + s2z[k] * id[k];
+
+            // in-plane polar decomposition: F = Q M with Q = [q0 q1] spanning the
+            // deformed triangle and M = [m00 m01; 0 m11], then the rotation of M in
+            // closed form. q1 comes from the tracked normal rather than from f1, so a
+            // collapsing or inverting element keeps a continuous frame (m11 < 0 when
+            // inverted). Small offsets keep the padded zero elements finite.
+            const float cxn = f0y * f1z - f0z * f1y, cyn = f0z * f1x - f0x * f1z, czn = f0x * f1y - f0y * f1x;
+            const float side = std::copysign(1.0f, cxn * nx[k] + cyn * ny[k] + czn * nz[k]);
+            const float tx = side * cxn + 1e-3f * nx[k], ty = side * cyn + 1e-3f * ny[k], tz = side * czn + 1e-3f * nz[k];
+            const float tn = 1.0f / std::sqrt(tx * tx + ty * ty + tz * tz + 1e-20f);
+            const float ux = tx * tn, uy = ty * tn, uz = tz * tn;
+            nextX[k] = ux; nextY[k] = uy; nextZ[k] = uz;
+
+            const float m00 = std::sqrt(f0x * f0x + f0y * f0y + f0z * f0z + 1e-20f);
+            const float inv00 = 1.0f / m00;
+            const float q0x = f0x * inv00, q0y = f0y * inv00, q0z = f0z * inv00;
+            float q1x = uy * q0z - uz * q0y, q1y = uz * q0x - ux * q0z, q1z = ux * q0y - uy * q0x;
+            const float qn = 1.0f / std::sqrt(q1x * q1x + q1y * q1y + q1z * q1z + 1e-20f);
+            q1x *= qn; q1y *= qn; q1z *= qn;
+            const float m01 = f1x * q0x + f1y * q0y + f1z * q0z;
+            const float m11 = f1x * q1x + f1y * q1y + f1z * q1z;
+            const float rc = m00 + m11, rs = -m01;
+            const float trace = std::sqrt(rc * rc + rs * rs + 1e-20f);   // tr(R^T F)
+            const float invTrace = 1.0f / trace;
+            const float cs = rc * invTrace, sn = rs * invTrace;
+            const float r0x = q0x * cs + q1x * sn, r0y = q0y * cs + q1y * sn, r0z = q0z * cs + q1z * sn;
+            const float r1x = q1x * cs - q0x * sn, r1y = q1y * cs - q0y * sn, r1z = q1z * cs - q0z * sn;
+
+            // co-rotated linear stress P = 2 mu (F - R) + lambda tr(R^T F - I) R
+            const float l = lam * (trace - 2.0f);
+            float p0x = twoMu * (f0x - r0x) + l * r0x, p0y = twoMu * (f0y - r0y) + l * r0y, p0z = twoMu * (f0z - r0z) + l * r0z;
+            float p1x = twoMu * (f1x - r1x) + l * r1x, p1y = twoMu * (f1y - r1y) + l * r1y, p1z = twoMu * (f1z - r1z) + l * r1z;
+
+            if constexpr (Damped) {
+                // viscous stress on the co-rotated strain rate, eta * R sym(R^T dF) with
+                // dF = dDs Dm^-1, so spin is not damped and the damping does not stiffen with stretch
+                const float d0x = w1x[k] * ia[k] + w2x[k] * ic[k], d0y = w1y[k] * ia[k] + w2y[k] * ic[k], d0z = w1z[k] * ia[k] + w2z[k] * ic[k];
+                const float d1x = w1x[k] * ib[k] + w2x[k] * id[k], d1y = w1y[k] * ib[k] + w2y[k] * id[k], d1z = w1z[k] * ib[k] + w2z[k] * id[k];
+                const float S00 = eta * (r0x * d0x + r0y * d0y + r0z * d0z);
+                const float S01 = eta * 0.5f * (r0x * d1x + r0y * d1y + r0z * d1z + r1x * d0x + r1y * d0y + r1z * d0z);
+                const float S11 = eta * (r1x * d1x + r1y * d1y + r1z * d1z);
+                p0x += r0x * S00 + r1x * S01; p0y += r0y * S00 + r1y * S01; p0z += r0z * S00 + r1z * S01;
+                p1x += r0x * S01 + r1x * S11; p1y += r0y * S01 + r1y * S11; p1z += r0z * S01 + r1z * S11;
+            }
+
+            // corner forces H = -A0 P Dm^-T
+            const float A = -area[k];
+            g2x[k] = A * (p0x * ia[k] + p1x * ib[k]); g2y[k] = A * (p0y * ia[k] + p1y * ib[k]); g2z[k] = A * (p0z * ia[k] + p1z * ib[k]);
+            g3x[k] = A * (p0x * ic[k] + p1x * id[k]); g3y[k] = A * (p0y * ic[k] + p1y * id[k]); g3z[k] = A * (p0z * ic[k] + p1z * id[k]);
+        }
+
+        std::copy(nextX, nextX + n, normalX.begin() + base);
+        std::copy(nextY, nextY + n, normalY.begin() + base);
+        std::copy(nextZ, nextZ + n, normalZ.begin() + base);
+
+        // corners are shared between elements, so the scatter stays serial
+        for(int k = 0; k < n; k++) {
+            const glm::vec3 f2(g2x[k], g2y[k], g2z[k]);
+            const glm::vec3 f3(g3x[k], g3y[k], g3z[k]);
+            particles[i1[base + k]]->force -= f2 + f3;
+            particles[i2[base + k]]->force += f2;
+            particles[i3[base + k]]->force += f3;
+        }
+    }
+}
+
+template void MembranePass::run<true>(const std::vector<Particle*>&);
+template void MembranePass::run<false>(const std::vector<Particle*>&);
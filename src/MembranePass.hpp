@@ -0,0 +1,57 @@
+#pragma once
+
+#include "core.hpp"
+
+struct Particle;
+struct Triangle;
+
+// Continuum membrane (co-rotated linear, plane stress) on the cloth triangles.
+// Each element caches the inverse of its 2D rest edge matrix Dm and its rest
+// area, so a step is F = Ds * Dm^-1, the in-plane rotation R of F, stress
+// P = 2 mu (F - R) + lambda tr(R^T F - I) R, and corner forces -A0 * P Dm^-T.
+// Stiffness is per unit area, so the stretch response does not change with
+// resolution, and unlike StVK it does not stiffen under the large stretch the
+// pinned corners see, which keeps the explicit step stable.
+//
+// The element count is padded to a multiple of LANES with zero-area elements,
+// so the blocked kernel never has a partial SIMD tail.
+
+class MembranePass {
+public:
+    static constexpr int LANES = 8;
+    static constexpr int BLOCK = 64;
+
+    /// youngModulus is E * thickness (N/m); damping is a strain-rate viscosity (N s/m).
+    void build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles,
+               float youngModulus, float poissonRatio, float damping);
+
+    // Re-reads the corners of the changed triangles after a topology edit; the
+    // rest shape of an element does not change when a corner is duplicated.
+    void update(const std::vector<Triangle*>& triangles, const std::vector<GLuint>& changed);
+
+    // Re-takes the tracked element normals from the current pose, for elements
+    // built from a rest pose the cloth has since moved away from.
+    void orient(const std::vector<Particle*>& particles);
+
+    // Adds the elastic force, and with Damped the viscous strain-rate force.
+    template<bool Damped>
+    void run(const std::vector<Particle*>& particles);
+
+    // The tracked normal of element t (= triangle t), for checkpoints; orient
+    // would re-take it from the pose, which need not match bit for bit.
+    glm::vec3 lastNormal(size_t t) const { return glm::vec3(normalX[t], normalY[t], normalZ[t]); }
+    void setLastNormal(size_t t, const glm::vec3& n) { normalX[t] = n.x; normalY[t] = n.y; normalZ[t] = n.z; }
+
+private:
+    float lambda, mu, viscosity;
+
+    // element corners, padded
+    std::vector<GLuint> i1, i2, i3;
+
+    // cached rest shape: Dm^-1 = [a b; c d] and area
+    std::vector<float> a, b, c, d;
+    std::vector<float> restArea;
+
+    // element normal, re-taken every step but kept on the side it started on
+    std::vector<float> normalX, normalY, normalZ;
+};
@@ -0,0 +1,266 @@
+#include "MeshCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    constexpr char MAGIC[8] = { 'C', 'L', 'T', 'H', 'M', 'E', 'S', 'H' };
+    constexpr size_t ALIGNMENT = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t fileSize;
+        uint64_t sourceSize;
+        uint64_t sourceHash;
+        uint64_t vertexCount;
+        uint64_t triangleCount;
+        uint64_t edgeCount;
+        uint64_t shapeCount;
+    };
+
+    struct SectionEntry {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct ShapeRecord {
+        uint64_t firstTriangle;
+        uint64_t triangleCount;
+        uint64_t nameOffset;   // into NAMES
+        uint64_t nameLength;
+    };
+
+    size_t alignUp(size_t offset) {
+        return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+
+    uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    uint64_t load64(const char* p) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        return w;
+    }
+}
+
+std::string MeshCache::pathFor(const std::string& assetPath) {
+    return assetPath + ".meshcache";
+}
+
+// xxHash64-style: four independent lanes over 32-byte stripes keep the
+// multiplies pipelined, so hashing runs at memory speed
+uint64_t MeshCache::hash(const char* data, size_t size) {
+    uint64_t lane[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32) {
+        for(int k = 0; k < 4; k++) {
+            lane[k] = rotl(lane[k] + load64(data + i + 8 * k) * PRIME2, 31) * PRIME1;
+        }
+    }
+
+    uint64_t h = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18) + uint64_t(size);
+    for(; i + 8 <= size; i += 8) {
+        h = rotl(h ^ (rotl(load64(data + i) * PRIME2, 31) * PRIME1), 27) * PRIME1 + PRIME3;
+    }
+    for(; i < size; i++) {
+        h = rotl(h ^ (uint64_t(uint8_t(data[i])) * PRIME3), 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+const char* MeshCache::section(SectionType type, size_t* size) const {
+    Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    for(uint32_t s = 0; s < header.sectionCount; s++) {
+        SectionEntry entry;
+        memcpy(&entry, file.data() + sizeof(Header) + s * sizeof(SectionEntry), sizeof(entry));
+        if(entry.type == type) {
+            if(size) *size = size_t(entry.size);
+            return file.data() + entry.offset;
+        }
+    }
+    if(size) *size = 0;
+    return nullptr;
+}
+
+std::shared_ptr<const MeshCache> MeshCache::open(const std::string& assetPath) {
+    std::shared_ptr<MeshCache> cache(new MeshCache(pathFor(assetPath)));
+    if(!cache->file.ok() || !cache->validate(assetPath)) {
+        return nullptr;
+    }
+    return cache;
+}
+
+bool MeshCache::validate(const std::string& assetPath) {
+    const size_t size = file.size();
+    Header header;
+    if(size < sizeof(header)) return false;
+    memcpy(&header, file.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.fileSize != size) {
+        return false;
+    }
+    if(header.sectionCount > (size - sizeof(Header)) / sizeof(SectionEntry)) return false;
+
+    for(uint32_t s = 0; s < header.sectionCount; s++) {
+        SectionEntry entry;
+        memcpy(&entry, file.data() + sizeof(Header) + s * sizeof(SectionEntry), sizeof(entry));
+        if(entry.offset % ALIGNMENT != 0 || entry.offset > size || entry.size > size - entry.offset) {
+            return false;
+        }
+    }
+
+    // every required section, at exactly the size the counts imply
+    vertices = size_t(header.vertexCount);
+    triangles = size_t(header.triangleCount);
+    edgeTotal = size_t(header.edgeCount);
+    const std::pair<SectionType, uint64_t> required[] = {
+        { POSITIONS, header.vertexCount * sizeof(glm::vec4) },
+        { NORMALS, header.vertexCount * sizeof(glm::vec4) },
+        { INDICES, header.triangleCount * 3 * sizeof(GLuint) },
+        { EDGES, header.edgeCount * 2 * sizeof(GLuint) },
+        { SHAPES, header.shapeCount * sizeof(ShapeRecord) },
+    };
+    for(const auto& r : required) {
+        size_t bytes;
+        if(!section(r.first, &bytes) || bytes != r.second) return false;
+    }
+    size_t nameBytes;
+    const char* names = section(NAMES, &nameBytes);
+    if(!names) return false;
+
+    const char* records = section(SHAPES);
+    shapeTable.resize(size_t(header.shapeCount));
+    for(size_t s = 0; s < shapeTable.size(); s++) {
+        ShapeRecord record;
+        memcpy(&record, records + s * sizeof(record), sizeof(record));
+        if(record.nameOffset > nameBytes || record.nameLength > nameBytes - record.nameOffset ||
+           record.firstTriangle > triangles || record.triangleCount > triangles - record.firstTriangle) {
+            return false;
+        }
+        shapeTable[s] = { std::string(names + record.nameOffset, size_t(record.nameLength)),
+                          size_t(record.firstTriangle), size_t(record.triangleCount) };
+    }
+
+    // the source must be byte for byte the one the cache was built from
+    FileView source(assetPath);
+    if(!source.ok() || source.size() != header.sourceSize || hash(source.data(), source.size()) != header.sourceHash) {
+        return false;
+    }
+
+    // out-of-range indices would reach the GPU unchecked
+    const GLuint* index = indices();
+    GLuint largest = 0;
+    for(size_t i = 0; i < 3 * triangles; i++) largest = std::max(largest, index[i]);
+    return triangles == 0 || largest < vertices;
+}
+
+bool MeshCache::write(const std::string& assetPath, const ObjData& obj, std::string& error,
+                      const std::vector<Payload>& payloads) {
+    FileView source(assetPath);
+    if(!source.ok()) {
+        error = "can't read '" + assetPath + "'";
+        return false;
+    }
+
+    // each undirected edge once, as (lower, higher)
+    const size_t triangleCount = obj.indices.size() / 3;
+    std::vector<uint64_t> keys(3 * triangleCount);
+    for(size_t t = 0; t < triangleCount; t++) {
+        for(int k = 0; k < 3; k++) {
+            const uint64_t a = obj.indices[3 * t + k], b = obj.indices[3 * t + (k + 1) % 3];
+            keys[3 * t + k] = std::min(a, b) << 32 | std::max(a, b);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    GLuints edges(2 * keys.size());
+    for(size_t e = 0; e < keys.size(); e++) {
+        edges[2 * e] = GLuint(keys[e] >> 32);
+        edges[2 * e + 1] = GLuint(keys[e]);
+    }
+
+    std::vector<ShapeRecord> records;
+    std::string names;
+    for(const ObjShape& shape : obj.shapes) {
+        records.push_back({ shape.firstTriangle, shape.triangleCount, names.size(), shape.name.size() });
+        names += shape.name;
+    }
+
+    std::vector<Payload> sections = {
+        { POSITIONS, obj.positions.data(), obj.positions.size() * sizeof(glm::vec4) },
+        { NORMALS, obj.normals.data(), obj.normals.size() * sizeof(glm::vec4) },
+        { INDICES, obj.indices.data(), obj.indices.size() * sizeof(GLuint) },
+        { EDGES, edges.data(), edges.size() * sizeof(GLuint) },
+        { SHAPES, records.data(), records.size() * sizeof(ShapeRecord) },
+        { NAMES, names.data(), names.size() },
+    };
+    sections.insert(sections.end(), payloads.begin(), payloads.end());
+
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sectionCount = uint32_t(sections.size());
+    header.sourceSize = source.size();
+    header.sourceHash = hash(source.data(), source.size());
+    header.vertexCount = obj.positions.size();
+    header.triangleCount = triangleCount;
+    header.edgeCount = keys.size();
+    header.shapeCount = records.size();
+
+    std::vector<SectionEntry> table(sections.size());
+    size_t offset = alignUp(sizeof(Header) + table.size() * sizeof(SectionEntry));
+    for(size_t s = 0; s < sections.size(); s++) {
+        table[s] = { sections[s].type, 0, offset, sections[s].size };
+        offset = alignUp(offset + sections[s].size);
+    }
+    header.fileSize = offset;
+
+    // written aside and renamed over the old cache, so a reader never maps half a file
+    const std::string path = pathFor(assetPath);
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        const char zeros[ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(SectionEntry)));
+        size_t written = sizeof(header) + table.size() * sizeof(SectionEntry);
+        for(size_t s = 0; s < sections.size(); s++) {
+            out.write(zeros, std::streamsize(table[s].offset - written));
+            out.write(static_cast<const char*>(sections[s].data), std::streamsize(sections[s].size));
+            written = table[s].offset + sections[s].size;
+        }
+        out.write(zeros, std::streamsize(header.fileSize - written));
+        out.close();
+        if(!out) {
+            std::remove(temporary.c_str());
+            error = "can't write '" + temporary + "'";
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        error = "can't replace '" + path + "'";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "core.hpp"
+#include "FileView.hpp"
+#include "ObjLoader.hpp"
+
+#include <memory>
+
+// Binary cache of a parsed OBJ, written next to the asset as
+// <asset>.meshcache. The file is a header, a section table and sections that
+// each start on a 64-byte boundary, so a mapping of the file can be handed to
+// OpenGL and read in place without parsing or copying.
+//
+// The header records the size and a 64-bit hash of the source file's bytes. A
+// cache whose source has changed, or whose version, size or sections don't
+// check out, is rejected and rewritten after the next parse.
+//
+// Sections hold positions and normals (a vec4 per vertex, as in ObjData), the
+// triangle indices, the deduplicated edges (index pairs, lower index first,
+// sorted), and the shape table and names. BVH and SDF are reserved for
+// acceleration payloads; they are optional and stored as opaque bytes.
+
+class MeshCache {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    enum SectionType : uint32_t {
+        POSITIONS = 1,
+        NORMALS,
+        INDICES,
+        EDGES,
+        SHAPES,
+        NAMES,
+        BVH,
+        SDF
+    };
+
+    // an optional section for write()
+    struct Payload {
+        SectionType type;
+        const void* data;
+        size_t size;
+    };
+
+    static std::string pathFor(const std::string& assetPath);
+
+    /// Maps the asset's cache. Returns null if it is missing, stale or malformed.
+    static std::shared_ptr<const MeshCache> open(const std::string& assetPath);
+
+    /// Writes the asset's cache for a parse of it. Returns false and sets error
+    /// if the file can't be written.
+    static bool write(const std::string& assetPath, const ObjData& obj, std::string& error,
+                      const std::vector<Payload>& payloads = {});
+
+    size_t vertexCount() const { return vertices; }
+    size_t triangleCount() const { return triangles; }
+    size_t edgeCount() const { return edgeTotal; }
+
+    const glm::vec4* positions() const { return reinterpret_cast<const glm::vec4*>(section(POSITIONS)); }
+    const glm::vec4* normals() const { return reinterpret_cast<const glm::vec4*>(section(NORMALS)); }
+    const GLuint* indices() const { return reinterpret_cast<const GLuint*>(section(INDICES)); }
+    const GLuint* edges() const { return reinterpret_cast<const GLuint*>(section(EDGES)); }
+    const std::vector<ObjShape>& shapes() const { return shapeTable; }
+
+    /// A section's bytes, or null if the cache has none of that type.
+    const char* section(SectionType type, size_t* size = nullptr) const;
+
+    /// 64-bit hash of a byte range, as stored for the source file.
+    static uint64_t hash(const char* data, size_t size);
+
+private:
+    explicit MeshCache(const std::string& path) : file(path) {}
+
+    FileView file;
+    size_t vertices = 0, triangles = 0, edgeTotal = 0;
+    std::vector<ObjShape> shapeTable;
+
+    bool validate(const std::string& assetPath);
+};
@@ -0,0 +1,267 @@
+#include "ObjLoader.hpp"
+#include "FileView.hpp"
+#include "ThreadPool.hpp"
+#include "Tokenizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+
+namespace {
+    // more chunks than threads, so uneven chunks still balance
+    constexpr int CHUNKS_PER_THREAD = 4;
+
+    enum LineKind { LINE_OTHER, LINE_POSITION, LINE_NORMAL, LINE_FACE, LINE_SHAPE };
+
+    bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+    const char* skipBlank(const char* p, const char* end) {
+        while(p < end && isBlank(*p)) p++;
+        return p;
+    }
+
+    const char* skipWord(const char* p, const char* end) {
+        while(p < end && !isBlank(*p) && *p != '\r' && *p != '\n') p++;
+        return p;
+    }
+
+    // classifies the line at p; rest is set past the keyword
+    LineKind kindOf(const char* p, const char* end, const char*& rest) {
+        p = skipBlank(p, end);
+        if(end - p < 2) return LINE_OTHER;
+        if(p[0] == 'v' && isBlank(p[1]))                                   { rest = p + 2; return LINE_POSITION; }
+        if(p[0] == 'v' && p[1] == 'n' && end - p > 2 && isBlank(p[2]))     { rest = p + 3; return LINE_NORMAL; }
+        if(p[0] == 'f' && isBlank(p[1]))                                   { rest = p + 2; return LINE_FACE; }
+        if((p[0] == 'o' || p[0] == 'g') && isBlank(p[1]))                  { rest = p + 2; return LINE_SHAPE; }
+        return LINE_OTHER;
+    }
+
+    bool parseFloat(const char*& p, const char* end, float& value) {
+        p = skipBlank(p, end);
+        if(p < end && *p == '+') p++;   // from_chars takes no leading '+'
+        const std::from_chars_result r = ParseFloat(p, end, value);
+        if(r.ec != std::errc()) return false;
+        p = r.ptr;
+        return true;
+    }
+
+    // one face corner, v[/[vt][/vn]], as raw OBJ indices (0 = absent)
+    bool parseCorner(const char*& p, const char* end, long& position, long& normal) {
+        std::from_chars_result r = std::from_chars(p, end, position);
+        if(r.ec != std::errc() || position == 0) return false;
+        p = r.ptr;
+        normal = 0;
+        if(p < end && *p == '/') {
+            p++;
+            long texcoord;
+            if(p < end && *p != '/') {
+                r = std::from_chars(p, end, texcoord);
+                if(r.ec != std::errc()) return false;
+                p = r.ptr;
+            }
+            if(p < end && *p == '/') {
+                p++;
+                r = std::from_chars(p, end, normal);
+                if(r.ec != std::errc() || normal == 0) return false;
+                p = r.ptr;
+            }
+        }
+        return p == end || isBlank(*p) || *p == '\r' || *p == '\n';
+    }
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t positions = 0, normals = 0, triangles = 0;            // counted by pass 1
+        size_t firstPosition = 0, firstNormal = 0, firstTriangle = 0; // prefix sums
+        std::vector<std::pair<size_t, std::string>> shapeStarts;      // (triangle in chunk, name)
+        std::string error;
+    };
+
+    void countChunk(Chunk& chunk) {
+        for(const char* line = chunk.begin; line < chunk.end;) {
+            const char* eol = static_cast<const char*>(memchr(line, '\n', size_t(chunk.end - line)));
+            if(!eol) eol = chunk.end;
+            const char* p;
+            switch(kindOf(line, eol, p)) {
+                case LINE_POSITION: chunk.positions++; break;
+                case LINE_NORMAL:   chunk.normals++; break;
+                case LINE_FACE: {
+                    int corners = 0;
+                    for(p = skipBlank(p, eol); p < eol && *p != '\r'; p = skipBlank(skipWord(p, eol), eol)) corners++;
+                    chunk.triangles += size_t(std::max(corners - 2, 0));
+                    break;
+                }
+                default: break;
+            }
+            line = eol + 1;
+        }
+    }
+
+    void parseChunk(Chunk& chunk, ObjData& obj, std::vector<glm::vec4>& rawNormals, std::vector<int>& cornerNormals) {
+        size_t positions = chunk.firstPosition, normals = chunk.firstNormal, triangle = chunk.firstTriangle;
+        std::vector<long> cornerPosition, cornerNormal;
+        for(const char* line = chunk.begin; line < chunk.end && chunk.error.empty();) {
+            const char* eol = static_cast<const char*>(memchr(line, '\n', size_t(chunk.end - line)));
+            if(!eol) eol = chunk.end;
+            const char* p;
+            switch(kindOf(line, eol, p)) {
+                case LINE_POSITION: {
+                    float x, y, z;
+                    if(!parseFloat(p, eol, x) || !parseFloat(p, eol, y) || !parseFloat(p, eol, z)) {
+                        chunk.error = "bad vertex position";
+                        break;
+                    }
+                    obj.positions[positions++] = glm::vec4(x, y, z, 1);
+                    break;
+                }
+                case LINE_NORMAL: {
+                    float x, y, z;
+                    if(!parseFloat(p, eol, x) || !parseFloat(p, eol, y) || !parseFloat(p, eol, z)) {
+                        chunk.error = "bad vertex normal";
+                        break;
+                    }
+                    rawNormals[normals++] = glm::vec4(x, y, z, 0);
+                    break;
+                }
+                case LINE_FACE: {
+                    cornerPosition.clear();
+                    cornerNormal.clear();
+                    for(p = skipBlank(p, eol); p < eol && *p != '\r'; p = skipBlank(p, eol)) {
+                        long v, vn;
+                        if(!parseCorner(p, eol, v, vn)) {
+                            chunk.error = "bad face corner";
+                            break;
+                        }
+                        // relative indices count back from what precedes this line
+                        cornerPosition.push_back(v > 0 ? v - 1 : long(positions) + v);
+                        cornerNormal.push_back(vn > 0 ? vn - 1 : vn < 0 ? long(normals) + vn : -1);
+                    }
+                    // fan triangulation
+                    for(size_t k = 1; k + 1 < cornerPosition.size(); k++) {
+                        const size_t corner[3] = { 0, k, k + 1 };
+                        for(int j = 0; j < 3; j++) {
+                            obj.indices[3 * triangle + j] = GLuint(cornerPosition[corner[j]]);
+                            cornerNormals[3 * triangle + j] = int(cornerNormal[corner[j]]);
+                        }
+                        triangle++;
+                    }
+                    break;
+                }
+                case LINE_SHAPE: {
+                    const char* name = skipBlank(p, eol);
+                    const char* nameEnd = eol;
+                    while(nameEnd > name && (isBlank(nameEnd[-1]) || nameEnd[-1] == '\r')) nameEnd--;
+                    chunk.shapeStarts.emplace_back(triangle - chunk.firstTriangle, std::string(name, nameEnd));
+                    break;
+                }
+                default: break;
+            }
+            line = eol + 1;
+        }
+    }
+}
+
+bool loadObj(const std::string& filepath, ObjData& obj, std::string& error) {
+    FileView file(filepath);
+    if(!file.ok()) {
+        error = "can't open '" + filepath + "'";
+        return false;
+    }
+    const char* data = file.data();
+    const char* end = data + file.size();
+
+    // chunks of roughly equal size, each ending on a line boundary
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t target = std::max<size_t>(file.size() / (pool.concurrency() * CHUNKS_PER_THREAD), 1 << 16);
+    std::vector<Chunk> chunks;
+    for(const char* begin = data; begin < end;) {
+        const char* cut = begin + std::min(target, size_t(end - begin));
+        const char* eol = cut < end ? static_cast<const char*>(memchr(cut, '\n', size_t(end - cut))) : nullptr;
+        cut = eol ? eol + 1 : end;
+        chunks.push_back(Chunk());
+        chunks.back().begin = begin;
+        chunks.back().end = cut;
+        begin = cut;
+    }
+    const int numChunks = int(chunks.size());
+
+    pool.parallelFor(0, numChunks, [&](int c0, int c1) {
+        for(int c = c0; c < c1; c++) countChunk(chunks[c]);
+    });
+
+    size_t positions = 0, normals = 0, triangles = 0;
+    for(Chunk& chunk : chunks) {
+        chunk.firstPosition = positions;
+        chunk.firstNormal = normals;
+        chunk.firstTriangle = triangles;
+        positions += chunk.positions;
+        normals += chunk.normals;
+        triangles += chunk.triangles;
+    }
+
+    obj.positions.resize(positions);
+    obj.indices.resize(3 * triangles);
+    std::vector<glm::vec4> rawNormals(normals);
+    std::vector<int> cornerNormals(3 * triangles);
+    pool.parallelFor(0, numChunks, [&](int c0, int c1) {
+        for(int c = c0; c < c1; c++) parseChunk(chunks[c], obj, rawNormals, cornerNormals);
+    });
+    for(const Chunk& chunk : chunks) {
+        if(!chunk.error.empty()) {
+            error = chunk.error + " in '" + filepath + "'";
+            return false;
+        }
+    }
+
+    // every index must land in the arrays; relative ones may have run off the front
+    std::atomic<bool> inRange(true);
+    pool.parallelFor(0, int(triangles), [&](int t0, int t1) {
+        for(size_t c = 3 * size_t(t0); c < 3 * size_t(t1); c++) {
+            if(obj.indices[c] >= positions || cornerNormals[c] >= int(normals) || cornerNormals[c] < -1) {
+                inRange = false;
+                return;
+            }
+        }
+    });
+    if(!inRange) {
+        error = "face index out of range in '" + filepath + "'";
+        return false;
+    }
+
+    // a vertex takes the normal of the last corner that uses it
+    std::vector<std::atomic<uint32_t>> lastCorner(positions);
+    pool.parallelFor(0, int(positions), [&](int v0, int v1) {
+        for(int v = v0; v < v1; v++) lastCorner[v].store(0, std::memory_order_relaxed);
+    });
+    pool.parallelFor(0, int(triangles), [&](int t0, int t1) {
+        for(uint32_t c = 3 * uint32_t(t0); c < 3 * uint32_t(t1); c++) {
+            std::atomic<uint32_t>& last = lastCorner[obj.indices[c]];
+            uint32_t seen = last.load(std::memory_order_relaxed);
+            while(seen < c + 1 && !last.compare_exchange_weak(seen, c + 1, std::memory_order_relaxed)) {}
+        }
+    });
+    obj.normals.resize(positions);
+    pool.parallelFor(0, int(positions), [&](int v0, int v1) {
+        for(int v = v0; v < v1; v++) {
+            const uint32_t c = lastCorner[v].load(std::memory_order_relaxed);
+            obj.normals[v] = c > 0 && cornerNormals[c - 1] >= 0 ? rawNormals[cornerNormals[c - 1]] : glm::vec4(0);
+        }
+    });
+
+    // shapes in file order; faces before the first 'o' or 'g' form their own
+    obj.shapes.clear();
+    ObjShape shape = { "default", 0, 0 };
+    for(const Chunk& chunk : chunks) {
+        for(const auto& start : chunk.shapeStarts) {
+            const size_t first = chunk.firstTriangle + start.first;
+            shape.triangleCount = first - shape.firstTriangle;
+            if(shape.triangleCount > 0) obj.shapes.push_back(shape);
+            shape = { start.second.empty() ? std::string("default") : start.second, first, 0 };
+        }
+    }
+    shape.triangleCount = triangles - shape.firstTriangle;
+    if(shape.triangleCount > 0) obj.shapes.push_back(shape);
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "core.hpp"
+
+// Multithreaded OBJ loader for large triangle meshes. The file is mapped and
+// split into chunks at line boundaries. A first parallel pass counts the
+// positions, normals and triangles of every chunk; prefix sums over those
+// counts give each chunk its place in the output, and a second parallel pass
+// parses straight into the flat arrays. Relative (negative) indices resolve
+// against the chunk's offset, so no chunk waits for another.
+//
+// Polygons are fan triangulated. As with tinyobjloader + Mesh, every 'o' or
+// 'g' starts a new shape and all shapes index the same positions. A vertex
+// takes the normal of the last face corner in the file that uses it (zero if
+// that corner names none); unlike tinyobjloader + Mesh, this is shared by all
+// shapes, so positions a shape does not use may still carry a normal.
+// Texture coordinates are skipped.
+
+struct ObjShape {
+    std::string name;
+    size_t firstTriangle;
+    size_t triangleCount;
+};
+
+struct ObjData {
+    vec4s positions;   // w = 1
+    vec4s normals;     // per position, w = 0
+    GLuints indices;   // 3 per triangle, all shapes back to back
+    std::vector<ObjShape> shapes;   // only shapes with triangles
+};
+
+/// Returns false and sets error if the file can't be read or is malformed.
+bool loadObj(const std::string& filepath, ObjData& obj, std::string& error);
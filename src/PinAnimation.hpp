@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <glm/gtc/quaternion.hpp>
+
+// A PinCurve drives a set of pinned particles. It is evaluated once per step
+// and the resulting matrix is applied to every pin bound to it.
+
+class PinCurve {
+public:
+    virtual ~PinCurve() {}
+    virtual glm::mat4 evaluate(float time) = 0;
+};
+
+struct PinKeyframe {
+    float     time;
+    glm::vec3 translation;
+    glm::quat rotation;
+
+    PinKeyframe(float t, const glm::vec3& translation, const glm::quat& rotation = glm::quat(1, 0, 0, 0))
+        : time(t), translation(translation), rotation(rotation) {}
+};
+
+// Piecewise linear translation + slerped rotation between keyframes.
+class KeyframePinCurve : public PinCurve {
+public:
+    std::vector<PinKeyframe> keys;
+    bool loop;
+
+    explicit KeyframePinCurve(bool loop = false) : loop(loop), segment(0) {}
+
+    void addKey(const PinKeyframe& key) {
+        auto it = std::upper_bound(keys.begin(), keys.end(), key.time,
+                                   [](float t, const PinKeyframe& k) { return t < k.time; });
+        keys.insert(it, key);
+        segment = 0;
+    }
+
+    glm::mat4 evaluate(float time) override {
+        if (keys.empty()) return glm::mat4(1);
+        if (keys.size() == 1 || time <= keys.front().time) return toMatrix(keys.front());
+
+        float duration = keys.back().time - keys.front().time;
+        if (loop && duration > 0.0f)
+            time = keys.front().time + std::fmod(time - keys.front().time, duration);
+        if (time >= keys.back().time) return toMatrix(keys.back());
+
+        // time advances monotonically, so start the search at the last segment
+        if (segment >= keys.size() - 1 || keys[segment].time > time) segment = 0;
+        while (keys[segment + 1].time < time) segment++;
+
+        const PinKeyframe& k0 = keys[segment];
+        const PinKeyframe& k1 = keys[segment + 1];
+        float a = (time - k0.time) / (k1.time - k0.time);
+        glm::mat4 m = glm::mat4_cast(glm::slerp(k0.rotation, k1.rotation, a));
+        m[3] = glm::vec4(glm::mix(k0.translation, k1.translation, a), 1);
+        return m;
+    }
+
+private:
+    size_t segment;
+
+    static glm::mat4 toMatrix(const PinKeyframe& k) {
+        glm::mat4 m = glm::mat4_cast(k.rotation);
+        m[3] = glm::vec4(k.translation, 1);
+        return m;
+    }
+};
+
+// Arbitrary function of time, e.g. [](float t) { return glm::translate(glm::vec3(0, sin(t), 0)); }
+class ProceduralPinCurve : public PinCurve {
+public:
+    std::function<glm::mat4(float)> curve;
+
+    explicit ProceduralPinCurve(std::function<glm::mat4(float)> curve) : curve(std::move(curve)) {}
+
+    glm::mat4 evaluate(float time) override { return curve(time); }
+};
@@ -0,0 +1,516 @@
+#include "Remesher.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+    // corner k of a triangle, k taken mod 3
+    Particle*& corner(Triangle* t, int k) {
+        k %= 3;
+        return k == 0 ? t->p1 : k == 1 ? t->p2 : t->p3;
+    }
+
+    Particle*& cornerRef(Triangle* t, const Particle* p) {
+        return t->p1 == p ? t->p1 : t->p2 == p ? t->p2 : t->p3;
+    }
+
+    bool hasCorners(const Triangle* t, const Particle* a, const Particle* b, const Particle* c) {
+        auto has = [t](const Particle* p) { return t->p1 == p || t->p2 == p || t->p3 == p; };
+        return has(a) && has(b) && has(c);
+    }
+
+    bool connects(const SpringDamper* s, const Particle* a, const Particle* b) {
+        return (s->p1 == a && s->p2 == b) || (s->p1 == b && s->p2 == a);
+    }
+
+    uint64_t edgeKey(GLuint a, GLuint b) {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    glm::vec3 faceNormal(const Triangle* t) {
+        const glm::vec3 n = glm::cross(t->p2->position - t->p1->position, t->p3->position - t->p1->position);
+        const float length = glm::length(n);
+        return length > 1e-12f ? n / length : glm::vec3(0);
+    }
+
+    // angle between the normals of two triangles sharing an edge; 0 when flat
+    float foldAngle(const Triangle* x, const Triangle* y) {
+        return std::acos(glm::clamp(glm::dot(faceNormal(x), faceNormal(y)), -1.0f, 1.0f));
+    }
+
+    // a split may leave no angle under ~17 degrees in the rest pose; splitting a
+    // grid triangle across either edge stays above it
+    constexpr float MIN_SPLIT_SINE = 0.3f;
+
+    // relative speed of two particles per unit distance between them
+    float spreadRate(const Particle* a, const Particle* b) {
+        const float distance = glm::length(b->position - a->position);
+        return glm::length(b->velocity - a->velocity) / std::max(distance, 1e-6f);
+    }
+}
+
+Remesher::Remesher() {
+    interval = DEFAULT_REMESH_INTERVAL;
+    refineAngle = DEFAULT_REFINE_ANGLE;
+    refineRate = 8.0f;
+    coarsenFactor = 0.5f;
+    maxParticles = 0;
+    minMass = 0.0f;
+    maxSubsteps = 4;
+    updatesSinceRemesh = 0;
+    indexCapacity = 0;
+    baseRatio = 0.0f;
+}
+
+void Remesher::build(const Cloth& cloth) {
+    splits.clear();
+    updatesSinceRemesh = 0;
+    indexCapacity = cloth.triangles.size();
+
+    // by default the mesh may double, and a particle may lose three quarters of its mass
+    maxParticles = 2 * cloth.particles.size();
+    float lightest = INFINITY;
+    for(const Particle* p : cloth.particles) {
+        lightest = std::min(lightest, p->mass);
+    }
+    minMass = 0.25f * lightest;
+    dead.clear();
+    baseRatio = sumStiffness(cloth);
+}
+
+int Remesher::run(Cloth& cloth) {
+    if(++updatesSinceRemesh < interval) return 0;
+    updatesSinceRemesh = 0;
+
+    touched.clear();
+    dead.clear();
+    const size_t uploaded = cloth.triangles.size();
+
+    collectEdges(cloth);
+    const int collapsed = coarsen(cloth);
+    const int refined = refine(cloth);
+    if(collapsed + refined == 0) return 0;
+
+    std::vector<unsigned char> renumbered;
+    if(collapsed > 0) {
+        compact(cloth, renumbered);
+    }
+    patchIndexBuffer(cloth, uploaded, renumbered);
+
+    cloth.buildPasses();
+    cloth.tearing.reset();
+
+    // the explicit step limit goes with sqrt(k / m); a mesh built without stiff
+    // springs has no limit to scale
+    const float ratio = sumStiffness(cloth);
+    const int substeps = baseRatio > 0.0f
+        ? glm::clamp(int(std::ceil(std::sqrt(ratio / baseRatio) - 1e-3f)), 1, maxSubsteps)
+        : 1;
+    if(substeps != cloth.substeps) {
+        // Verlet carries velocity as the last step's displacement, which has to
+        // be rescaled to the new step length
+        const float scale = float(cloth.substeps) / substeps;
+        for(Particle* p : cloth.particles) {
+            p->position_prev = p->position - scale * (p->position - p->position_prev);
+        }
+        cloth.substeps = substeps;
+    }
+    return collapsed + refined;
+}
+
+float Remesher::sumStiffness(const Cloth& cloth) {
+    stiffness.assign(cloth.particles.size(), 0.0f);
+    for(const SpringDamper* s : cloth.springDampers) {
+        if(dead.count(s)) continue;
+        stiffness[s->p1->particleID] += s->springConstant;
+        stiffness[s->p2->particleID] += s->springConstant;
+    }
+    float ratio = 0.0f;
+    for(const Particle* p : cloth.particles) {
+        ratio = std::max(ratio, stiffness[p->particleID] / p->mass);
+    }
+    return ratio;
+}
+
+void Remesher::collectEdges(const Cloth& cloth) {
+    edges.clear();
+    valence.assign(cloth.particles.size(), 0);
+    for(size_t t = 0; t < cloth.triangles.size(); t++) {
+        Triangle* tri = cloth.triangles[t];
+        for(int k = 0; k < 3; k++) {
+            const GLuint a = corner(tri, k)->particleID, b = corner(tri, k + 1)->particleID;
+            edges.push_back({ edgeKey(a, b), GLuint(t), k });
+            valence[a]++;
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const EdgeRef& x, const EdgeRef& y) { return x.key < y.key; });
+}
+
+int Remesher::coarsen(Cloth& cloth) {
+    const float angle = coarsenFactor * refineAngle;
+    const float rate = coarsenFactor * refineRate;
+
+    // a split is undone only while nothing else has edited its triangles and
+    // springs since: no later split, tear or collapse next to it
+    auto intact = [&](const Split& s) {
+        if(valence[s.m->particleID] != (s.d ? 4u : 2u)) return false;
+        if(std::find(cloth.pinnedIndices.begin(), cloth.pinnedIndices.end(), s.m->particleID) != cloth.pinnedIndices.end()) return false;
+        if(!hasCorners(s.t1, s.a, s.m, s.c) || !hasCorners(s.n1, s.m, s.b, s.c)) return false;
+        if(touched.count(s.t1) || touched.count(s.n1)) return false;
+        if(!connects(s.ab, s.a, s.m) || !connects(s.mb, s.m, s.b) || !connects(s.mc, s.m, s.c)) return false;
+        if(s.ab->springConstant == 0.0f || s.mb->springConstant == 0.0f || s.mc->springConstant == 0.0f) return false;
+        if(s.d) {
+            if(!hasCorners(s.t2, s.m, s.a, s.d) || !hasCorners(s.n2, s.b, s.m, s.d)) return false;
+            if(touched.count(s.t2) || touched.count(s.n2)) return false;
+            if(!connects(s.md, s.m, s.d) || s.md->springConstant == 0.0f) return false;
+        }
+        return true;
+    };
+
+    auto flat = [&](const Split& s) {
+        if(foldAngle(s.t1, s.n1) > angle) return false;
+        if(s.d && (foldAngle(s.t2, s.n2) > angle || foldAngle(s.t1, s.t2) > angle || foldAngle(s.n1, s.n2) > angle)) return false;
+        for(const Particle* q : { s.a, s.b, s.c, s.d }) {
+            if(q && spreadRate(s.m, q) > rate) return false;
+        }
+        return true;
+    };
+
+    int collapsed = 0;
+    for(size_t r = 0; r < splits.size();) {
+        if(intact(splits[r]) && flat(splits[r])) {
+            collapse(splits[r]);
+            splits[r] = splits.back();
+            splits.pop_back();
+            collapsed++;
+            continue;
+        }
+        r++;
+    }
+    return collapsed;
+}
+
+int Remesher::refine(Cloth& cloth) {
+    sumStiffness(cloth);
+    std::unordered_map<uint64_t, SpringDamper*> springOf;
+    springOf.reserve(cloth.springDampers.size());
+    for(SpringDamper* s : cloth.springDampers) {
+        if(s->springConstant > 0.0f) springOf[edgeKey(s->p1->particleID, s->p2->particleID)] = s;
+    }
+
+    // score the edges; an edge seen from two triangles is interior, from more
+    // than two it is left alone
+    std::vector<size_t> groupOf(3 * cloth.triangles.size());   // 3 * triangle + slot -> first edge ref
+    std::vector<float> score(edges.size(), 0.0f);
+    std::vector<unsigned char> fold(edges.size(), 0);   // scored by its fold rather than its spread
+    for(size_t i = 0; i < edges.size();) {
+        size_t j = i + 1;
+        while(j < edges.size() && edges[j].key == edges[i].key) j++;
+        for(size_t r = i; r < j; r++) {
+            groupOf[3 * edges[r].triangle + edges[r].slot] = i;
+        }
+        if(j - i <= 2) {
+            Triangle* t1 = cloth.triangles[edges[i].triangle];
+            score[i] = spreadRate(corner(t1, edges[i].slot), corner(t1, edges[i].slot + 1)) / refineRate;
+            if(j - i == 2) {
+                const float folded = foldAngle(t1, cloth.triangles[edges[i + 1].triangle]) / refineAngle;
+                fold[i] = folded > score[i];
+                score[i] = std::max(score[i], folded);
+            }
+        }
+        i = j;
+    }
+
+    // anisotropic targets, all measured on the rest pose: a fold is resolved by
+    // splitting the edges that cross it, which adds particles across the fold
+    // but not along it, and a fast-spreading edge by splitting that edge, along
+    // the direction the velocity changes. A target whose halves would be too
+    // thin goes to the longest edge of its triangle instead, which splits into
+    // the best shaped halves.
+    auto rest = [&](Triangle* t, int k) { return cloth.restPositions[corner(t, k)->particleID]; };
+    auto restLengthSq = [&](Triangle* t, int k) {
+        const glm::vec3 e = rest(t, k + 1) - rest(t, k);
+        return glm::dot(e, e);
+    };
+    auto longest = [&](Triangle* t) {
+        int slot = 0;
+        for(int k = 1; k < 3; k++) {
+            if(restLengthSq(t, k) > restLengthSq(t, slot)) slot = k;
+        }
+        return slot;
+    };
+    // smallest sine of any angle in the two halves of t split at edge k
+    auto splitQuality = [&](Triangle* t, int k) {
+        const glm::vec3 a = rest(t, k), b = rest(t, k + 1), o = rest(t, k + 2);
+        const glm::vec3 m = 0.5f * (a + b);
+        float quality = 1.0f;
+        const glm::vec3 halves[2][3] = { { a, m, o }, { m, b, o } };
+        for(const auto& h : halves) {
+            for(int v = 0; v < 3; v++) {
+                const glm::vec3 u = h[(v + 1) % 3] - h[v], w = h[(v + 2) % 3] - h[v];
+                const float lengths = std::sqrt(glm::dot(u, u) * glm::dot(w, w));
+                quality = std::min(quality, lengths > 0.0f ? glm::length(glm::cross(u, w)) / lengths : 0.0f);
+            }
+        }
+        return quality;
+    };
+    // the edge of t that reaches furthest across edge k, ties to the longer one
+    auto across = [&](Triangle* t, int k) {
+        const glm::vec3 line = glm::normalize(rest(t, k + 1) - rest(t, k));
+        int best = (k + 1) % 3;
+        float bestExtent = -1.0f;
+        for(int slot : { (k + 1) % 3, (k + 2) % 3 }) {
+            const float extent = glm::length(glm::cross(rest(t, slot + 1) - rest(t, slot), line));
+            if(extent > 1.001f * bestExtent || (extent > 0.999f * bestExtent && restLengthSq(t, slot) > restLengthSq(t, best))) {
+                best = slot;
+                bestExtent = std::max(extent, bestExtent);
+            }
+        }
+        return best;
+    };
+    std::vector<float> target(edges.size(), 0.0f);
+    for(size_t r = 0; r < edges.size(); r++) {
+        const size_t i = groupOf[3 * edges[r].triangle + edges[r].slot];
+        if(score[i] <= 1.0f) continue;
+        const GLuint t = edges[r].triangle;
+        Triangle* tri = cloth.triangles[t];
+        int slot = fold[i] ? across(tri, edges[r].slot) : edges[r].slot;
+        if(splitQuality(tri, slot) < MIN_SPLIT_SINE) slot = longest(tri);
+        const size_t g = groupOf[3 * t + slot];
+        target[g] = std::max(target[g], score[i]);
+    }
+
+    struct Candidate {
+        float score;
+        size_t edge;
+        bool interior;
+        SpringDamper* spring;
+    };
+    std::vector<Candidate> candidates;
+    for(size_t i = 0; i < edges.size();) {
+        size_t j = i + 1;
+        while(j < edges.size() && edges[j].key == edges[i].key) j++;
+
+        // split only where both halves stay well shaped on every side
+        bool eligible = target[i] > 1.0f && j - i <= 2;
+        for(size_t r = i; r < j && eligible; r++) {
+            eligible = splitQuality(cloth.triangles[edges[r].triangle], edges[r].slot) >= MIN_SPLIT_SINE;
+        }
+        auto spring = springOf.find(edges[i].key);
+        if(eligible && spring != springOf.end()) {
+            candidates.push_back({ target[i], i, j - i == 2, spring->second });
+        }
+        i = j;
+    }
+
+    // the budget goes to the worst edges first
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& x, const Candidate& y) { return x.score > y.score; });
+    int refined = 0;
+    for(const Candidate& c : candidates) {
+        if(cloth.particles.size() >= maxParticles) break;
+        refined += split(cloth, edges[c.edge], c.interior ? &edges[c.edge + 1] : nullptr, c.spring);
+    }
+    return refined;
+}
+
+bool Remesher::split(Cloth& cloth, const EdgeRef& e1, const EdgeRef* e2, SpringDamper* spring) {
+    // one edit per triangle and remesh, so every edge ref read here is current
+    Triangle* t1 = cloth.triangles[e1.triangle];
+    Triangle* t2 = e2 ? cloth.triangles[e2->triangle] : nullptr;
+    if(touched.count(t1) || (t2 && touched.count(t2))) return false;
+
+    Particle* a = corner(t1, e1.slot);
+    Particle* b = corner(t1, e1.slot + 1);
+    Particle* c = corner(t1, e1.slot + 2);
+    Particle* d = nullptr;
+    if(t2) {
+        // the two sides must agree on the winding (a tear can flip one)
+        if(corner(t2, e2->slot) != b || corner(t2, e2->slot + 1) != a) return false;
+        d = corner(t2, e2->slot + 2);
+    }
+
+    const float shareA = 0.25f * a->mass, shareB = 0.25f * b->mass;
+    const float mass = shareA + shareB;
+    if(a->mass - shareA < minMass || b->mass - shareB < minMass || mass < minMass) return false;
+
+    // every particle the split touches must stay within maxSubsteps; a and b
+    // get the stiffer halves, c and d a spring each, and the midpoint all of them
+    const float k = spring->springConstant;
+    const float limit = baseRatio * maxSubsteps * maxSubsteps;
+    auto fits = [&](const Particle* p, float mass) { return stiffness[p->particleID] + k <= limit * mass; };
+    if(!fits(a, a->mass - shareA) || !fits(b, b->mass - shareB) || !fits(c, c->mass) || (d && !fits(d, d->mass))) return false;
+    if((d ? 6.0f : 5.0f) * k > limit * mass) return false;
+    stiffness[a->particleID] += k;
+    stiffness[b->particleID] += k;
+    stiffness[c->particleID] += k;
+    if(d) stiffness[d->particleID] += k;
+    stiffness.push_back((d ? 6.0f : 5.0f) * k);
+
+    // the midpoint takes its mass from both ends along with the matching momentum,
+    // which is carried by velocity and, for Verlet, by position - position_prev
+    const GLuint id = GLuint(cloth.particles.size());
+    Particle* m = cloth.arena.create<Particle>((shareA * a->position + shareB * b->position) / mass, mass, id);
+    m->position_prev = (shareA * a->position_prev + shareB * b->position_prev) / mass;
+    m->velocity = (shareA * a->velocity + shareB * b->velocity) / mass;
+    m->normal = a->normal;
+    a->mass -= shareA;
+    b->mass -= shareB;
+    cloth.particles.push_back(m);
+    const glm::vec3 restA = cloth.restPositions[a->particleID], restB = cloth.restPositions[b->particleID];
+    cloth.restPositions.push_back(0.5f * (restA + restB));
+
+    // (a, b, c) -> (a, m, c) + (m, b, c), and (b, a, d) -> (m, a, d) + (b, m, d),
+    // keeping the winding
+    corner(t1, e1.slot + 1) = m;
+    Triangle* n1 = cloth.arena.create<Triangle>(m, b, c);
+    cloth.triangles.push_back(n1);
+    touched.insert({ t1, n1 });
+    Triangle* n2 = nullptr;
+    if(t2) {
+        corner(t2, e2->slot) = m;
+        n2 = cloth.arena.create<Triangle>(b, m, d);
+        cloth.triangles.push_back(n2);
+        touched.insert({ t2, n2 });
+    }
+
+    // each half of the edge is twice as stiff, so the edge as a whole is not
+    // softened; the springs across take the material distance as rest length
+    auto makeSpring = [&](Particle* p, Particle* q, float springConstant, float restLength) {
+        SpringDamper* s = cloth.arena.create<SpringDamper>(p, q, false);
+        s->springConstant = springConstant;
+        s->dampingConstant = spring->dampingConstant;
+        s->restLength = restLength;
+        cloth.springDampers.push_back(s);
+        return s;
+    };
+    const float restLength = spring->restLength;
+    const glm::vec3 restM = cloth.restPositions[id];
+    (spring->p1 == b ? spring->p1 : spring->p2) = m;
+    spring->springConstant = 2.0f * k;
+    spring->restLength = 0.5f * restLength;
+    SpringDamper* mb = makeSpring(m, b, 2.0f * k, 0.5f * restLength);
+    SpringDamper* mc = makeSpring(m, c, k, glm::length(cloth.restPositions[c->particleID] - restM));
+    SpringDamper* md = d ? makeSpring(m, d, k, glm::length(cloth.restPositions[d->particleID] - restM)) : nullptr;
+
+    splits.push_back({ m, a, b, c, d, t1, t2, n1, n2, spring, mb, mc, md, shareA, shareB, k, restLength });
+    return true;
+}
+
+void Remesher::collapse(const Split& s) {
+    // the ends take back the midpoint's mass with its share of the momentum
+    Particle* m = s.m;
+    auto giveBack = [m](Particle* p, float share) {
+        const float mass = p->mass + share;
+        const glm::vec3 step = (p->mass * (p->position - p->position_prev) + share * (m->position - m->position_prev)) / mass;
+        p->velocity = (p->mass * p->velocity + share * m->velocity) / mass;
+        p->position_prev = p->position - step;
+        p->mass = mass;
+    };
+    giveBack(s.a, s.shareA);
+    giveBack(s.b, s.shareB);
+
+    cornerRef(s.t1, m) = s.b;
+    (s.ab->p1 == m ? s.ab->p1 : s.ab->p2) = s.b;
+    s.ab->springConstant = s.stiffness;
+    s.ab->restLength = s.restLength;
+    dead.insert({ m, s.n1, s.mb, s.mc });
+    touched.insert({ s.t1, s.n1 });
+    if(s.d) {
+        cornerRef(s.t2, m) = s.b;
+        dead.insert({ s.n2, s.md });
+        touched.insert({ s.t2, s.n2 });
+    }
+}
+
+void Remesher::compact(Cloth& cloth, std::vector<unsigned char>& renumbered) {
+    // swap-and-pop removal; scanning from the back means whatever fills a hole
+    // has already been checked. Springs on a removed particle (a tear twin) go too
+    auto removed = [&](const Particle* p) { return dead.count(p) != 0; };
+    std::vector<SpringDamper*>& springs = cloth.springDampers;
+    for(size_t i = springs.size(); i-- > 0;) {
+        if(dead.count(springs[i]) || removed(springs[i]->p1) || removed(springs[i]->p2)) {
+            springs[i] = springs.back();
+            springs.pop_back();
+        }
+    }
+
+    std::vector<Triangle*>& triangles = cloth.triangles;
+    for(size_t i = triangles.size(); i-- > 0;) {
+        if(dead.count(triangles[i])) {
+            triangles[i] = triangles.back();
+            triangles.pop_back();
+            if(i < triangles.size()) touched.insert(triangles[i]);
+        }
+    }
+
+    // particles keep particleID == index; the one moved into a hole takes the
+    // hole's ID, its rest position and any pin on it along
+    std::vector<Particle*>& particles = cloth.particles;
+    renumbered.assign(particles.size(), 0);
+    for(size_t i = particles.size(); i-- > 0;) {
+        if(!removed(particles[i])) continue;
+        Particle* last = particles.back();
+        const GLuint from = last->particleID;
+        particles[i] = last;
+        last->particleID = GLuint(i);
+        cloth.restPositions[i] = cloth.restPositions[from];
+        particles.pop_back();
+        cloth.restPositions.pop_back();
+        std::replace(cloth.pinnedIndices.begin(), cloth.pinnedIndices.end(), from, GLuint(i));
+        renumbered[i] = 1;
+    }
+    renumbered.resize(particles.size());
+}
+
+void Remesher::patchIndexBuffer(Cloth& cloth, size_t uploaded, const std::vector<unsigned char>& renumbered) {
+    const std::vector<Triangle*>& triangles = cloth.triangles;
+    if(cloth.headless) {
+        cloth.indexCount = GLsizei(3 * triangles.size());
+        return;
+    }
+    auto moved = [&](const Triangle* t) {
+        return !renumbered.empty() &&
+               (renumbered[t->p1->particleID] || renumbered[t->p2->particleID] || renumbered[t->p3->particleID]);
+    };
+    auto changed = [&](size_t t) {
+        return t >= uploaded || touched.count(triangles[t]) || moved(triangles[t]);
+    };
+
+    std::vector<GLuint> indices;
+    auto gather = [&](size_t begin, size_t end) {
+        indices.clear();
+        for(size_t t = begin; t < end; t++) {
+            indices.push_back(triangles[t]->p1->particleID);
+            indices.push_back(triangles[t]->p2->particleID);
+            indices.push_back(triangles[t]->p3->particleID);
+        }
+    };
+
+    glBindVertexArray(cloth.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cloth.buffers[2]);
+    if(triangles.size() > indexCapacity) {
+        // grow geometrically, so refinement reallocates only now and then
+        indexCapacity = std::max(triangles.size(), 2 * indexCapacity);
+        gather(0, triangles.size());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3 * indexCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+    } else {
+        // one glBufferSubData per run of changed triangles
+        for(size_t begin = 0; begin < triangles.size();) {
+            if(!changed(begin)) {
+                begin++;
+                continue;
+            }
+            size_t end = begin + 1;
+            while(end < triangles.size() && changed(end)) end++;
+            gather(begin, end);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 3 * begin * sizeof(GLuint),
+                            indices.size() * sizeof(GLuint), indices.data());
+            begin = end;
+        }
+    }
+    glBindVertexArray(0);
+    cloth.indexCount = GLsizei(3 * triangles.size());
+}
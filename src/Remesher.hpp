@@ -0,0 +1,101 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <unordered_set>
+
+class Cloth;
+struct Particle;
+struct SpringDamper;
+struct Triangle;
+
+// Adaptive anisotropic remeshing by edge bisection. Every interval updates each
+// triangle edge is scored by the fold angle across it and by how fast its ends
+// move apart relative to its length. A fold's score goes to the edges that
+// cross it, so the mesh is refined across the fold and not along it; a spread
+// score stays on its edge, refining along the velocity gradient. Where that
+// would leave a thin triangle (any rest angle under ~17 degrees) the score goes
+// to the triangle's longest edge instead. The worst edges past the refine
+// thresholds are split at their midpoint together with the triangles on them.
+// A split whose triangles have since gone flat and slow is collapsed again, so
+// refinement follows the folds around instead of piling up; the original grid
+// itself is never coarsened.
+//
+// Splits are conservative: the midpoint takes a quarter of each end's mass with
+// the matching share of momentum, and a collapse hands both back. Each half of
+// a split spring is twice as stiff, so the material does not soften where it
+// is refined. Masses, springs and the index buffer are edited in place; the
+// per-element passes are rebuilt from the rest pose when the mesh changed.
+//
+// Lighter, stiffer particles need a shorter explicit step: the cloth's
+// substeps follow the largest spring stiffness / mass at any particle, relative
+// to the unrefined mesh. maxParticles, minMass and maxSubsteps bound the work.
+
+class Remesher {
+public:
+    int interval;          // updates between remeshes
+    float refineAngle;     // fold angle across an edge that splits it (rad)
+    float refineRate;      // |v_a - v_b| / |x_a - x_b| that splits an edge (1/s)
+    float coarsenFactor;   // a split collapses below coarsenFactor * both thresholds
+    size_t maxParticles;   // hard budget, set by build
+    float minMass;         // lightest particle a split may leave, set by build
+    int maxSubsteps;       // no split may need more substeps than this
+
+    Remesher();
+
+    void build(const Cloth& cloth);
+
+    /// Counts updates and remeshes every interval, then sets cloth.substeps.
+    /// Returns the number of edges split plus splits collapsed.
+    int run(Cloth& cloth);
+
+    size_t refinedEdges() const { return splits.size(); }
+
+    /// Stiffness / mass of the unrefined mesh that substeps are measured against.
+    /// A restored checkpoint hands it back, since build would measure the
+    /// already refined mesh.
+    float baseStiffness() const { return baseRatio; }
+    void rebase(float ratio) { baseRatio = ratio; }
+
+private:
+    // one edge split a -> b at m; c and d are the opposite corners (d is null on
+    // a boundary edge). t1 = (a, m, c) and t2 = (m, a, d) are the original
+    // triangles, n1 = (m, b, c) and n2 = (b, m, d) the new ones. Spring ab now
+    // runs a - m.
+    struct Split {
+        Particle *m, *a, *b, *c, *d;
+        Triangle *t1, *t2, *n1, *n2;
+        SpringDamper *ab, *mb, *mc, *md;
+        float shareA, shareB;   // mass taken from a and b
+        float stiffness;        // spring constant of the original edge
+        float restLength;       // of the original edge
+    };
+
+    // a triangle edge; the edge runs from corner slot to corner slot + 1
+    struct EdgeRef {
+        uint64_t key;
+        GLuint triangle;
+        int slot;
+    };
+
+    std::vector<Split> splits;
+    int updatesSinceRemesh;
+    size_t indexCapacity;   // triangles the index buffer holds
+    float baseRatio;        // largest stiffness / mass of the unrefined mesh
+
+    // scratch of one remesh
+    std::vector<EdgeRef> edges;
+    std::vector<GLuint> valence;   // triangles per particle
+    std::vector<float> stiffness;  // spring constants summed per particle
+    std::unordered_set<const Triangle*> touched;
+    std::unordered_set<const void*> dead;   // removed particles, springs and triangles
+
+    void collectEdges(const Cloth& cloth);
+    float sumStiffness(const Cloth& cloth);   // fills stiffness, returns the largest stiffness / mass
+    int coarsen(Cloth& cloth);
+    int refine(Cloth& cloth);
+    bool split(Cloth& cloth, const EdgeRef& e1, const EdgeRef* e2, SpringDamper* spring);
+    void collapse(const Split& s);
+    void compact(Cloth& cloth, std::vector<unsigned char>& renumbered);
+    void patchIndexBuffer(Cloth& cloth, size_t uploaded, const std::vector<unsigned char>& renumbered);
+};
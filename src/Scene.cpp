@@ -11,9 +11,13 @@
 #include <tiny_obj_loader.h>
 
 /// Constructor
-Scene::Scene(const std::string& name) : name(name) {
+Scene::Scene(const std::string& name) : name(name), models(sizeof(ModelBlock)) {
     grid = new Grid("Grid");
     camera = new Camera("Camera");
+
+    glGenBuffers(1, &cameraBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
 }
 
 /// Destructor
@@ -22,28 +26,48 @@ Scene::~Scene() {
         if (object.second) { delete object.second; }
     }
     objects.clear();
+    glDeleteBuffers(1, &cameraBuffer);
+}
+
+void Scene::bindCamera() {
+    CameraBlock block = {};
+    block.view = camera->view;
+    block.projection = camera->projection;
+    block.viewInv = camera->getViewInv();
+    block.projInv = camera->getProjInv();
+    block.zNear = camera->getNear();
+    block.zFar = camera->getFar();
+    if (!cameraUploaded || memcmp(&block, &uploadedCamera, sizeof(block)) != 0) {
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+        uploadedCamera = block;
+        cameraUploaded = true;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, cameraBuffer);
 }
 
 void Scene::drawGrid(Shader *shader) {
-    GLuint program = shader->program;
-    glUseProgram(program);
-    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(camera->view));
-    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(camera->projection));
-    glUniformMatrix4fv(glGetUniformLocation(program, "viewInv"), 1, GL_FALSE, glm::value_ptr(camera->getViewInv()));
-    glUniformMatrix4fv(glGetUniformLocation(program, "projInv"), 1, GL_FALSE, glm::value_ptr(camera->getProjInv()));
-    glUniform1f(glGetUniformLocation(program, "zNear"), camera->getNear());
-    glUniform1f(glGetUniformLocation(program, "zFar"), camera->getFar());
+    glUseProgram(shader->program);
+    bindCamera();
     grid->draw(shader);
 }
 
 void Scene::draw(Shader *shader) {
-    GLuint program = shader->program;
-    glUseProgram(program);
-    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(camera->view));
-    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(camera->projection));
+    glUseProgram(shader->program);
+    bindCamera();
+
+    // every object's matrices in one upload, then a range bind per draw
+    modelBlocks.clear();
+    for (auto& object : objects) {
+        modelBlocks.push_back({ object.second->matrix_world, object.second->normalMatrix() });
+    }
+    models.upload(modelBlocks.data(), modelBlocks.size());
 
     // MARK: Ask each object to draw.
+    size_t index = 0;
     for (auto& object : objects) {
+        models.bind(MODEL_BLOCK_BINDING, index++);
         object.second->draw(shader);
     }
+    models.finish();
 }
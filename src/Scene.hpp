@@ -10,6 +10,7 @@
 #include "Grid.hpp"
 #include "Camera.hpp"
 #include "Mesh.hpp"
+#include "UniformBlocks.hpp"
 
 class Scene {
 public:
@@ -22,4 +23,14 @@ public:
     void drawGrid(Shader *shader);
     void draw(Shader *shader);
     ~Scene();
+
+private:
+    GLuint cameraBuffer = 0;
+    CameraBlock uploadedCamera;
+    bool cameraUploaded = false;
+    UniformRing models;
+    std::vector<ModelBlock> modelBlocks;
+
+    /// Binds the camera block, uploading it only when the camera moved.
+    void bindCamera();
 };
@@ -0,0 +1,397 @@
+#include "SceneFile.hpp"
+#include "Tokenizer.hpp"
+
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+
+namespace {
+    // Statements over the Tokenizer's tokens, with comments skipped, one token
+    // of lookahead and the first error kept
+    class Parser {
+    public:
+        Parser(Tokenizer& in, const std::string& path, std::string& error) : in(in), path(path), error(error) {}
+
+        // the next token, empty at the end of the file
+        std::string next() {
+            if(hasPending) {
+                hasPending = false;
+                return pending;
+            }
+            for(;;) {
+                const std::string_view token = in.GetToken();
+                if(!token.empty() && token[0] == '#') {
+                    in.SkipLine();
+                    continue;
+                }
+                return std::string(token);
+            }
+        }
+
+        const std::string& peek() {
+            if(!hasPending) {
+                pending = next();
+                hasPending = true;
+            }
+            return pending;
+        }
+
+        bool fail(const std::string& message) {
+            if(error.empty()) error = path + ":" + std::to_string(in.GetLineNum()) + ": " + message;
+            return false;
+        }
+
+        bool expect(const char* token) {
+            const std::string t = next();
+            return t == token || fail("expected '" + std::string(token) + "', got '" + t + "'");
+        }
+
+        bool number(float& value) {
+            const std::string t = next();
+            char* stop = nullptr;
+            value = std::strtof(t.c_str(), &stop);
+            return (!t.empty() && *stop == '\0') || fail("expected a number, got '" + t + "'");
+        }
+
+        bool integer(int& value) {
+            const std::string t = next();
+            char* stop = nullptr;
+            const long parsed = std::strtol(t.c_str(), &stop, 10);
+            value = int(parsed);
+            const bool whole = !t.empty() && *stop == '\0' && long(value) == parsed;
+            return whole || fail("expected an integer, got '" + t + "'");
+        }
+
+        bool vector(glm::vec3& value) {
+            return number(value.x) && number(value.y) && number(value.z);
+        }
+
+        bool numbers(std::initializer_list<float*> values) {
+            for(float* value : values) {
+                if(!number(*value)) return false;
+            }
+            return true;
+        }
+
+        bool toggle(bool& value) {
+            const std::string t = next();
+            if(t == "on") value = true;
+            else if(t == "off") value = false;
+            else return fail("expected 'on' or 'off', got '" + t + "'");
+            return true;
+        }
+
+        // a name not declared before in names
+        template<class Map>
+        bool newName(const Map& names, const char* kind, std::string& name) {
+            name = next();
+            if(name.empty() || name == "{") return fail(std::string("expected a ") + kind + " name");
+            return names.count(name) == 0 || fail(std::string(kind) + " '" + name + "' is declared twice");
+        }
+
+        // '{' statements '}'; statement parses one from its keyword, and returns
+        // false once it has failed
+        bool block(const char* kind, const std::function<bool(const std::string&)>& statement) {
+            if(!expect("{")) return false;
+            for(;;) {
+                const std::string keyword = next();
+                if(keyword == "}") return true;
+                if(keyword.empty()) return fail(std::string("missing '}' after ") + kind);
+                if(!statement(keyword)) return false;
+            }
+        }
+
+        bool unknown(const char* kind, const std::string& keyword) {
+            return fail(std::string("unknown ") + kind + " statement '" + keyword + "'");
+        }
+
+    private:
+        Tokenizer& in;
+        const std::string& path;
+        std::string& error;
+        std::string pending;
+        bool hasPending = false;
+    };
+
+    bool parseMaterial(Parser& p, ClothMaterial& m) {
+        return p.block("material", [&](const std::string& k) {
+            if(k == "springs") return p.numbers({ &m.springConstant, &m.dampingConstant });
+            if(k == "bending") return p.numbers({ &m.bendingStiffness, &m.bendingDamping });
+            if(k == "membrane") return p.numbers({ &m.youngModulus, &m.poissonRatio, &m.membraneDamping });
+            if(k == "maxStretch") return p.number(m.maxStretch);
+            if(k == "tearStretch") return p.number(m.tearStretch);
+            return p.unknown("material", k);
+        });
+    }
+
+    bool parseCurve(Parser& p, CurveDesc& c) {
+        if(p.peek() == "loop") {
+            p.next();
+            c.loop = true;
+        }
+        return p.block("curve", [&](const std::string& k) {
+            if(k != "key") return p.unknown("curve", k);
+            float time;
+            glm::vec3 translation;
+            if(!p.number(time) || !p.vector(translation)) return false;
+            if(!c.keys.empty() && time <= c.keys.back().time) return p.fail("keys must be in increasing time");
+            c.keys.push_back(PinKeyframe(time, translation));
+            return true;
+        });
+    }
+
+    bool parseWind(Parser& p, WindDesc& w) {
+        return p.block("wind", [&](const std::string& k) {
+            if(k == "lattice") {
+                if(!p.vector(w.origin) || !p.integer(w.dims.x) || !p.integer(w.dims.y) || !p.integer(w.dims.z) ||
+                   !p.number(w.cellSize)) {
+                    return false;
+                }
+                if(glm::any(glm::lessThan(w.dims, glm::ivec3(2))) || glm::any(glm::greaterThan(w.dims, glm::ivec3(256)))) {
+                    return p.fail("the wind lattice needs 2 to 256 nodes per side");
+                }
+                return w.cellSize > 0.0f || p.fail("the cell size must be positive");
+            }
+            if(k == "speed") return p.vector(w.speed);
+            if(k == "turbulence") return p.numbers({ &w.turbulence, &w.turbulenceScale, &w.turbulenceRate });
+            if(k == "gust") {
+                WindGust g;
+                if(!p.vector(g.direction) || !p.numbers({ &g.strength, &g.wavelength, &g.speed })) return false;
+                if(glm::length(g.direction) == 0.0f) return p.fail("a gust needs a direction");
+                g.direction = glm::normalize(g.direction);
+                w.gusts.push_back(g);
+                return true;
+            }
+            if(k == "vortex") {
+                WindVortex v;
+                if(!p.vector(v.center) || !p.vector(v.axis) || !p.numbers({ &v.radius, &v.strength })) return false;
+                if(glm::length(v.axis) == 0.0f) return p.fail("a vortex needs an axis");
+                v.axis = glm::normalize(v.axis);
+                w.vortices.push_back(v);
+                return true;
+            }
+            return p.unknown("wind", k);
+        });
+    }
+
+    bool parsePin(Parser& p, const SceneDesc& scene, ClothDesc& c) {
+        const std::string kind = p.next();
+        if(!c.customPins) {
+            c.customPins = true;
+            c.pins.clear();
+        }
+        if(kind == "none") return true;
+
+        PinDesc pin;
+        if(kind == "row") {
+            pin.kind = PIN_ROW;
+            if(!p.integer(pin.row)) return false;
+        } else if(kind == "column") {
+            pin.kind = PIN_COLUMN;
+            if(!p.integer(pin.column)) return false;
+        } else if(kind == "particle") {
+            pin.kind = PIN_PARTICLE;
+            if(!p.integer(pin.row) || !p.integer(pin.column)) return false;
+        } else if(kind == "corners") {
+            pin.kind = PIN_CORNERS;
+        } else {
+            return p.fail("unknown pin '" + kind + "'");
+        }
+        if(p.peek() == "curve") {
+            p.next();
+            pin.curve = p.next();
+            if(!scene.curves.count(pin.curve)) return p.fail("unknown curve '" + pin.curve + "'");
+        }
+        c.pins.push_back(pin);
+        return true;
+    }
+
+    bool parseCloth(Parser& p, const SceneDesc& scene, ClothDesc& c) {
+        const bool parsed = p.block("cloth", [&](const std::string& k) {
+            if(k == "size") return p.integer(c.size);
+            if(k == "mass") return p.number(c.mass);
+            if(k == "spacing") return p.number(c.spacing);
+            if(k == "origin") return p.vector(c.origin);
+            if(k == "material") {
+                c.material = p.next();
+                return scene.materials.count(c.material) > 0 || p.fail("unknown material '" + c.material + "'");
+            }
+            if(k == "stretch") {
+                const std::string model = p.next();
+                if(model == "springs") c.stretchModel = STRETCH_SPRINGS;
+                else if(model == "membrane") c.stretchModel = STRETCH_MEMBRANE;
+                else return p.fail("expected 'springs' or 'membrane', got '" + model + "'");
+                return true;
+            }
+            if(k == "damping") {
+                const std::string model = p.next();
+                if(model == "spring") c.dampingModel = DAMPING_SPRING;
+                else if(model == "none") c.dampingModel = DAMPING_NONE;
+                else return p.fail("expected 'spring' or 'none', got '" + model + "'");
+                return true;
+            }
+            if(k == "pin") return parsePin(p, scene, c);
+            if(k == "bending") return p.toggle(c.bending);
+            if(k == "drag") return p.toggle(c.drag);
+            if(k == "occlusion") return p.toggle(c.occlusion);
+            if(k == "strainLimiting") return p.toggle(c.strainLimiting);
+            if(k == "tearing") return p.toggle(c.tearing);
+            if(k == "remeshing") return p.toggle(c.remeshing);
+            return p.unknown("cloth", k);
+        });
+        if(!parsed) return false;
+
+        // checked at the end, since the size may come after the pins
+        if(c.size < 2 || c.size > 4096) return p.fail("cloth '" + c.name + "' needs a size from 2 to 4096");
+        if(!(c.mass > 0.0f) || !(c.spacing > 0.0f)) {
+            return p.fail("cloth '" + c.name + "' needs a positive mass and spacing");
+        }
+        for(const PinDesc& pin : c.pins) {
+            if(pin.row < 0 || pin.row >= c.size || pin.column < 0 || pin.column >= c.size) {
+                return p.fail("cloth '" + c.name + "' pins outside its " + std::to_string(c.size) + " particle rows");
+            }
+        }
+        return true;
+    }
+}
+
+bool loadSceneFile(const std::string& path, SceneDesc& scene, std::string& error) {
+    scene = SceneDesc();
+    scene.path = path;
+    Tokenizer in;
+    if(!in.Open(path.c_str())) {
+        error = "can't open '" + path + "'";
+        return false;
+    }
+    error.clear();
+    Parser p(in, path, error);
+
+    for(std::string keyword = p.next(); !keyword.empty() && error.empty(); keyword = p.next()) {
+        std::string name;
+        if(keyword == "frames") {
+            if(p.integer(scene.frames) && scene.frames < 0) p.fail("frames can't be negative");
+        } else if(keyword == "checksum") {
+            const std::string t = p.next();
+            char* stop = nullptr;
+            scene.checksum = std::strtoull(t.c_str(), &stop, 16);
+            scene.hasChecksum = !t.empty() && *stop == '\0';
+            if(!scene.hasChecksum) p.fail("expected a hexadecimal checksum, got '" + t + "'");
+        } else if(keyword == "material") {
+            ClothMaterial material;
+            if(p.newName(scene.materials, "material", name) && parseMaterial(p, material)) {
+                scene.materials[name] = material;
+            }
+        } else if(keyword == "curve") {
+            CurveDesc curve;
+            if(p.newName(scene.curves, "curve", name) && parseCurve(p, curve)) {
+                scene.curves[name] = curve;
+            }
+        } else if(keyword == "wind") {
+            if(scene.hasWind) {
+                p.fail("wind is declared twice");
+            } else {
+                scene.hasWind = parseWind(p, scene.wind);
+            }
+        } else if(keyword == "ground") {
+            p.toggle(scene.ground);
+        } else if(keyword == "collider") {
+            const std::string shape = p.next();
+            SphereCollider sphere;
+            if(shape != "sphere") {
+                p.fail("unknown collider '" + shape + "'");
+            } else if(p.vector(sphere.center) && p.number(sphere.radius)) {
+                if(sphere.radius > 0.0f) scene.colliders.push_back(sphere);
+                else p.fail("a sphere needs a positive radius");
+            }
+        } else if(keyword == "cloth") {
+            ClothDesc cloth;
+            std::map<std::string, int> names;
+            for(const ClothDesc& c : scene.cloths) names[c.name] = 0;
+            if(p.newName(names, "cloth", cloth.name) && parseCloth(p, scene, cloth)) {
+                scene.cloths.push_back(cloth);
+            }
+        } else {
+            p.fail("unknown statement '" + keyword + "'");
+        }
+    }
+    in.Close();
+    return error.empty();
+}
+
+Cloth* buildCloth(const SceneDesc& scene, const ClothDesc& desc, bool headless) {
+    const auto found = scene.materials.find(desc.material);
+    const ClothMaterial material = found != scene.materials.end() ? found->second : ClothMaterial();
+    Cloth* cloth = new Cloth(desc.name, desc.size, desc.mass, desc.spacing, desc.origin, headless, material);
+
+    cloth->stretchModel = desc.stretchModel;
+    cloth->dampingModel = desc.dampingModel;
+    cloth->bendingEnabled = desc.bending;
+    cloth->dragEnabled = desc.drag;
+    cloth->windOcclusion = desc.occlusion;
+    cloth->strainLimiting = desc.strainLimiting;
+    cloth->tearingEnabled = desc.tearing;
+    cloth->remeshing = desc.remeshing;
+    cloth->groundCollision = scene.ground;
+    cloth->colliders = scene.colliders;
+
+    if(desc.customPins) {
+        cloth->unpinAll();
+        std::map<std::string, int> curveIDs;   // each curve the cloth uses, added once
+        // a particle named by several statements (a row and a column, say) is
+        // pinned once, by the first
+        std::vector<bool> pinned(size_t(desc.size) * desc.size, false);
+        auto pinAt = [&](int row, int column, int curveID) {
+            const GLuint id = cloth->particleAt(row, column)->particleID;
+            if(pinned[id]) return;
+            pinned[id] = true;
+            cloth->pin(id, curveID);
+        };
+        for(const PinDesc& pin : desc.pins) {
+            int curveID = 0;
+            if(!pin.curve.empty()) {
+                int& id = curveIDs[pin.curve];
+                if(id == 0) {
+                    const CurveDesc& curve = scene.curves.at(pin.curve);
+                    KeyframePinCurve* keyframes = new KeyframePinCurve(curve.loop);
+                    for(const PinKeyframe& key : curve.keys) keyframes->addKey(key);
+                    id = cloth->addPinCurve(keyframes);
+                }
+                curveID = id;
+            }
+
+            const int last = desc.size - 1;
+            switch(pin.kind) {
+                case PIN_ROW:
+                    for(int col = 0; col <= last; col++) {
+                        pinAt(pin.row, col, curveID);
+                    }
+                    break;
+                case PIN_COLUMN:
+                    for(int row = 0; row <= last; row++) {
+                        pinAt(row, pin.column, curveID);
+                    }
+                    break;
+                case PIN_PARTICLE:
+                    pinAt(pin.row, pin.column, curveID);
+                    break;
+                case PIN_CORNERS:
+                    pinAt(0, 0, curveID);
+                    pinAt(0, last, curveID);
+                    break;
+            }
+        }
+    }
+    return cloth;
+}
+
+WindField* buildWind(const SceneDesc& scene) {
+    if(!scene.hasWind) return nullptr;
+    const WindDesc& w = scene.wind;
+    WindField* wind = new WindField(w.origin, w.dims, w.cellSize, w.speed);
+    wind->turbulence = w.turbulence;
+    wind->turbulenceScale = w.turbulenceScale;
+    wind->turbulenceRate = w.turbulenceRate;
+    wind->gusts = w.gusts;
+    wind->vortices = w.vortices;
+    return wind;
+}
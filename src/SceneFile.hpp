@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Cloth.hpp"
+#include "WindField.hpp"
+
+// Declarative scene files for batch simulations. A scene is a list of
+// whitespace separated statements, read with the Tokenizer; '#' starts a
+// comment that runs to the end of the line. Every block is optional and
+// every value defaults to the #defines in Cloth.hpp.
+//
+//   frames 600                        # updates a batch run takes
+//   checksum 3f2a...                  # expected final state, as a batch run printed it
+//
+//   material canvas {
+//       springs 1200 4                # stiffness, damping
+//       bending 1.0 0.05              # stiffness, damping
+//       membrane 2000 0.3 0.5         # Young's modulus * thickness, Poisson ratio, damping
+//       maxStretch 1.1                # strain limit
+//       tearStretch 1.3
+//   }
+//
+//   curve wave loop {                 # keyframed pin translation, optionally looping
+//       key 0  0 0 0                  # time, translation
+//       key 1  0 0.4 0
+//   }
+//
+//   wind {                            # without it the air is still
+//       lattice -3 -1 -3  17 9 17  0.5   # origin, node counts, cell size
+//       speed 0 0 20
+//       turbulence 5 2 0.5            # amplitude, feature size, rate
+//       gust 1 0 0  3 4 5             # direction, strength, wavelength, speed
+//       vortex 1 1 1  0 1 0  0.5 2    # center, axis, radius, strength
+//   }
+//
+//   ground on                         # the y = 0 plane
+//   collider sphere 1.4 0.6 1.4 0.5   # center, radius
+//
+//   cloth flag {                      # any number of cloths, all in the same wind
+//       size 15                       # particles per side
+//       mass 0.5                      # per particle
+//       spacing 0.2
+//       origin 0 1.7 0
+//       material canvas
+//       stretch springs               # or membrane
+//       damping spring                # or none
+//       pin row 0 curve wave          # also column c, particle row col, corners, none
+//       bending on                    # also drag, occlusion, strainLimiting, tearing, remeshing
+//   }
+//
+// A cloth with no pin statements keeps the constructor's pinned top row; the
+// first pin statement replaces it. Names must be declared before they are used.
+
+struct CurveDesc {
+    bool loop = false;
+    std::vector<PinKeyframe> keys;
+};
+
+enum PinKind {
+    PIN_ROW,
+    PIN_COLUMN,
+    PIN_PARTICLE,
+    PIN_CORNERS   // the two ends of row 0
+};
+
+struct PinDesc {
+    PinKind kind;
+    int row = 0, column = 0;
+    std::string curve;   // empty for a fixed pin
+};
+
+struct ClothDesc {
+    std::string name;
+    int size = 15;
+    float mass = MASS;
+    float spacing = PARTICLE_SPACING;
+    glm::vec3 origin = glm::vec3(0, INITIAL_HEIGHT, 0);
+    std::string material;   // empty for the defaults
+    StretchModel stretchModel = STRETCH_SPRINGS;
+    DampingModel dampingModel = DAMPING_SPRING;
+    bool customPins = false;   // set by the first pin statement
+    std::vector<PinDesc> pins;
+    bool bending = true, drag = true, occlusion = true;
+    bool strainLimiting = true, tearing = false, remeshing = false;
+};
+
+struct WindDesc {
+    glm::vec3 origin = glm::vec3(-3, -1, -3);
+    glm::ivec3 dims = glm::ivec3(17, 9, 17);
+    float cellSize = 0.5f;
+    glm::vec3 speed = DEFAULT_WIND_SPEED;
+    float turbulence = 0.0f, turbulenceScale = 2.0f, turbulenceRate = 0.5f;
+    std::vector<WindGust> gusts;
+    std::vector<WindVortex> vortices;
+};
+
+struct SceneDesc {
+    std::string path;
+    int frames = 600;
+    bool hasChecksum = false;
+    uint64_t checksum = 0;
+    std::map<std::string, ClothMaterial> materials;
+    std::map<std::string, CurveDesc> curves;
+    bool hasWind = false;
+    WindDesc wind;
+    bool ground = true;
+    std::vector<SphereCollider> colliders;
+    std::vector<ClothDesc> cloths;
+};
+
+/// Returns false and sets error, with the line it stopped at, if the file
+/// can't be read or is malformed.
+bool loadSceneFile(const std::string& path, SceneDesc& scene, std::string& error);
+
+/// Builds a cloth of the scene, with its material, pins, toggles and the
+/// scene's colliders. A headless cloth makes no GL calls.
+Cloth* buildCloth(const SceneDesc& scene, const ClothDesc& desc, bool headless);
+
+/// Builds the scene's wind field; nullptr if it has none.
+WindField* buildWind(const SceneDesc& scene);
@@ -0,0 +1,254 @@
+#include "SequenceExporter.hpp"
+#include "Cloth.hpp"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    struct Pc2Header {
+        char signature[12];
+        int32_t fileVersion;
+        int32_t pointCount;
+        float startFrame;
+        float sampleRate;
+        int32_t sampleCount;
+    };
+    static_assert(sizeof(Pc2Header) == 32, "PC2 header is 32 bytes");
+    static_assert(sizeof(glm::vec3) == 12, "PC2 points are packed float triples");
+
+    constexpr size_t FLOAT_CHARS = 24;   // "-1.17549435e-38" and the separator, with room
+    constexpr size_t LINE_CHARS = 4 + 3 * FLOAT_CHARS;
+    constexpr size_t FACE_CHARS = 4 + 3 * 24;
+
+    // shortest round-trip std::to_chars where the standard library has it for
+    // floats (libc++ only on newer macOS), printf's 9 significant digits otherwise
+    char* writeFloat(char* p, float value) {
+#if defined(__cpp_lib_to_chars)
+        return std::to_chars(p, p + FLOAT_CHARS, value).ptr;
+#else
+        return p + snprintf(p, FLOAT_CHARS, "%.9g", double(value));
+#endif
+    }
+
+    char* writeLine(char* p, const char* tag, size_t tagLength, const glm::vec3& v) {
+        memcpy(p, tag, tagLength);
+        p += tagLength;
+        p = writeFloat(p, v.x);
+        *p++ = ' ';
+        p = writeFloat(p, v.y);
+        *p++ = ' ';
+        p = writeFloat(p, v.z);
+        *p++ = '\n';
+        return p;
+    }
+
+    // "a//a", 1-based, position and normal alike
+    char* writeCorner(char* p, GLuint index) {
+        char* start = p;
+        p = std::to_chars(p, p + 10, uint64_t(index) + 1).ptr;
+        *p++ = '/';
+        *p++ = '/';
+        const size_t digits = size_t(p - start) - 2;
+        memcpy(p, start, digits);
+        return p + digits;
+    }
+}
+
+SequenceExporter::SequenceExporter(const std::string& directory, const std::string& name, int formats)
+    : prefix(directory + "/" + name), formats(formats) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if(ec) {
+        failure = "can't create '" + directory + "': " + ec.message();
+        return;
+    }
+    worker = std::thread(&SequenceExporter::run, this);
+}
+
+SequenceExporter::~SequenceExporter() {
+    close();
+}
+
+bool SequenceExporter::ok() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure.empty();
+}
+
+std::string SequenceExporter::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failure;
+}
+
+size_t SequenceExporter::frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return appended;
+}
+
+size_t SequenceExporter::dropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return droppedCount;
+}
+
+std::string SequenceExporter::pathFor(size_t frame, const char* extension) const {
+    char number[32];
+    snprintf(number, sizeof(number), "_%06zu.", frame);
+    return prefix + number + extension;
+}
+
+void SequenceExporter::append(const Cloth& cloth) {
+    // the faces only change with the topology
+    if((formats & OBJ) && (!indices || cloth.topologyVersion != topology)) {
+        std::shared_ptr<GLuints> list = std::make_shared<GLuints>();
+        list->reserve(3 * cloth.triangles.size());
+        for(const Triangle* t : cloth.triangles) {
+            list->push_back(t->p1->particleID);
+            list->push_back(t->p2->particleID);
+            list->push_back(t->p3->particleID);
+        }
+        indices = std::move(list);
+        topology = cloth.topologyVersion;
+    }
+
+    Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(closing || !worker.joinable()) return;
+        frame.number = appended++;
+        if(queued.size() >= MAX_QUEUED) {
+            droppedCount++;
+            return;
+        }
+        if(!spare.empty()) {
+            frame.positions.swap(spare.back().positions);
+            frame.normals.swap(spare.back().normals);
+            spare.pop_back();
+        }
+    }
+
+    const size_t n = cloth.particles.size();
+    frame.positions.resize(n);
+    frame.normals.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        frame.positions[i] = cloth.particles[i]->position;
+        frame.normals[i] = cloth.particles[i]->normal;
+    }
+    frame.indices = indices;
+    frame.topology = cloth.topologyVersion;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(closing) return;
+        queued.push_back(std::move(frame));
+    }
+    wake.notify_one();
+}
+
+void SequenceExporter::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(closing) return;
+        closing = true;
+    }
+    wake.notify_one();
+    if(worker.joinable()) worker.join();
+    finishPc2();
+}
+
+void SequenceExporter::fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(failure.empty()) failure = message;
+}
+
+void SequenceExporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        wake.wait(lock, [this] { return !queued.empty() || closing; });
+        if(queued.empty()) break;   // closing, all written
+        Frame frame = std::move(queued.front());
+        queued.pop_front();
+        lock.unlock();
+
+        if(formats & OBJ) writeObj(frame);
+        if(formats & PC2) writePc2(frame);
+        frame.indices.reset();
+
+        lock.lock();
+        spare.push_back(std::move(frame));
+    }
+}
+
+void SequenceExporter::writeObj(const Frame& frame) {
+    if(frame.indices != faceSource) {
+        const GLuints& list = *frame.indices;
+        faces.resize(list.size() / 3 * FACE_CHARS);
+        char* p = faces.data();
+        for(size_t i = 0; i + 2 < list.size(); i += 3) {
+            *p++ = 'f';
+            for(int k = 0; k < 3; k++) {
+                *p++ = ' ';
+                p = writeCorner(p, list[i + k]);
+            }
+            *p++ = '\n';
+        }
+        faces.resize(size_t(p - faces.data()));
+        faceSource = frame.indices;
+    }
+
+    const size_t n = frame.positions.size();
+    text.resize(64 + 2 * n * LINE_CHARS);
+    char* p = text.data();
+    p += snprintf(p, 64, "# frame %zu, %zu vertices\n", frame.number, n);
+    for(size_t i = 0; i < n; i++) p = writeLine(p, "v ", 2, frame.positions[i]);
+    for(size_t i = 0; i < n; i++) p = writeLine(p, "vn ", 3, frame.normals[i]);
+
+    const std::string path = pathFor(frame.number, "obj");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(text.data(), std::streamsize(p - text.data()));
+    out.write(faces.data(), std::streamsize(faces.size()));
+    out.close();
+    if(!out) fail("can't write '" + path + "'");
+}
+
+void SequenceExporter::writePc2(const Frame& frame) {
+    const size_t n = frame.positions.size();
+    // the point order can change with the topology even if the count does not
+    if(cache.is_open() && (n != cachePoints || frame.topology != cacheTopology)) finishPc2();
+    if(!cache.is_open()) {
+        const std::string path = pathFor(frame.number, "pc2");
+        cache.open(path, std::ios::binary | std::ios::trunc);
+        if(!cache) {
+            fail("can't open '" + path + "'");
+            return;
+        }
+        Pc2Header header = {};
+        memcpy(header.signature, "POINTCACHE2", 12);
+        header.fileVersion = 1;
+        header.pointCount = int32_t(n);
+        header.startFrame = float(frame.number);
+        header.sampleRate = 1.0f;
+        cache.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        cachePoints = n;
+        cacheTopology = frame.topology;
+        cacheSamples = 0;
+        cacheStart = frame.number;
+    }
+
+    // a dropped frame repeats the next one's positions, keeping the cache in time
+    while(cacheStart + cacheSamples <= frame.number) {
+        cache.write(reinterpret_cast<const char*>(frame.positions.data()), std::streamsize(n * sizeof(glm::vec3)));
+        cacheSamples++;
+    }
+    if(!cache) fail("can't write the point cache");
+}
+
+void SequenceExporter::finishPc2() {
+    if(!cache.is_open()) return;
+    const int32_t samples = int32_t(cacheSamples);
+    cache.seekp(offsetof(Pc2Header, sampleCount));
+    cache.write(reinterpret_cast<const char*>(&samples), sizeof(samples));
+    cache.close();
+    if(!cache) fail("can't finish the point cache");
+}
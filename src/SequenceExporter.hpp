@@ -0,0 +1,94 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class Cloth;
+
+// Per-frame export of a simulated cloth for DCC tools: an OBJ file per frame
+// (positions, normals and the triangles) and a PC2 point cache holding every
+// frame's positions.
+//
+// append copies the positions and normals into a recycled frame buffer and
+// hands it to an I/O thread through a bounded queue. It never waits: if the
+// writer is MAX_QUEUED frames behind, the frame is dropped and counted. The
+// triangle indices are copied only when the cloth's topology changes, and the
+// writer formats their face lines once per topology. Each file is formatted
+// into one buffer, with shortest round-trip float formatting where the
+// standard library has it, and written in a single call.
+//
+// A PC2 cache needs a fixed point count, so a cloth that tears or remeshes
+// starts a new cache at that frame. Caches are named after the frame they
+// start at; the frame count in each header is filled in when it ends. A
+// dropped frame is missing from the OBJ sequence, and the point cache holds
+// the next frame's positions in its place so it stays in time.
+
+class SequenceExporter {
+public:
+    enum Format { OBJ = 1, PC2 = 2 };
+
+    /// Writes into directory, creating it if needed, as <name>_<frame>.obj and
+    /// <name>_<frame>.pc2.
+    SequenceExporter(const std::string& directory, const std::string& name, int formats = OBJ | PC2);
+    ~SequenceExporter();   // closes
+
+    SequenceExporter(const SequenceExporter&) = delete;
+    SequenceExporter& operator=(const SequenceExporter&) = delete;
+
+    bool ok() const;
+    std::string error() const;   // the first failure, empty if none
+
+    void append(const Cloth& cloth);
+
+    /// Writes what is queued and finishes the point cache. Later appends are ignored.
+    void close();
+
+    size_t frames() const;    // appended so far, dropped ones included
+    size_t dropped() const;   // not exported because the writer was behind
+
+private:
+    static constexpr size_t MAX_QUEUED = 16;
+
+    struct Frame {
+        size_t number;
+        unsigned topology;   // the cloth's topologyVersion
+        std::vector<glm::vec3> positions, normals;
+        std::shared_ptr<const GLuints> indices;
+    };
+
+    std::string prefix;   // directory/name
+    int formats;
+
+    // owned by the caller of append
+    unsigned topology = 0;
+    std::shared_ptr<const GLuints> indices;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Frame> queued;
+    std::vector<Frame> spare;   // written frames, reused by append
+    bool closing = false;
+    size_t appended = 0, droppedCount = 0;
+    std::string failure;
+    std::thread worker;
+
+    // writer state, owned by the worker
+    std::vector<char> text;
+    std::shared_ptr<const GLuints> faceSource;   // the indices faces was formatted from
+    std::vector<char> faces;
+    std::ofstream cache;
+    size_t cachePoints = 0, cacheSamples = 0, cacheStart = 0;
+    unsigned cacheTopology = 0;
+
+    void run();
+    void writeObj(const Frame& frame);
+    void writePc2(const Frame& frame);
+    void finishPc2();
+    std::string pathFor(size_t frame, const char* extension) const;
+    void fail(const std::string& message);
+};
@@ -0,0 +1,267 @@
+#include "ShaderCache.hpp"
+#include "FileView.hpp"
+#include "MeshCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// Apple's headers stop at GL 4.1; the ARB extension uses the same token
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+    constexpr char MAGIC[8] = { 'C', 'L', 'T', 'H', 'P', 'R', 'O', 'G' };
+    constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t format;   // as glGetProgramBinary reported it
+        uint64_t length;
+    };
+
+    std::string readSource(const std::string& fn) {
+        FileView file(fn);
+        if(!file.ok()) {
+            throw std::runtime_error("Failed to open " + fn);
+        }
+        return std::string(file.data(), file.size());
+    }
+
+    std::string glString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        return value ? reinterpret_cast<const char*>(value) : "";
+    }
+
+    void printShaderLog(GLuint shader) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> log(size_t(length) + 1, 0);
+        glGetShaderInfoLog(shader, length, &length, log.data());
+        std::cout << log.data() << std::endl;
+    }
+
+    void printProgramLog(GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> log(size_t(length) + 1, 0);
+        glGetProgramInfoLog(program, length, &length, log.data());
+        std::cout << log.data() << std::endl;
+    }
+}
+
+ShaderCache::ShaderCache(const std::string& directory) : directory(directory) {
+    driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    binaries = formats > 0;
+
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for(GLint i = 0; i < extensions; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+        if(extension && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 ||
+                         strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)) {
+            parallel = true;
+        }
+    }
+}
+
+ShaderCache::~ShaderCache() {
+    for(Job& job : jobs) {
+        glDeleteShader(job.vs);
+        glDeleteShader(job.fs);
+        glDeleteProgram(job.program);
+    }
+}
+
+Shader* ShaderCache::load(const std::string& name, const std::string& vsfn, const std::string& fsfn) {
+    Job job;
+    job.vsfn = vsfn;
+    job.fsfn = fsfn;
+    GLuint program = start(job, name);
+    if(!program) {
+        const std::string error = finish(job);
+        if(!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        program = job.program;
+    }
+    return new Shader(name, program);
+}
+
+Shader* ShaderCache::loadAsync(const std::string& name, const std::string& vsfn, const std::string& fsfn,
+                               const Shader* fallback) {
+    Job job;
+    job.vsfn = vsfn;
+    job.fsfn = fsfn;
+    const GLuint program = start(job, name);
+    if(program) return new Shader(name, program);
+
+    job.shader = new Shader(name, fallback ? fallback->program : 0, false);
+    jobs.push_back(job);
+    return job.shader;
+}
+
+size_t ShaderCache::poll() {
+    bool finished = false;
+    for(size_t i = 0; i < jobs.size();) {
+        Job& job = jobs[i];
+        // without completion queries a frame waits for one program at most
+        if(!done(job) || (!parallel && finished)) {
+            i++;
+            continue;
+        }
+        const std::string error = finish(job);
+        if(error.empty()) {
+            job.shader->adopt(job.program);
+        } else {
+            std::cerr << job.shader->name << ": " << error << std::endl;
+        }
+        finished = true;
+        jobs.erase(jobs.begin() + std::ptrdiff_t(i));
+    }
+    return jobs.size();
+}
+
+GLuint ShaderCache::start(Job& job, const std::string& name) {
+    const std::string vsf = readSource(job.vsfn);
+    const std::string fsf = readSource(job.fsfn);
+    const std::string key = vsf + '\0' + fsf + '\0' + driver;
+    char hex[20];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(MeshCache::hash(key.data(), key.size())));
+    job.path = directory + "/" + name + "-" + hex + ".bin";
+    if(binaries) {
+        const GLuint program = loadBinary(job.path);
+        if(program) return program;
+    }
+
+    // issued back to back, so a parallel compiler can work on the whole program
+    job.vs = glCreateShader(GL_VERTEX_SHADER);
+    job.fs = glCreateShader(GL_FRAGMENT_SHADER);
+    const GLchar* vs_cstr = vsf.c_str();
+    const GLchar* fs_cstr = fsf.c_str();
+    glShaderSource(job.vs, 1, &vs_cstr, NULL);
+    glShaderSource(job.fs, 1, &fs_cstr, NULL);
+    glCompileShader(job.vs);
+    glCompileShader(job.fs);
+    job.program = glCreateProgram();
+    glAttachShader(job.program, job.vs);
+    glAttachShader(job.program, job.fs);
+    if(binaries) {
+        glProgramParameteri(job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(job.program);
+    return 0;
+}
+
+bool ShaderCache::done(const Job& job) const {
+    if(!parallel) return true;
+    GLint complete = 0;
+    glGetProgramiv(job.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != 0;
+}
+
+std::string ShaderCache::finish(Job& job) {
+    std::string error;
+    GLint status = 0;
+    glGetShaderiv(job.vs, GL_COMPILE_STATUS, &status);
+    if(!status) {
+        std::cout << "In " << job.vsfn << std::endl;
+        printShaderLog(job.vs);
+        error = "Vertex shader compilation failed";
+    }
+    if(error.empty()) {
+        glGetShaderiv(job.fs, GL_COMPILE_STATUS, &status);
+        if(!status) {
+            std::cout << "In " << job.fsfn << std::endl;
+            printShaderLog(job.fs);
+            error = "Fragment shader compilation failed";
+        }
+    }
+    if(error.empty()) {
+        glGetProgramiv(job.program, GL_LINK_STATUS, &status);
+        if(!status) {
+            printProgramLog(job.program);
+            error = "Shader program linking failed";
+        }
+    }
+
+    glDetachShader(job.program, job.vs);
+    glDetachShader(job.program, job.fs);
+    glDeleteShader(job.vs);
+    glDeleteShader(job.fs);
+    job.vs = job.fs = 0;
+    if(!error.empty()) {
+        glDeleteProgram(job.program);
+        job.program = 0;
+    } else if(binaries) {
+        saveBinary(job.path, job.program);
+    }
+    return error;
+}
+
+GLuint ShaderCache::loadBinary(const std::string& path) const {
+    FileView file(path);
+    Header header;
+    if(!file.ok() || file.size() < sizeof(header)) return 0;
+    memcpy(&header, file.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+       header.length != file.size() - sizeof(header)) {
+        return 0;
+    }
+
+    const GLuint program = glCreateProgram();
+    glProgramBinary(program, GLenum(header.format), file.data() + sizeof(header), GLsizei(header.length));
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked) return program;
+    // the driver changed in a way its strings don't show; compile instead, and
+    // drop the blob so it isn't offered again
+    glDeleteProgram(program);
+    std::remove(path.c_str());
+    return 0;
+}
+
+void ShaderCache::saveBinary(const std::string& path, GLuint program) const {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+    std::vector<char> blob(static_cast<size_t>(length));
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, blob.data());
+    if(written <= 0) return;
+
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.format = format;
+    header.length = uint64_t(written);
+
+    // a missing cache only costs a compile, so failures are just reported
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    const std::string temporary = path + ".tmp";
+    bool saved;
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(blob.data(), std::streamsize(written));
+        out.close();
+        saved = bool(out);
+    }
+    if(saved) {
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        saved = std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+    if(!saved) {
+        std::remove(temporary.c_str());
+        std::cerr << "ShaderCache: can't write '" << path << "'" << std::endl;
+    }
+}
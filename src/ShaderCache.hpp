@@ -0,0 +1,73 @@
+#pragma once
+
+#include "core.hpp"
+#include "Shader.hpp"
+
+// Shader programs linked once and kept as program binaries between runs.
+// A binary is keyed by a hash of both sources and the driver's vendor,
+// renderer and version strings, so an edited shader or an updated driver
+// compiles afresh, and a binary the driver still refuses falls back to the
+// sources. Drivers without binary formats (Apple's among them) always
+// compile from source.
+//
+// Programs a frame can do without compile in the background: loadAsync()
+// issues the compile and link and returns a shader that draws with a
+// fallback's program until poll() finds the link done. With
+// KHR_parallel_shader_compile poll() only takes finished programs; without
+// it, it finishes one program a frame, which a driver that compiles on its
+// own threads has usually done by then.
+
+class ShaderCache {
+public:
+    /// Binaries go into directory, which is created on the first save.
+    explicit ShaderCache(const std::string& directory);
+    ~ShaderCache();
+
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+    /// Links a program now, from its binary when one matches. Throws like
+    /// Shader's constructor if a source can't be read or doesn't build.
+    Shader* load(const std::string& name, const std::string& vsfn, const std::string& fsfn);
+
+    /// Starts a program and returns its shader at once, drawing with
+    /// fallback's program meanwhile; without a fallback it isn't ready() until
+    /// it links. A program that fails to build keeps the fallback, with the
+    /// log on stdout. Throws if a source can't be read. The shader has to
+    /// outlive the compile.
+    Shader* loadAsync(const std::string& name, const std::string& vsfn, const std::string& fsfn,
+                      const Shader* fallback = nullptr);
+
+    /// Once per frame: hands finished programs to their shaders. Returns how
+    /// many are still compiling.
+    size_t poll();
+
+    size_t pending() const { return jobs.size(); }
+    bool parallelCompile() const { return parallel; }
+    bool binaryFormats() const { return binaries; }
+
+private:
+    struct Job {
+        Shader* shader = nullptr;
+        std::string vsfn, fsfn;
+        std::string path;   // where the binary goes
+        GLuint vs = 0, fs = 0, program = 0;
+    };
+
+    std::string directory;
+    std::string driver;
+    bool binaries = false;
+    bool parallel = false;
+    std::vector<Job> jobs;
+
+    /// The program from path's binary, or 0.
+    GLuint loadBinary(const std::string& path) const;
+    void saveBinary(const std::string& path, GLuint program) const;
+
+    /// Reads the sources and returns 0 with job ready to finish(), or the
+    /// program restored from a matching binary.
+    GLuint start(Job& job, const std::string& name);
+    bool done(const Job& job) const;
+    /// Returns an empty string, and the program cached, if it linked.
+    std::string finish(Job& job);
+};
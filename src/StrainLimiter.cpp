@@ -0,0 +1,227 @@
+#include "StrainLimiter.hpp"
+#include "Cloth.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+    // springs per parallel task; smaller colors run on the calling thread
+    constexpr int GRAIN = 1024;
+}
+
+StrainLimiter::StrainLimiter() {
+    maxStretch = DEFAULT_MAX_STRETCH;
+    tolerance = 0.01f;
+    iterations = 8;
+    colorWords = 1;
+}
+
+void StrainLimiter::build(const std::vector<Particle*>& particles, const std::vector<SpringDamper*>& springs) {
+    // greedy coloring: each spring takes the lowest color neither end uses yet;
+    // a grid particle has at most 8 springs and needs one word of color bits,
+    // remeshed particles with more widen the bitsets as they go
+    colorWords = 1;
+    particleColors.assign(particles.size(), 0);
+    colorOf.resize(springs.size());
+    int numColors = 0;
+    for(size_t s = 0; s < springs.size(); s++) {
+        colorOf[s] = takeColor(springs[s]);
+        numColors = std::max(numColors, colorOf[s] + 1);
+    }
+
+    // counting sort by color
+    colorStart.assign(numColors + 1, 0);
+    for(int c : colorOf) colorStart[c + 1]++;
+    for(int c = 0; c < numColors; c++) colorStart[c + 1] += colorStart[c];
+
+    i1.resize(springs.size());
+    i2.resize(springs.size());
+    restLength.resize(springs.size());
+    slotOf.resize(springs.size());
+    std::vector<int> fill(colorStart.begin(), colorStart.end() - 1);
+    for(size_t s = 0; s < springs.size(); s++) {
+        const int slot = fill[colorOf[s]]++;
+        slotOf[s] = GLuint(slot);
+        i1[slot] = springs[s]->p1->particleID;
+        i2[slot] = springs[s]->p2->particleID;
+        // torn springs are no longer limited, as in update
+        restLength[slot] = springs[s]->springConstant > 0.0f ? springs[s]->restLength : INFINITY;
+    }
+}
+
+int StrainLimiter::takeColor(const SpringDamper* spring) {
+    const GLuint a = spring->p1->particleID, b = spring->p2->particleID;
+    colorBits(std::max(a, b));   // grow first, so neither lookup moves the other
+    int word = 0;
+    uint64_t taken = ~uint64_t(0);
+    for(; word < colorWords; word++) {
+        taken = colorBits(a)[word] | colorBits(b)[word];
+        if(taken != ~uint64_t(0)) break;
+    }
+    if(word == colorWords) {
+        // every color so far meets at one of the ends
+        widenColors();
+        taken = 0;
+    }
+    int bit = 0;
+    while(taken & (uint64_t(1) << bit)) bit++;
+    const int c = word * 64 + bit;
+    setColor(a, c, true);
+    setColor(b, c, true);
+    return c;
+}
+
+uint64_t* StrainLimiter::colorBits(GLuint particle) {
+    const size_t end = (size_t(particle) + 1) * colorWords;
+    if(end > particleColors.size()) particleColors.resize(end, 0);
+    return &particleColors[size_t(particle) * colorWords];
+}
+
+void StrainLimiter::setColor(GLuint particle, int color, bool used) {
+    const uint64_t bit = uint64_t(1) << (color % 64);
+    uint64_t& word = colorBits(particle)[color / 64];
+    word = used ? word | bit : word & ~bit;
+}
+
+void StrainLimiter::widenColors() {
+    const size_t n = particleColors.size() / colorWords;
+    std::vector<uint64_t> wider(n * (colorWords + 1), 0);
+    for(size_t i = 0; i < n; i++) {
+        std::copy_n(&particleColors[i * colorWords], colorWords, &wider[i * (colorWords + 1)]);
+    }
+    particleColors.swap(wider);
+    colorWords++;
+}
+
+void StrainLimiter::update(const std::vector<SpringDamper*>& springs, const std::vector<GLuint>& changed) {
+    // an end moved to a new particle brings its color along; no other spring
+    // of that color meets the old particle, so it gives the color up
+    std::vector<GLuint> added;
+    for(GLuint s : changed) {
+        if(s >= slotOf.size()) {
+            added.push_back(s);
+            continue;
+        }
+        const GLuint slot = slotOf[s];
+        setColor(i1[slot], colorOf[s], false);
+        setColor(i2[slot], colorOf[s], false);
+        i1[slot] = springs[s]->p1->particleID;
+        i2[slot] = springs[s]->p2->particleID;
+        restLength[slot] = springs[s]->springConstant > 0.0f ? springs[s]->restLength : INFINITY;
+        setColor(i1[slot], colorOf[s], true);
+        setColor(i2[slot], colorOf[s], true);
+    }
+    if(added.empty()) return;
+
+    // new springs take free colors and are merged into the sorted arrays in one pass
+    colorOf.resize(springs.size());
+    int numColors = colors();
+    for(GLuint s : added) {
+        colorOf[s] = takeColor(springs[s]);
+        numColors = std::max(numColors, colorOf[s] + 1);
+    }
+    std::vector<std::vector<GLuint>> extra(numColors);
+    for(GLuint s : added) {
+        extra[colorOf[s]].push_back(s);
+    }
+
+    // colors opened by the new springs start out empty
+    colorStart.resize(numColors + 1, colorStart.back());
+    std::vector<int> start(numColors + 1, 0);
+    for(int c = 0; c < numColors; c++) {
+        start[c + 1] = start[c] + colorStart[c + 1] - colorStart[c] + int(extra[c].size());
+    }
+
+    // old slots move up by the new springs merged into earlier colors
+    for(size_t s = 0; s < slotOf.size(); s++) {
+        const int c = colorOf[s];
+        slotOf[s] += start[c] - colorStart[c];
+    }
+    slotOf.resize(springs.size());
+
+    std::vector<GLuint> n1(start[numColors]), n2(start[numColors]);
+    std::vector<float> rest(start[numColors]);
+    for(int c = 0; c < numColors; c++) {
+        int slot = start[c];
+        for(int k = colorStart[c]; k < colorStart[c + 1]; k++, slot++) {
+            n1[slot] = i1[k];
+            n2[slot] = i2[k];
+            rest[slot] = restLength[k];
+        }
+        for(GLuint s : extra[c]) {
+            slotOf[s] = GLuint(slot);
+            n1[slot] = springs[s]->p1->particleID;
+            n2[slot] = springs[s]->p2->particleID;
+            rest[slot++] = springs[s]->springConstant > 0.0f ? springs[s]->restLength : INFINITY;
+        }
+    }
+
+    i1.swap(n1);
+    i2.swap(n2);
+    restLength.swap(rest);
+    colorStart.swap(start);
+}
+
+int StrainLimiter::run(const std::vector<Particle*>& particles, const std::vector<GLuint>& pinned, float timestep) {
+    const size_t n = particles.size();
+    px.resize(n); py.resize(n); pz.resize(n); w.resize(n);
+    x0.resize(n); y0.resize(n); z0.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        const glm::vec3 p = particles[i]->position;
+        px[i] = x0[i] = p.x;
+        py[i] = y0[i] = p.y;
+        pz[i] = z0[i] = p.z;
+        w[i] = 1.0f / particles[i]->mass;
+    }
+    for(GLuint i : pinned) {
+        w[i] = 0.0f;
+    }
+
+    const float stretch = maxStretch;
+    int sweep = 0;
+    while(sweep < iterations) {
+        sweep++;
+
+        std::atomic<float> worst(0.0f);
+        for(int c = 0; c + 1 < int(colorStart.size()); c++) {
+            const int begin = colorStart[c], count = colorStart[c + 1] - begin;
+            const int tasks = (count + GRAIN - 1) / GRAIN;
+
+            ThreadPool::shared().parallelFor(0, tasks, [&](int taskBegin, int taskEnd) {
+                const int end = std::min(begin + taskEnd * GRAIN, begin + count);
+                float localWorst = 0.0f;
+                for(int s = begin + taskBegin * GRAIN; s < end; s++) {
+                    const GLuint a = i1[s], b = i2[s];
+                    const float dx = px[b] - px[a], dy = py[b] - py[a], dz = pz[b] - pz[a];
+                    const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+                    const float limit = stretch * restLength[s];
+                    const float weight = w[a] + w[b];
+                    if(length <= limit || weight == 0.0f) continue;
+
+                    localWorst = std::max(localWorst, length / limit - 1.0f);
+                    const float k = (length - limit) / (length * weight);
+                    px[a] += w[a] * k * dx; py[a] += w[a] * k * dy; pz[a] += w[a] * k * dz;
+                    px[b] -= w[b] * k * dx; py[b] -= w[b] * k * dy; pz[b] -= w[b] * k * dz;
+                }
+
+                float seen = worst.load();
+                while(localWorst > seen && !worst.compare_exchange_weak(seen, localWorst)) {}
+            });
+        }
+
+        // worst is measured before each spring's own correction, so a sweep
+        // that found nothing over tolerance left everything within it
+        if(worst.load() < tolerance) break;
+    }
+
+    // positions take the correction, velocities the matching change over the step
+    const float invDt = 1.0f / timestep;
+    for(size_t i = 0; i < n; i++) {
+        const glm::vec3 delta(px[i] - x0[i], py[i] - y0[i], pz[i] - z0[i]);
+        particles[i]->position += delta;
+        particles[i]->velocity += delta * invDt;
+    }
+    return sweep;
+}
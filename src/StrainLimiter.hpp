@@ -0,0 +1,57 @@
+#pragma once
+
+#include "core.hpp"
+
+struct Particle;
+struct SpringDamper;
+
+// Provot-style strain limiting, run on positions after integration. Every
+// spring longer than maxStretch * restLength is shortened back to that length,
+// splitting the correction by inverse mass (pinned ends do not move), and the
+// particle velocities get the same correction / dt.
+//
+// The springs are graph-colored at build time so no two springs of one color
+// share a particle; each color is then projected in parallel without locks,
+// Gauss-Seidel style from color to color. Sweeps stop as soon as no spring is
+// more than tolerance past its limit.
+
+class StrainLimiter {
+public:
+    float maxStretch;   // allowed length / restLength
+    float tolerance;    // relative over-stretch that counts as converged
+    int iterations;     // sweep cap per step
+
+    StrainLimiter();
+
+    void build(const std::vector<Particle*>& particles, const std::vector<SpringDamper*>& springs);
+
+    /// Re-reads the ends of the changed springs after a topology edit. Moving an
+    /// end to a copy of its particle keeps the coloring valid; a spring with no
+    /// stiffness left (torn) is no longer limited, and springs appended since the
+    /// last call are colored and merged in.
+    void update(const std::vector<SpringDamper*>& springs, const std::vector<GLuint>& changed);
+
+    /// Returns the number of sweeps taken.
+    int run(const std::vector<Particle*>& particles, const std::vector<GLuint>& pinned, float timestep);
+
+    int colors() const { return int(colorStart.size()) - 1; }
+
+private:
+    // springs sorted by color; color c is [colorStart[c], colorStart[c + 1])
+    std::vector<GLuint> i1, i2;
+    std::vector<float> restLength;
+    std::vector<int> colorStart;
+    std::vector<GLuint> slotOf;   // spring index -> position in the sorted arrays
+    std::vector<int> colorOf;     // spring index -> color
+    std::vector<uint64_t> particleColors;   // colors used at each particle, colorWords words of bits each
+    int colorWords;
+
+    // particle state gathered once per step
+    std::vector<float> px, py, pz, w;
+    std::vector<float> x0, y0, z0;
+
+    int takeColor(const SpringDamper* spring);
+    uint64_t* colorBits(GLuint particle);   // grows the bitsets to cover particle
+    void setColor(GLuint particle, int color, bool used);
+    void widenColors();
+};
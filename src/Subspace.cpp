@@ -0,0 +1,514 @@
+#include "Subspace.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// same drag as TrianglePass: |F| per corner = 0.5 * rho * Cd * |v|^2 * A * dot(v^, n) / 3
+#define DRAG_SCALE (AIR_DENSITY * DRAG_COFF / 12.0f)
+
+namespace {
+    // most training frames the cubature fit looks at
+    constexpr size_t CUBATURE_FRAMES = 100;
+
+    // cyclic Jacobi on the symmetric n x n matrix a (row-major): a ends up
+    // diagonal and the columns of v hold its eigenvectors
+    void jacobi(std::vector<double>& a, std::vector<double>& v, int n) {
+        v.assign(size_t(n) * n, 0.0);
+        double total = 0.0;
+        for(int i = 0; i < n; i++) {
+            v[size_t(i) * n + i] = 1.0;
+            for(int j = 0; j < n; j++) total += a[size_t(i) * n + j] * a[size_t(i) * n + j];
+        }
+
+        for(int sweep = 0; sweep < 50; sweep++) {
+            double off = 0.0;
+            for(int p = 0; p < n; p++) {
+                for(int q = p + 1; q < n; q++) off += a[size_t(p) * n + q] * a[size_t(p) * n + q];
+            }
+            if(off <= 1e-24 * total) break;
+
+            for(int p = 0; p < n; p++) {
+                for(int q = p + 1; q < n; q++) {
+                    const double apq = a[size_t(p) * n + q];
+                    if(apq == 0.0) continue;
+                    const double theta = (a[size_t(q) * n + q] - a[size_t(p) * n + p]) / (2.0 * apq);
+                    const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                    const double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                    for(int k = 0; k < n; k++) {
+                        double& kp = a[size_t(k) * n + p];
+                        double& kq = a[size_t(k) * n + q];
+                        const double x = kp, y = kq;
+                        kp = c * x - s * y;
+                        kq = s * x + c * y;
+                    }
+                    for(int k = 0; k < n; k++) {
+                        double& pk = a[size_t(p) * n + k];
+                        double& qk = a[size_t(q) * n + k];
+                        const double x = pk, y = qk;
+                        pk = c * x - s * y;
+                        qk = s * x + c * y;
+                    }
+                    for(int k = 0; k < n; k++) {
+                        double& kp = v[size_t(k) * n + p];
+                        double& kq = v[size_t(k) * n + q];
+                        const double x = kp, y = kq;
+                        kp = c * x - s * y;
+                        kq = s * x + c * y;
+                    }
+                }
+            }
+        }
+    }
+
+    // solves the symmetric positive system a x = b in place (Gaussian elimination, partial pivoting)
+    void solve(std::vector<double>& a, std::vector<double>& b, int n) {
+        for(int col = 0; col < n; col++) {
+            int pivot = col;
+            for(int r = col + 1; r < n; r++) {
+                if(std::abs(a[size_t(r) * n + col]) > std::abs(a[size_t(pivot) * n + col])) pivot = r;
+            }
+            if(pivot != col) {
+                for(int k = 0; k < n; k++) std::swap(a[size_t(col) * n + k], a[size_t(pivot) * n + k]);
+                std::swap(b[col], b[pivot]);
+            }
+            const double d = a[size_t(col) * n + col];
+            if(d == 0.0) continue;
+            for(int r = col + 1; r < n; r++) {
+                const double f = a[size_t(r) * n + col] / d;
+                if(f == 0.0) continue;
+                for(int k = col; k < n; k++) a[size_t(r) * n + k] -= f * a[size_t(col) * n + k];
+                b[r] -= f * b[col];
+            }
+        }
+        for(int r = n - 1; r >= 0; r--) {
+            double x = b[r];
+            for(int k = r + 1; k < n; k++) x -= a[size_t(r) * n + k] * b[k];
+            const double d = a[size_t(r) * n + r];
+            b[r] = d != 0.0 ? x / d : 0.0;
+        }
+    }
+}
+
+SubspaceModel::SubspaceModel() {
+    dimension = 0;
+    vertexCount = 0;
+    cubatureError = 0.0f;
+}
+
+void SubspaceModel::record(const Cloth& cloth, glm::vec3 windSpeed) {
+    // a diverged run would poison the whole basis
+    for(const Particle* p : cloth.particles) {
+        if(!std::isfinite(p->position.x + p->position.y + p->position.z)) return;
+    }
+    for(const Particle* p : cloth.particles) {
+        framePositions.insert(framePositions.end(), { p->position.x, p->position.y, p->position.z });
+        frameVelocities.insert(frameVelocities.end(), { p->velocity.x, p->velocity.y, p->velocity.z });
+        frameNormals.insert(frameNormals.end(), { p->normal.x, p->normal.y, p->normal.z });
+    }
+    windSpeeds.push_back(windSpeed);
+}
+
+void SubspaceModel::build(const Cloth& cloth, int modes, int samples) {
+    const size_t n = cloth.particles.size();
+    const size_t rowCount = 3 * n;
+    const int m = int(windSpeeds.size());
+    dimension = 0;
+    if(m == 0 || framePositions.size() != size_t(m) * rowCount) return;
+
+    vertexCount = n;
+    mass.resize(n);
+    for(size_t i = 0; i < n; i++) {
+        mass[i] = cloth.particles[i]->mass;
+    }
+
+    // mean pose and normals
+    rest.assign(2 * rowCount, 0.0f);
+    for(int t = 0; t < m; t++) {
+        for(size_t row = 0; row < rowCount; row++) {
+            rest[row] += framePositions[t * rowCount + row];
+            rest[rowCount + row] += frameNormals[t * rowCount + row];
+        }
+    }
+    for(float& x : rest) x /= float(m);
+
+    // PCA by the snapshot method: eigenvectors of the m x m Gram matrix of the
+    // mass-weighted displacements give the principal directions directly
+    std::vector<double> displacement(size_t(m) * rowCount);
+    for(int t = 0; t < m; t++) {
+        for(size_t row = 0; row < rowCount; row++) {
+            displacement[t * rowCount + row] = double(framePositions[t * rowCount + row]) - rest[row];
+        }
+    }
+    std::vector<double> gram(size_t(m) * m);
+    for(int t = 0; t < m; t++) {
+        for(int s = t; s < m; s++) {
+            double dot = 0.0;
+            for(size_t row = 0; row < rowCount; row++) {
+                dot += mass[row / 3] * displacement[t * rowCount + row] * displacement[s * rowCount + row];
+            }
+            gram[size_t(t) * m + s] = gram[size_t(s) * m + t] = dot;
+        }
+    }
+    std::vector<double> vectors;
+    jacobi(gram, vectors, m);
+
+    std::vector<int> order(m);
+    for(int k = 0; k < m; k++) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](int x, int y) {
+        return gram[size_t(x) * m + x] > gram[size_t(y) * m + y];
+    });
+    const double largest = gram[size_t(order[0]) * m + order[0]];
+    int r = 0;
+    while(r < std::min(modes, m) && largest > 0.0 && gram[size_t(order[r]) * m + order[r]] > 1e-8 * largest) r++;
+    dimension = r;
+
+    // U_k = D v_k / sqrt(lambda_k) is mass-orthonormal, frame t sits at
+    // q_k = sqrt(lambda_k) v_k[t], and the normals take the least-squares map
+    // of q, which is (N - mean) q_k / lambda_k since the q_k are orthogonal
+    basis.assign(size_t(r) * 2 * rowCount, 0.0f);
+    coordinates.assign(size_t(m) * r, 0.0f);
+    for(int k = 0; k < r; k++) {
+        const double lambda = gram[size_t(order[k]) * m + order[k]];
+        float* column = basis.data() + size_t(k) * 2 * rowCount;
+        for(int t = 0; t < m; t++) {
+            const double vt = vectors[size_t(t) * m + order[k]];
+            const double qt = std::sqrt(lambda) * vt;
+            coordinates[size_t(t) * r + k] = float(qt);
+            for(size_t row = 0; row < rowCount; row++) {
+                column[row] += float(displacement[t * rowCount + row] * vt / std::sqrt(lambda));
+                column[rowCount + row] += float((frameNormals[t * rowCount + row] - rest[rowCount + row]) * qt / lambda);
+            }
+        }
+    }
+
+    rows.resize(rowCount * r);
+    for(size_t row = 0; row < rowCount; row++) {
+        for(int k = 0; k < r; k++) rows[row * r + k] = basis[size_t(k) * 2 * rowCount + row];
+    }
+
+    // gravity is linear in the pose, so its reduced force is exact
+    gravity.assign(r, 0.0f);
+    for(size_t i = 0; i < n; i++) {
+        for(int k = 0; k < r; k++) gravity[k] += rows[(3 * i + 1) * r + k] * mass[i] * (GRAVITY / MASS);
+    }
+
+    triangles.clear();
+    elements.clear();
+    for(const SpringDamper* s : cloth.springDampers) {
+        if(s->springConstant == 0.0f) continue;
+        elements.push_back({ s->p1->particleID, s->p2->particleID, NONE, s->springConstant, s->dampingConstant, s->restLength });
+    }
+    for(const Triangle* t : cloth.triangles) {
+        elements.push_back({ t->p1->particleID, t->p2->particleID, t->p3->particleID, 0.0f, 0.0f, 0.0f });
+        triangles.insert(triangles.end(), { t->p1->particleID, t->p2->particleID, t->p3->particleID });
+    }
+
+    fitCubature(samples);
+}
+
+void SubspaceModel::frameState(size_t frame, float* q, float* qdot) const {
+    const int r = dimension;
+    const float* v = frameVelocities.data() + frame * 3 * vertexCount;
+    for(int k = 0; k < r; k++) {
+        q[k] = coordinates[frame * r + k];
+        qdot[k] = 0.0f;
+    }
+    // qdot = U^T M v
+    for(size_t row = 0; row < 3 * vertexCount; row++) {
+        const float mv = mass[row / 3] * v[row];
+        for(int k = 0; k < r; k++) qdot[k] += rows[row * r + k] * mv;
+    }
+}
+
+int SubspaceModel::elementForce(const Element& e, const glm::vec3* x, const glm::vec3* v, glm::vec3 windSpeed,
+                                glm::vec3* f) {
+    if(e.c == NONE) {
+        // as SpringDamper::computeForce
+        const glm::vec3 edge = x[1] - x[0];
+        const float length = glm::length(edge);
+        if(length == 0.0f) return 0;
+        const glm::vec3 dir = edge / length;
+        const float force = e.stiffness * (length - e.restLength) - e.damping * glm::dot(v[0] - v[1], dir);
+        f[0] = force * dir;
+        f[1] = -f[0];
+        return 2;
+    }
+    // as the drag in TrianglePass
+    const glm::vec3 cross = glm::cross(x[1] - x[0], x[2] - x[0]);
+    const float len = glm::length(cross);
+    if(len == 0.0f) return 0;
+    const glm::vec3 tv = (v[0] + v[1] + v[2]) * (1.0f / 3.0f) - windSpeed;
+    f[0] = f[1] = f[2] = -DRAG_SCALE * glm::length(tv) * glm::dot(tv, cross) / len * cross;
+    return 3;
+}
+
+void SubspaceModel::addElementForce(const Element& e, const float* q, const float* qdot, glm::vec3 windSpeed,
+                                    float* out) const {
+    const int r = dimension;
+    const GLuint id[3] = { e.a, e.b, e.c };
+    const int corners = e.c == NONE ? 2 : 3;
+
+    glm::vec3 x[3], v[3], f[3];
+    for(int c = 0; c < corners; c++) {
+        for(int d = 0; d < 3; d++) {
+            const float* row = rows.data() + (3 * id[c] + d) * r;
+            float px = rest[3 * id[c] + d], vx = 0.0f;
+            for(int k = 0; k < r; k++) {
+                px += row[k] * q[k];
+                vx += row[k] * qdot[k];
+            }
+            x[c][d] = px;
+            v[c][d] = vx;
+        }
+    }
+
+    const int n = elementForce(e, x, v, windSpeed, f);
+    for(int c = 0; c < n; c++) {
+        for(int d = 0; d < 3; d++) {
+            const float* row = rows.data() + (3 * id[c] + d) * r;
+            for(int k = 0; k < r; k++) out[k] += row[k] * f[c][d];
+        }
+    }
+}
+
+void SubspaceModel::fitCubature(int samples) {
+    const int r = dimension;
+    const size_t ne = elements.size();
+    const size_t stride = std::max<size_t>(1, (frames() + CUBATURE_FRAMES - 1) / CUBATURE_FRAMES);
+    std::vector<size_t> training;
+    for(size_t t = 0; t < frames(); t += stride) training.push_back(t);
+    const size_t height = training.size() * r;
+
+    // column e holds element e's reduced force over all training frames, and the
+    // target is their sum; each frame is scaled to unit target so small forces count
+    std::vector<float> columns(ne * height, 0.0f);
+    std::vector<double> target(height, 0.0);
+    std::vector<float> q(r), qdot(r);
+    for(size_t f = 0; f < training.size(); f++) {
+        frameState(training[f], q.data(), qdot.data());
+        for(size_t e = 0; e < ne; e++) {
+            addElementForce(elements[e], q.data(), qdot.data(), windSpeeds[training[f]],
+                            columns.data() + e * height + f * r);
+        }
+        double norm = 0.0;
+        for(size_t e = 0; e < ne; e++) {
+            for(int k = 0; k < r; k++) target[f * r + k] += columns[e * height + f * r + k];
+        }
+        for(int k = 0; k < r; k++) norm += target[f * r + k] * target[f * r + k];
+        const double scale = norm > 0.0 ? 1.0 / std::sqrt(norm) : 0.0;
+        for(int k = 0; k < r; k++) target[f * r + k] *= scale;
+        for(size_t e = 0; e < ne; e++) {
+            for(int k = 0; k < r; k++) columns[e * height + f * r + k] *= float(scale);
+        }
+    }
+
+    std::vector<double> columnNorm(ne, 0.0);
+    for(size_t e = 0; e < ne; e++) {
+        for(size_t h = 0; h < height; h++) columnNorm[e] += double(columns[e * height + h]) * columns[e * height + h];
+        columnNorm[e] = std::sqrt(columnNorm[e]);
+    }
+    double targetNorm = 0.0;
+    for(double x : target) targetNorm += x * x;
+    targetNorm = std::sqrt(targetNorm);
+
+    // greedy NNLS: take the element that best matches the residual, refit all
+    // taken weights by least squares and drop any that come out negative
+    sampled.clear();
+    weights.clear();
+    std::vector<double> residual = target;
+    std::vector<char> tried(ne, 0);
+    std::vector<double> w;
+    cubatureError = 1.0f;
+    while(int(sampled.size()) < samples && targetNorm > 0.0) {
+        size_t best = ne;
+        double bestScore = 0.0;
+        for(size_t e = 0; e < ne; e++) {
+            if(tried[e] || columnNorm[e] == 0.0) continue;
+            double dot = 0.0;
+            for(size_t h = 0; h < height; h++) dot += columns[e * height + h] * residual[h];
+            if(dot / columnNorm[e] > bestScore) {
+                bestScore = dot / columnNorm[e];
+                best = e;
+            }
+        }
+        if(best == ne) break;
+        tried[best] = 1;
+        sampled.push_back(GLuint(best));
+
+        for(;;) {
+            const int k = int(sampled.size());
+            std::vector<double> normal(size_t(k) * k);
+            w.assign(k, 0.0);
+            for(int i = 0; i < k; i++) {
+                const float* ci = columns.data() + sampled[i] * height;
+                for(size_t h = 0; h < height; h++) w[i] += ci[h] * target[h];
+                for(int j = i; j < k; j++) {
+                    const float* cj = columns.data() + sampled[j] * height;
+                    double dot = 0.0;
+                    for(size_t h = 0; h < height; h++) dot += double(ci[h]) * cj[h];
+                    normal[size_t(i) * k + j] = normal[size_t(j) * k + i] = dot;
+                }
+                normal[size_t(i) * k + i] *= 1.0 + 1e-9;
+            }
+            solve(normal, w, k);
+
+            const int worst = int(std::min_element(w.begin(), w.end()) - w.begin());
+            if(w[worst] >= 0.0) break;
+            sampled.erase(sampled.begin() + worst);
+            if(sampled.empty()) {
+                w.clear();
+                break;
+            }
+        }
+
+        residual = target;
+        for(size_t i = 0; i < sampled.size(); i++) {
+            const float* ci = columns.data() + sampled[i] * height;
+            for(size_t h = 0; h < height; h++) residual[h] -= w[i] * ci[h];
+        }
+        double norm = 0.0;
+        for(double x : residual) norm += x * x;
+        cubatureError = float(std::sqrt(norm) / targetNorm);
+        if(cubatureError < 1e-3f) break;
+    }
+
+    weights.assign(w.begin(), w.end());
+
+    // the basis and mean rows of every sampled corner, so a step only
+    // reconstructs those
+    std::vector<GLuint> slotOf(vertexCount, NONE);
+    cornerSlots.clear();
+    std::vector<GLuint> vertices;
+    for(GLuint s : sampled) {
+        for(GLuint i : { elements[s].a, elements[s].b, elements[s].c }) {
+            if(i == NONE) continue;
+            if(slotOf[i] == NONE) {
+                slotOf[i] = GLuint(vertices.size());
+                vertices.push_back(i);
+            }
+            cornerSlots.push_back(slotOf[i]);
+        }
+    }
+    const size_t cornerRows = 3 * vertices.size();
+    cornerRest.resize(cornerRows);
+    cornerBasis.resize(size_t(r) * cornerRows);
+    for(size_t j = 0; j < vertices.size(); j++) {
+        for(int d = 0; d < 3; d++) {
+            const size_t row = 3 * vertices[j] + d;
+            cornerRest[3 * j + d] = rest[row];
+            for(int k = 0; k < r; k++) cornerBasis[k * cornerRows + 3 * j + d] = rows[row * r + k];
+        }
+    }
+}
+
+void SubspaceModel::force(const float* q, const float* qdot, glm::vec3 windSpeed, float* out) const {
+    const int r = dimension;
+    const size_t height = cornerRest.size();
+
+    // sampled corner positions and velocities, one basis column at a time
+    std::vector<float> x(cornerRest), v(height, 0.0f), f(height, 0.0f);
+    for(int k = 0; k < r; k++) {
+        const float* __restrict column = cornerBasis.data() + k * height;
+        float* __restrict ox = x.data();
+        float* __restrict ov = v.data();
+        const float qk = q[k], vk = qdot[k];
+        for(size_t row = 0; row < height; row++) {
+            ox[row] += qk * column[row];
+            ov[row] += vk * column[row];
+        }
+    }
+
+    // weighted element forces, summed per corner
+    const GLuint* slot = cornerSlots.data();
+    for(size_t s = 0; s < sampled.size(); s++) {
+        const Element& e = elements[sampled[s]];
+        const int corners = e.c == NONE ? 2 : 3;
+        glm::vec3 ex[3], ev[3], ef[3];
+        for(int c = 0; c < corners; c++) {
+            ex[c] = glm::vec3(x[3 * slot[c]], x[3 * slot[c] + 1], x[3 * slot[c] + 2]);
+            ev[c] = glm::vec3(v[3 * slot[c]], v[3 * slot[c] + 1], v[3 * slot[c] + 2]);
+        }
+        const int n = elementForce(e, ex, ev, windSpeed, ef);
+        for(int c = 0; c < n; c++) {
+            f[3 * slot[c]]     += weights[s] * ef[c].x;
+            f[3 * slot[c] + 1] += weights[s] * ef[c].y;
+            f[3 * slot[c] + 2] += weights[s] * ef[c].z;
+        }
+        slot += corners;
+    }
+
+    // out = U^T M g + U_corners^T f
+    for(int k = 0; k < r; k++) {
+        const float* __restrict column = cornerBasis.data() + k * height;
+        float sum = 0.0f;
+        for(size_t row = 0; row < height; row++) sum += column[row] * f[row];
+        out[k] = gravity[k] + sum;
+    }
+}
+
+void SubspaceModel::reconstruct(const float* q, vec4s& positions, vec4s& normals) const {
+    // rest + basis * q, one column at a time so the inner loop is a plain axpy
+    const size_t height = 6 * vertexCount;
+    std::vector<float> stacked(rest);
+    for(int k = 0; k < dimension; k++) {
+        const float* __restrict column = basis.data() + k * height;
+        float* __restrict out = stacked.data();
+        const float qk = q[k];
+        for(size_t row = 0; row < height; row++) out[row] += qk * column[row];
+    }
+
+    positions.resize(vertexCount);
+    normals.resize(vertexCount);
+    const float* normal = stacked.data() + 3 * vertexCount;
+    for(size_t i = 0; i < vertexCount; i++) {
+        positions[i] = glm::vec4(stacked[3 * i], stacked[3 * i + 1], stacked[3 * i + 2], 1);
+        const glm::vec3 nrm(normal[3 * i], normal[3 * i + 1], normal[3 * i + 2]);
+        const float len = glm::length(nrm);
+        normals[i] = glm::vec4(len > 0.0f ? nrm / len : DEFAULT_NORMAL, 0);
+    }
+}
+
+SubspaceCloth::SubspaceCloth(const std::string& name, const SubspaceModel* model, size_t frame) : Mesh(name) {
+    this->model = model;
+    q.resize(model->modes());
+    qdot.resize(model->modes());
+    acceleration.resize(model->modes());
+    model->frameState(std::min(frame, model->frames() - 1), q.data(), qdot.data());
+
+    vec4s positions;
+    vec4s normals;
+    model->reconstruct(q.data(), positions, normals);
+    uploadBuffers(positions, normals, model->indices(), GL_DYNAMIC_DRAW);
+}
+
+void SubspaceCloth::update(glm::vec3 windSpeed) {
+    // the basis is mass-orthonormal, so the reduced force is the acceleration;
+    // semi-implicit Euler, the reduced counterpart of the full Verlet step
+    model->force(q.data(), qdot.data(), windSpeed, acceleration.data());
+    for(size_t k = 0; k < q.size(); k++) {
+        qdot[k] += TIME_STEP * acceleration[k];
+        q[k] += TIME_STEP * qdot[k];
+    }
+    upload();
+}
+
+void SubspaceCloth::upload() {
+    vec4s positions;
+    vec4s normals;
+    model->reconstruct(q.data(), positions, normals);
+
+    glBindVertexArray(VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec4), normals.data(), GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core.hpp"
+#include "Mesh.hpp"
+
+class Cloth;
+
+// Reduced-order cloth for background flags and banners. Frames of a full
+// Cloth run are recorded, and their principal components become a basis U:
+// every pose is x = rest + U q for a handful of coordinates q. The basis is
+// mass-orthonormal (U^T M U = I), so the reduced equations of motion are just
+// q'' = U^T f(rest + U q, U q').
+//
+// Evaluating f on every element would cost as much as the full cloth, so the
+// reduced force is approximated by cubature: a few sample springs and
+// triangles with non-negative weights, fitted by greedy NNLS to the exact
+// reduced forces of the recorded frames. Gravity is exact and precomputed.
+// Rendering needs positions and normals for every vertex; normals get a
+// linear map of q fitted to the recorded ones, so reconstruction is one
+// matrix-vector product over the stacked basis.
+//
+// One SubspaceModel is shared by any number of SubspaceCloth instances, each of
+// which only holds its coordinates, its wind and its buffers. Bending and
+// strain limiting shape the recorded poses, and so the basis, but are not
+// cubature elements.
+
+class SubspaceModel {
+public:
+    SubspaceModel();
+
+    /// Records the cloth's current state, driven by uniform windSpeed. Frames
+    /// with non-finite positions are skipped.
+    void record(const Cloth& cloth, glm::vec3 windSpeed);
+
+    /// Builds a basis of up to modes coordinates from the recorded frames and
+    /// fits up to samples cubature elements, using the cloth's topology and masses.
+    void build(const Cloth& cloth, int modes, int samples);
+
+    bool ready() const { return dimension > 0; }
+    int modes() const { return dimension; }
+    size_t frames() const { return windSpeeds.size(); }
+    size_t samples() const { return sampled.size(); }
+    float fitError() const { return cubatureError; }   // relative, over the training frames
+    const GLuints& indices() const { return triangles; }
+
+    /// Reduced coordinates and velocities of a recorded frame.
+    void frameState(size_t frame, float* q, float* qdot) const;
+
+    /// Reduced force (= acceleration) at q, qdot in uniform wind.
+    void force(const float* q, const float* qdot, glm::vec3 windSpeed, float* out) const;
+
+    /// Positions and normals of every vertex at q.
+    void reconstruct(const float* q, vec4s& positions, vec4s& normals) const;
+
+private:
+    // a spring (c == NONE) or a drag triangle
+    struct Element {
+        GLuint a, b, c;
+        float stiffness, damping, restLength;
+    };
+    static constexpr GLuint NONE = ~0u;
+
+    // recorded frames, 3 floats per particle each
+    std::vector<float> framePositions, frameVelocities, frameNormals;
+    std::vector<glm::vec3> windSpeeds;
+
+    int dimension;
+    size_t vertexCount;
+    std::vector<float> mass;
+    std::vector<float> rest;         // 6n rows: mean positions, then mean normals
+    std::vector<float> basis;        // column-major over rest's rows, [k * 6n + row]
+    std::vector<float> rows;         // position rows of the basis, [(3i + d) * modes + k]
+    std::vector<float> coordinates;  // q of every recorded frame, [frame * modes + k]
+    std::vector<float> gravity;      // U^T M g
+    GLuints triangles;
+
+    std::vector<Element> elements;
+    std::vector<GLuint> sampled;     // cubature elements
+    std::vector<float> weights;
+    float cubatureError;
+
+    // the corners of the sampled elements, deduplicated
+    std::vector<GLuint> cornerSlots;   // 2 or 3 per sampled element
+    std::vector<float> cornerRest;     // 3 rows per corner
+    std::vector<float> cornerBasis;    // column-major, [k * rows + row]
+
+    // forces on the corners at x with velocities v; returns the corner count, 0 if degenerate
+    static int elementForce(const Element& e, const glm::vec3* x, const glm::vec3* v, glm::vec3 windSpeed,
+                            glm::vec3* f);
+    // adds U^T f_e(q, qdot) to out
+    void addElementForce(const Element& e, const float* q, const float* qdot, glm::vec3 windSpeed,
+                         float* out) const;
+    void fitCubature(int samples);
+};
+
+// One reduced cloth, drawn with the model's topology.
+class SubspaceCloth : public Mesh {
+public:
+    /// Starts from a recorded frame of the model, so instances need not move in step.
+    SubspaceCloth(const std::string& name, const SubspaceModel* model, size_t frame = 0);
+
+    void update(glm::vec3 windSpeed);
+
+private:
+    const SubspaceModel* model;
+    std::vector<float> q, qdot, acceleration;
+
+    void upload();
+};
@@ -0,0 +1,252 @@
+#include "Tearing.hpp"
+#include "Cloth.hpp"
+
+#include <algorithm>
+
+namespace {
+    Particle*& cornerRef(Triangle* t, const Particle* p) {
+        return t->p1 == p ? t->p1 : t->p2 == p ? t->p2 : t->p3;
+    }
+
+    bool hasCorner(const Triangle* t, const Particle* p) {
+        return t->p1 == p || t->p2 == p || t->p3 == p;
+    }
+}
+
+Tearing::Tearing() {
+    tearStretch = DEFAULT_TEAR_STRETCH;
+    maxSplitsPerStep = 64;
+}
+
+void Tearing::buildAdjacency(const Cloth& cloth) {
+    particleTriangles.assign(cloth.particles.size(), {});
+    particleSprings.assign(cloth.particles.size(), {});
+    for(size_t t = 0; t < cloth.triangles.size(); t++) {
+        const Triangle* tri = cloth.triangles[t];
+        particleTriangles[tri->p1->particleID].push_back(GLuint(t));
+        particleTriangles[tri->p2->particleID].push_back(GLuint(t));
+        particleTriangles[tri->p3->particleID].push_back(GLuint(t));
+    }
+    for(size_t s = 0; s < cloth.springDampers.size(); s++) {
+        particleSprings[cloth.springDampers[s]->p1->particleID].push_back(GLuint(s));
+        particleSprings[cloth.springDampers[s]->p2->particleID].push_back(GLuint(s));
+    }
+    splitThisStep.assign(cloth.particles.size(), 0);
+}
+
+int Tearing::run(Cloth& cloth) {
+    if(particleTriangles.size() != cloth.particles.size()) {
+        buildAdjacency(cloth);
+    }
+    changedTriangles.clear();
+    changedSprings.clear();
+    splitParticles.clear();
+
+    int splits = 0;
+    for(size_t s = 0; s < cloth.springDampers.size() && splits < maxSplitsPerStep; s++) {
+        const SpringDamper* spring = cloth.springDampers[s];
+        if(spring->springConstant == 0.0f) continue;   // already torn
+
+        const glm::vec3 e = spring->p2->position - spring->p1->position;
+        const float length = glm::length(e);
+        if(length <= tearStretch * spring->restLength) continue;
+
+        // split an end not touched yet this step; the far side faces the other end
+        const glm::vec3 direction = e / length;
+        const GLuint a = spring->p1->particleID, b = spring->p2->particleID;
+        if((!splitThisStep[a] && split(cloth, a, direction)) ||
+           (!splitThisStep[b] && split(cloth, b, -direction))) {
+            splits++;
+        }
+    }
+    if(splits == 0) return 0;
+
+    cutStaleSprings(cloth);
+
+    std::sort(changedTriangles.begin(), changedTriangles.end());
+    changedTriangles.erase(std::unique(changedTriangles.begin(), changedTriangles.end()), changedTriangles.end());
+    std::sort(changedSprings.begin(), changedSprings.end());
+    changedSprings.erase(std::unique(changedSprings.begin(), changedSprings.end()), changedSprings.end());
+
+    // the triangle pass only holds topology, so it is rebuilt; the rest re-read
+    // the edited elements and keep their rest state
+    cloth.trianglePass.build(cloth.particles, cloth.triangles);
+    cloth.bendingPass.update(cloth.triangles, changedTriangles);
+    cloth.membranePass.update(cloth.triangles, changedTriangles);
+    cloth.strainLimiter.update(cloth.springDampers, changedSprings);
+    if(!cloth.headless) {
+        patchIndexBuffer(cloth);
+    }
+
+    for(GLuint i : splitParticles) {
+        splitThisStep[i] = 0;
+    }
+    return splits;
+}
+
+bool Tearing::split(Cloth& cloth, GLuint id, glm::vec3 direction) {
+    Particle* p = cloth.particles[id];
+    std::vector<GLuint>& tris = particleTriangles[id];
+
+    // triangles whose centroid is on the far side go to the copy; both sides
+    // must keep a triangle, or there is nothing to open
+    auto far = std::partition(tris.begin(), tris.end(), [&](GLuint t) {
+        const Triangle* tri = cloth.triangles[t];
+        const glm::vec3 centroid = (tri->p1->position + tri->p2->position + tri->p3->position) / 3.0f;
+        return glm::dot(centroid - p->position, direction) <= 0.0f;
+    });
+    const size_t kept = size_t(far - tris.begin());
+    if(kept == 0 || kept == tris.size()) return false;
+
+    // the copy keeps the full particle mass: masses are per particle, not lumped
+    // from area, and halving them along a tear would break the explicit step limit
+    const GLuint copyID = GLuint(cloth.particles.size());
+    Particle* copy = cloth.arena.create<Particle>(p->position, p->mass, copyID);
+    copy->position_prev = p->position_prev;
+    copy->velocity = p->velocity;
+    copy->normal = p->normal;
+    cloth.particles.push_back(copy);
+    cloth.restPositions.push_back(cloth.restPositions[id]);
+
+    // a pinned particle stays pinned on both sides of the crack
+    for(size_t k = 0, pins = cloth.pinnedIndices.size(); k < pins; k++) {
+        if(cloth.pinnedIndices[k] != id) continue;
+        const glm::vec3 anchor = cloth.pinAnchors[k];
+        const glm::mat4 transform = cloth.pinTransforms[k];
+        const int curveID = cloth.pinCurveIDs[k];
+        cloth.pinnedIndices.push_back(copyID);
+        cloth.pinAnchors.push_back(anchor);
+        cloth.pinTransforms.push_back(transform);
+        cloth.pinCurveIDs.push_back(curveID);
+    }
+
+    // copied out before the push, which may move the lists
+    std::vector<GLuint> movedTriangles(far, tris.end());
+    tris.erase(far, tris.end());
+    for(GLuint t : movedTriangles) {
+        cornerRef(cloth.triangles[t], p) = copy;
+        changedTriangles.push_back(t);
+    }
+
+    // springs follow the triangles they belong to: an edge of moved triangles
+    // only goes to the copy, an edge on the crack itself is duplicated, and a
+    // quad diagonal goes with the triangle of p that borders the other end's
+    auto sideOf = [&](GLuint q) {
+        const Particle* pq = cloth.particles[q];
+        bool kept = false, far = false;
+        for(GLuint t : tris) kept |= hasCorner(cloth.triangles[t], pq);
+        for(GLuint t : movedTriangles) far |= hasCorner(cloth.triangles[t], pq);
+        if(kept || far) return kept && far ? 2 : far ? 1 : 0;
+        for(GLuint tq : particleTriangles[q]) {
+            const Triangle* y = cloth.triangles[tq];
+            auto borders = [&](GLuint t) {
+                const Triangle* x = cloth.triangles[t];
+                return hasCorner(y, x->p1) + hasCorner(y, x->p2) + hasCorner(y, x->p3) == 2;
+            };
+            if(std::any_of(movedTriangles.begin(), movedTriangles.end(), borders)) return 1;
+        }
+        return 0;
+    };
+
+    std::vector<GLuint>& springs = particleSprings[id];
+    std::vector<GLuint> movedSprings;
+    for(size_t k = 0; k < springs.size();) {
+        SpringDamper* spring = cloth.springDampers[springs[k]];
+        Particle* other = spring->p1 == p ? spring->p2 : spring->p1;
+        const int side = sideOf(other->particleID);
+        if(side == 2) {
+            SpringDamper* twin = cloth.arena.create<SpringDamper>(copy, other, false);
+            twin->springConstant = spring->springConstant;
+            twin->dampingConstant = spring->dampingConstant;
+            twin->restLength = spring->restLength;
+            const GLuint twinID = GLuint(cloth.springDampers.size());
+            cloth.springDampers.push_back(twin);
+            movedSprings.push_back(twinID);
+            particleSprings[other->particleID].push_back(twinID);
+            changedSprings.push_back(twinID);
+        } else if(side == 1) {
+            (spring->p1 == p ? spring->p1 : spring->p2) = copy;
+            movedSprings.push_back(springs[k]);
+            changedSprings.push_back(springs[k]);
+            springs[k] = springs.back();
+            springs.pop_back();
+            continue;
+        }
+        k++;
+    }
+
+    particleTriangles.push_back(std::move(movedTriangles));
+    particleSprings.push_back(std::move(movedSprings));
+
+    splitThisStep.push_back(1);
+    splitThisStep[id] = 1;
+    splitParticles.push_back(id);
+    splitParticles.push_back(copyID);
+    return true;
+}
+
+void Tearing::cutStaleSprings(Cloth& cloth) {
+    // a spring survives while its ends share a triangle, or sit on two triangles
+    // that still share an edge (the quad diagonal that is not a triangle edge)
+    auto holds = [&](GLuint a, GLuint b) {
+        const Particle* pb = cloth.particles[b];
+        for(GLuint ta : particleTriangles[a]) {
+            if(hasCorner(cloth.triangles[ta], pb)) return true;
+        }
+        for(GLuint ta : particleTriangles[a]) {
+            const Triangle* x = cloth.triangles[ta];
+            for(GLuint tb : particleTriangles[b]) {
+                const Triangle* y = cloth.triangles[tb];
+                const int shared = hasCorner(y, x->p1) + hasCorner(y, x->p2) + hasCorner(y, x->p3);
+                if(shared == 2) return true;
+            }
+        }
+        return false;
+    };
+
+    // only springs around the split particles can have lost their triangles
+    std::vector<GLuint> candidates;
+    for(GLuint i : splitParticles) {
+        for(GLuint t : particleTriangles[i]) {
+            const Triangle* tri = cloth.triangles[t];
+            for(const Particle* c : { tri->p1, tri->p2, tri->p3 }) {
+                const std::vector<GLuint>& springs = particleSprings[c->particleID];
+                candidates.insert(candidates.end(), springs.begin(), springs.end());
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for(GLuint s : candidates) {
+        SpringDamper* spring = cloth.springDampers[s];
+        if(spring->springConstant == 0.0f) continue;
+        if(holds(spring->p1->particleID, spring->p2->particleID)) continue;
+        spring->springConstant = 0.0f;
+        spring->dampingConstant = 0.0f;
+        changedSprings.push_back(s);
+    }
+}
+
+void Tearing::patchIndexBuffer(Cloth& cloth) {
+    // one glBufferSubData per run of consecutive changed triangles
+    std::vector<GLuint> indices;
+    glBindVertexArray(cloth.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cloth.buffers[2]);
+    for(size_t begin = 0; begin < changedTriangles.size();) {
+        size_t end = begin + 1;
+        while(end < changedTriangles.size() && changedTriangles[end] == changedTriangles[end - 1] + 1) end++;
+
+        indices.clear();
+        for(size_t k = begin; k < end; k++) {
+            const Triangle* tri = cloth.triangles[changedTriangles[k]];
+            indices.push_back(tri->p1->particleID);
+            indices.push_back(tri->p2->particleID);
+            indices.push_back(tri->p3->particleID);
+        }
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 3 * changedTriangles[begin] * sizeof(GLuint),
+                        indices.size() * sizeof(GLuint), indices.data());
+        begin = end;
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "core.hpp"
+
+class Cloth;
+
+// Runtime tearing by vertex splits. A spring stretched past tearStretch splits
+// one of its ends: the particle is duplicated, and the triangles and springs on
+// the far side of the plane through it, normal to the spring, move to the copy,
+// so the crack opens across the pull. Springs whose ends no longer share a
+// triangle (or a triangle edge, for the quad diagonals) are cut. The copy of a
+// pinned particle is pinned to the same target.
+//
+// All splits of a step are batched: the passes re-read only the changed
+// triangles and springs, and the index buffer is patched with glBufferSubData
+// over runs of changed triangles instead of being re-uploaded.
+
+class Tearing {
+public:
+    float tearStretch;     // spring length / restLength that tears
+    int maxSplitsPerStep;  // caps the work of one step
+
+    Tearing();
+
+    /// Returns the number of particles split this step.
+    int run(Cloth& cloth);
+
+    /// Drops the adjacency after another topology edit; the next run rebuilds it.
+    void reset() { particleTriangles.clear(); }
+
+private:
+    // particle -> incident triangles and springs, built on the first run
+    std::vector<std::vector<GLuint>> particleTriangles;
+    std::vector<std::vector<GLuint>> particleSprings;
+
+    // edits of the current step
+    std::vector<GLuint> changedTriangles;
+    std::vector<GLuint> changedSprings;
+    std::vector<GLuint> splitParticles;
+    std::vector<unsigned char> splitThisStep;
+
+    void buildAdjacency(const Cloth& cloth);
+    bool split(Cloth& cloth, GLuint particle, glm::vec3 direction);
+    void cutStaleSprings(Cloth& cloth);
+    void patchIndexBuffer(Cloth& cloth);
+};
@@ -1,211 +1,440 @@
-////////////////////////////////////////
-// Tokenizer.cpp
-////////////////////////////////////////
-
-#define _CRT_SECURE_NO_WARNINGS
-
-#include "Tokenizer.hpp"
-
-////////////////////////////////////////////////////////////////////////////////
-
-Tokenizer::Tokenizer() {
-	File=0;
-	LineNum=0;
-	strcpy(FileName,"");
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-Tokenizer::~Tokenizer() {
-	if(File) {
-		printf("ERROR: Tokenizer::~Tokenizer()- Closing file '%s'\n",FileName);
-		fclose((FILE*)File);
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::Open(const char *fname) {
-	File=(void*)fopen(fname,"r");
-	LineNum=1;
-	if(File==0) {
-		printf("ERROR: Tokenzier::Open()- Can't open file '%s'\n",fname);
-		return false;
-	}
-	strcpy(FileName,fname);
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::Close() {
-	if(File) fclose((FILE*)File);
-	else return false;
-
-	File=0;
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::Abort(char *error) {
-	printf("ERROR '%s' line %d: %s\n",FileName,LineNum,error);
-	Close();
-	return false;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-char Tokenizer::GetChar() {
-	char c=char(getc((FILE*)File));
-	if(c=='\n') LineNum++;
-	return c;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-char Tokenizer::CheckChar() {
-	int c=getc((FILE*)File);
-	ungetc(c,(FILE*)File);
-	return char(c);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-int Tokenizer::GetInt() {
-	SkipWhitespace();
-	int pos=0;
-	char temp[256];
-
-	// Get first character ('-' or digit)
-	char c=CheckChar();
-	if(c=='-') {
-		temp[pos++]=GetChar();
-		c=CheckChar();
-	}
-	if(!isdigit(c)) {
-		printf("ERROR: Tokenizer::GetInt()- Expecting int on line %d of '%s'\n",LineNum,FileName);
-		return 0;
-	}
-	temp[pos++]=GetChar();
-
-	// Get integer potion
-	while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
-
-	// Finish
-	temp[pos++]='\0';
-	return atoi(temp);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-// BUG: can't parse ".2", "f", or "F"
-// Uses: [-]I[.[I]][(e|E)[+|-]I]
-// Should use: [+|-](I|I.|.I|I.I)[(e|E)[+|-]I][f|F]
-
-float Tokenizer::GetFloat() {
-	SkipWhitespace();
-	int pos=0;
-	char temp[256];
-
-	// Get first character ('-' or digit)
-	char c=CheckChar();
-	if(c=='-') {
-		temp[pos++]=GetChar();
-		c=CheckChar();
-	}
-	if(!isdigit(c)) {
-		printf("ERROR: Tokenizer::GetFloat()- Expecting float on line %d of '%s' '%c'\n",LineNum,FileName,c);
-		return 0.0f;
-	}
-	temp[pos++]=GetChar();
-
-	// Get integer potion of mantissa
-	while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
-
-	// Get fraction component
-	if(c=='.') {
-		temp[pos++]=GetChar();
-		while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
-	}
-
-	// Get exponent
-	if(c=='e' || c=='E') {
-		temp[pos++]=GetChar();
-		c=CheckChar();
-		if(c=='+' || c=='-') {
-			temp[pos++]=GetChar();
-			c=CheckChar();
-		}
-		if(!isdigit(c)) {
-			printf("ERROR: Tokenizer::GetFloat()- Poorly formatted float exponent on line %d of '%s'\n",LineNum,FileName);
-			return 0.0f;
-		}
-		while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
-	}
-
-	// Finish
-	temp[pos++]='\0';
-	return float(atof(temp));
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::GetToken(char *str) {
-	SkipWhitespace();
-
-	int pos=0;
-	char c=CheckChar();
-	while(c!=' ' && c!='\n' && c!='\t' && c!='\r' && !feof((FILE*)File)) {
-		str[pos++]=GetChar();
-		c=CheckChar();
-	}
-	str[pos]='\0';
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::FindToken(const char *tok) {
-	int pos=0;
-	while(tok[pos]!='\0') {
-		if(feof((FILE*)File)) return false;
-		char c=GetChar();
-		if(c==tok[pos]) pos++;
-		else pos=0;
-	}
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::SkipWhitespace() {
-	char c=CheckChar();
-	bool white=false;
-	while(isspace(c)) {
-		GetChar();
-		c=CheckChar();
-		white=true;
-	}
-	return white;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::SkipLine() {
-	char c=GetChar();
-	while(c!='\n') {
-		if(feof((FILE*)File)) return false;
-		c=GetChar();
-	}
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-bool Tokenizer::Reset() {
-	if(fseek((FILE*)File,0,SEEK_SET)) return false;
-	return true;
-}
-
-////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////
+// Tokenizer.cpp
+////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "Tokenizer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+Tokenizer::Tokenizer() {
+	File=0;
+	LineNum=0;
+	strcpy(FileName,"");
+	Begin=Cur=End=LineMark=0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Tokenizer::~Tokenizer() {
+	if(File || Begin) {
+		printf("ERROR: Tokenizer::~Tokenizer()- Closing file '%s'\n",FileName);
+		Close();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::Open(const char *fname,bool map) {
+	LineNum=1;
+	if(map && Map(fname)) {
+		strcpy(FileName,fname);
+		return true;
+	}
+
+	File=(void*)fopen(fname,"r");
+	if(File==0) {
+		printf("ERROR: Tokenzier::Open()- Can't open file '%s'\n",fname);
+		return false;
+	}
+	strcpy(FileName,fname);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::Map(const char *fname) {
+#ifndef _WIN32
+	int fd=open(fname,O_RDONLY);
+	if(fd<0) return false;
+
+	// empty files and pipes can't be mapped; stdio handles those
+	struct stat info;
+	void *data=MAP_FAILED;
+	if(fstat(fd,&info)==0 && S_ISREG(info.st_mode) && info.st_size>0)
+		data=mmap(0,size_t(info.st_size),PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(data==MAP_FAILED) return false;
+
+	madvise(data,size_t(info.st_size),MADV_SEQUENTIAL);
+	Begin=Cur=LineMark=(const char*)data;
+	End=Begin+info.st_size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::Close() {
+	if(Begin) {
+#ifndef _WIN32
+		munmap((void*)Begin,size_t(End-Begin));
+#endif
+		Begin=Cur=End=LineMark=0;
+		return true;
+	}
+	if(File) fclose((FILE*)File);
+	else return false;
+
+	File=0;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::Abort(char *error) {
+	printf("ERROR '%s' line %d: %s\n",FileName,GetLineNum(),error);
+	Close();
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+char Tokenizer::GetChar() {
+	if(Begin) return Cur<End ? *Cur++ : char(EOF);
+
+	char c=char(getc((FILE*)File));
+	if(c=='\n') LineNum++;
+	return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+char Tokenizer::CheckChar() {
+	if(Begin) return Cur<End ? *Cur : char(EOF);
+
+	int c=getc((FILE*)File);
+	ungetc(c,(FILE*)File);
+	return char(c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int Tokenizer::GetInt() {
+	SkipWhitespace();
+	if(Begin) {
+		int value=0;
+		const std::from_chars_result r=std::from_chars(Cur,End,value);
+		if(r.ec!=std::errc()) {
+			printf("ERROR: Tokenizer::GetInt()- Expecting int on line %d of '%s'\n",GetLineNum(),FileName);
+			return 0;
+		}
+		Cur=r.ptr;
+		return value;
+	}
+
+	int pos=0;
+	char temp[256];
+
+	// Get first character ('-' or digit)
+	char c=CheckChar();
+	if(c=='-') {
+		temp[pos++]=GetChar();
+		c=CheckChar();
+	}
+	if(!isdigit(c)) {
+		printf("ERROR: Tokenizer::GetInt()- Expecting int on line %d of '%s'\n",LineNum,FileName);
+		return 0;
+	}
+	temp[pos++]=GetChar();
+
+	// Get integer potion
+	while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
+
+	// Finish
+	temp[pos++]='\0';
+	return atoi(temp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#if !defined(__cpp_lib_to_chars)
+// Length of the float at first in the from_chars grammar,
+// [-](I|I.|.I|I.I)[(e|E)[+|-]I] or inf, infinity or nan, or 0 if there is none
+static size_t FloatLength(const char *first,const char *last) {
+	const char *p=first;
+	if(p<last && *p=='-') p++;
+
+	for(const char *word : {"infinity","inf","nan"}) {
+		const size_t len=strlen(word);
+		size_t i=0;
+		while(i<len && p+i<last && tolower((unsigned char)p[i])==word[i]) i++;
+		if(i==len) return size_t(p+len-first);
+	}
+
+	const char *digits=p;
+	while(p<last && isdigit((unsigned char)*p)) p++;
+	bool mantissa=p>digits;
+	if(p<last && *p=='.') {
+		digits=++p;
+		while(p<last && isdigit((unsigned char)*p)) p++;
+		mantissa|=p>digits;
+	}
+	if(!mantissa) return 0;
+
+	if(p<last && (*p=='e' || *p=='E')) {
+		const char *e=p+1;
+		if(e<last && (*e=='+' || *e=='-')) e++;
+		if(e<last && isdigit((unsigned char)*e)) {
+			p=e;
+			while(p<last && isdigit((unsigned char)*p)) p++;
+		}
+	}
+	return size_t(p-first);
+}
+#endif
+
+// std::from_chars for floats where the standard library has it (libc++ only
+// recently, and not for older macOS deployment targets). Otherwise the float is
+// measured first, so only its own bytes are copied, and parsed by strtof in the
+// C locale, which keeps '.' the decimal point; the grammar already kept out
+// the hex floats strtof would take.
+std::from_chars_result ParseFloat(const char *first,const char *last,float &value) {
+#if defined(__cpp_lib_to_chars)
+	return std::from_chars(first,last,value);
+#else
+	std::from_chars_result r;
+	r.ptr=first;
+	r.ec=std::errc::invalid_argument;
+	const size_t len=FloatLength(first,last);
+	if(len==0) return r;
+
+	char temp[64];
+	std::string longer;
+	char *copy=temp;
+	if(len<sizeof(temp)) {
+		memcpy(temp,first,len);
+		temp[len]='\0';
+	} else {
+		longer.assign(first,len);
+		copy=&longer[0];
+	}
+#ifdef _WIN32
+	static const _locale_t c=_create_locale(LC_ALL,"C");
+	value=_strtof_l(copy,0,c);
+#else
+	static const locale_t c=newlocale(LC_ALL_MASK,"C",(locale_t)0);
+	value=strtof_l(copy,0,c);
+#endif
+	r.ptr=first+len;
+	r.ec=std::errc();
+	return r;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// BUG: can't parse ".2", "f", or "F" unless mapped
+// Uses: [-]I[.[I]][(e|E)[+|-]I]
+// Should use: [+|-](I|I.|.I|I.I)[(e|E)[+|-]I][f|F]
+// Mapped: [+|-](I|I.|.I|I.I)[(e|E)[+|-]I][f|F], plus inf and nan
+
+float Tokenizer::GetFloat() {
+	SkipWhitespace();
+	if(Begin) {
+		// from_chars takes no leading '+'
+		const char *start=Cur;
+		if(start<End && *start=='+') start++;
+		float value=0.0f;
+		const std::from_chars_result r=ParseFloat(start,End,value);
+		if(r.ec==std::errc::invalid_argument) {
+			printf("ERROR: Tokenizer::GetFloat()- Expecting float on line %d of '%s' '%c'\n",GetLineNum(),FileName,CheckChar());
+			return 0.0f;
+		}
+		Cur=r.ptr;
+		if(Cur<End && (*Cur=='f' || *Cur=='F')) Cur++;
+		return value;
+	}
+
+	int pos=0;
+	char temp[256];
+
+	// Get first character ('-' or digit)
+	char c=CheckChar();
+	if(c=='-') {
+		temp[pos++]=GetChar();
+		c=CheckChar();
+	}
+	if(!isdigit(c)) {
+		printf("ERROR: Tokenizer::GetFloat()- Expecting float on line %d of '%s' '%c'\n",LineNum,FileName,c);
+		return 0.0f;
+	}
+	temp[pos++]=GetChar();
+
+	// Get integer potion of mantissa
+	while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
+
+	// Get fraction component
+	if(c=='.') {
+		temp[pos++]=GetChar();
+		while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
+	}
+
+	// Get exponent
+	if(c=='e' || c=='E') {
+		temp[pos++]=GetChar();
+		c=CheckChar();
+		if(c=='+' || c=='-') {
+			temp[pos++]=GetChar();
+			c=CheckChar();
+		}
+		if(!isdigit(c)) {
+			printf("ERROR: Tokenizer::GetFloat()- Poorly formatted float exponent on line %d of '%s'\n",LineNum,FileName);
+			return 0.0f;
+		}
+		while(isdigit(c=CheckChar())) temp[pos++]=GetChar();
+	}
+
+	// Finish
+	temp[pos++]='\0';
+	return float(atof(temp));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::GetToken(char *str) {
+	if(Begin) {
+		const std::string_view tok=GetToken();
+		memcpy(str,tok.data(),tok.size());
+		str[tok.size()]='\0';
+		return true;
+	}
+
+	SkipWhitespace();
+
+	int pos=0;
+	char c=CheckChar();
+	while(c!=' ' && c!='\n' && c!='\t' && c!='\r' && !feof((FILE*)File)) {
+		str[pos++]=GetChar();
+		c=CheckChar();
+	}
+	str[pos]='\0';
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string_view Tokenizer::GetToken() {
+	SkipWhitespace();
+	if(Begin) {
+		const char *start=Cur;
+		while(Cur<End && *Cur!=' ' && *Cur!='\n' && *Cur!='\t' && *Cur!='\r') Cur++;
+		return std::string_view(start,size_t(Cur-start));
+	}
+
+	Token.clear();
+	char c=CheckChar();
+	while(c!=' ' && c!='\n' && c!='\t' && c!='\r' && !feof((FILE*)File)) {
+		Token.push_back(GetChar());
+		c=CheckChar();
+	}
+	return Token;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::FindToken(const char *tok) {
+	if(Begin) {
+		const std::string_view rest(Cur,size_t(End-Cur));
+		const size_t at=rest.find(tok);
+		if(at==std::string_view::npos) {
+			Cur=End;
+			return false;
+		}
+		Cur+=at+strlen(tok);
+		return true;
+	}
+
+	int pos=0;
+	while(tok[pos]!='\0') {
+		if(feof((FILE*)File)) return false;
+		char c=GetChar();
+		if(c==tok[pos]) pos++;
+		else pos=0;
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::SkipWhitespace() {
+	if(Begin) {
+		const char *start=Cur;
+		while(Cur<End && isspace((unsigned char)*Cur)) Cur++;
+		return Cur!=start;
+	}
+
+	char c=CheckChar();
+	bool white=false;
+	while(isspace(c)) {
+		GetChar();
+		c=CheckChar();
+		white=true;
+	}
+	return white;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::SkipLine() {
+	if(Begin) {
+		const char *eol=(const char*)memchr(Cur,'\n',size_t(End-Cur));
+		Cur=eol ? eol+1 : End;
+		return eol!=0;
+	}
+
+	char c=GetChar();
+	while(c!='\n') {
+		if(feof((FILE*)File)) return false;
+		c=GetChar();
+	}
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool Tokenizer::Reset() {
+	if(Begin) {
+		Cur=LineMark=Begin;
+		LineNum=1;
+		return true;
+	}
+	if(fseek((FILE*)File,0,SEEK_SET)) return false;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int Tokenizer::GetLineNum() {
+	// mapped reads skip the per-character count; catch up from the last query
+	if(Begin) {
+		if(Cur<LineMark) {
+			LineNum=1;
+			LineMark=Begin;
+		}
+		LineNum+=int(std::count(LineMark,Cur,'\n'));
+		LineMark=Cur;
+	}
+	return LineNum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -1,49 +1,71 @@
-////////////////////////////////////////
-// Tokenizer.h
-////////////////////////////////////////
-
-#pragma once
-
-#include "core.hpp"
-
-////////////////////////////////////////////////////////////////////////////////
-
-// The Tokenizer class for reading simple ascii data files. The GetToken function
-// just grabs tokens separated by whitespace, but the GetInt and GetFloat functions
-// specifically parse integers and floating point numbers. SkipLine will skip to
-// the next carraige return. FindToken searches for a specific token and returns
-// true if it found it.
-
-class Tokenizer 
-{
-public:
-	Tokenizer();
-	~Tokenizer();
-
-	bool Open(const char *file);
-	bool Close();
-
-	bool Abort(char *error);	// Prints error & closes file, and always returns false
-
-	// Tokenization
-	char GetChar();
-	char CheckChar();
-	int GetInt();
-	float GetFloat();
-	bool GetToken(char *str);
-	bool FindToken(const char *tok);
-	bool SkipWhitespace();
-	bool SkipLine();
-	bool Reset();
-
-	// Access functions
-	char *GetFileName()			{return FileName;}
-	int GetLineNum()			{return LineNum;}
-
-private:
-	void *File;
-	char FileName[256];
-	int LineNum;
-};
-
-////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////
+// Tokenizer.h
+////////////////////////////////////////
+
+#pragma once
+
+#include "core.hpp"
+
+#include <charconv>
+#include <string_view>
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The Tokenizer class for reading simple ascii data files. The GetToken function
+// just grabs tokens separated by whitespace, but the GetInt and GetFloat functions
+// specifically parse integers and floating point numbers. SkipLine will skip to
+// the next carraige return. FindToken searches for a specific token and returns
+// true if it found it.
+//
+// Open maps the file into memory when it can and tokenizes straight from the
+// mapped bytes: tokens come back as views into the file, numbers are parsed in
+// place with std::from_chars, and line numbers are only counted when asked
+// for. Files that can't be mapped are read through stdio as before.
+
+class Tokenizer 
+{
+public:
+	Tokenizer();
+	~Tokenizer();
+
+	bool Open(const char *file,bool map=true);	// map=false reads through stdio
+	bool Close();
+
+	bool Abort(char *error);	// Prints error & closes file, and always returns false
+
+	// Tokenization
+	char GetChar();
+	char CheckChar();
+	int GetInt();
+	float GetFloat();
+	bool GetToken(char *str);
+	std::string_view GetToken();	// valid until the next call, or Close() when mapped
+	bool FindToken(const char *tok);
+	bool SkipWhitespace();
+	bool SkipLine();
+	bool Reset();
+
+	// Access functions
+	char *GetFileName()			{return FileName;}
+	int GetLineNum();
+	bool IsMapped()				{return Begin!=0;}
+
+private:
+	void *File;
+	char FileName[256];
+	int LineNum;
+
+	// Mapped mode: the whole file in place, with LineNum counting the lines
+	// up to LineMark
+	const char *Begin,*Cur,*End;
+	const char *LineMark;
+	std::string Token;			// backs GetToken() in stdio mode
+
+	bool Map(const char *fname);
+};
+
+// Parses a float at [first,last) like std::from_chars: no leading '+', no hex,
+// and '.' is the decimal point whatever the locale.
+std::from_chars_result ParseFloat(const char *first,const char *last,float &value);
+
+////////////////////////////////////////////////////////////////////////////////
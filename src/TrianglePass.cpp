@@ -0,0 +1,160 @@
+#include "TrianglePass.hpp"
+#include "Cloth.hpp"
+#include "Airflow.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// |F| per corner = 0.5 * rho * Cd * |v|^2 * A * dot(v^, n) / 3, with A = |c| / 2 and n = c / |c|
+#define DRAG_SCALE (AIR_DENSITY * DRAG_COFF / 12.0f)
+
+void TrianglePass::build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles) {
+    const size_t np = particles.size();
+    const size_t nt = triangles.size();
+
+    i1.resize(nt);
+    i2.resize(nt);
+    i3.resize(nt);
+    for(size_t t = 0; t < nt; t++) {
+        i1[t] = triangles[t]->p1->particleID;
+        i2[t] = triangles[t]->p2->particleID;
+        i3[t] = triangles[t]->p3->particleID;
+    }
+
+    // count, prefix sum, fill
+    incidenceStart.assign(np + 1, 0);
+    for(size_t t = 0; t < nt; t++) {
+        incidenceStart[i1[t] + 1]++;
+        incidenceStart[i2[t] + 1]++;
+        incidenceStart[i3[t] + 1]++;
+    }
+    for(size_t i = 0; i < np; i++) {
+        incidenceStart[i + 1] += incidenceStart[i];
+    }
+    incidence.resize(3 * nt);
+    std::vector<GLuint> fill(incidenceStart.begin(), incidenceStart.end() - 1);
+    for(size_t t = 0; t < nt; t++) {
+        incidence[fill[i1[t]]++] = GLuint(t);
+        incidence[fill[i2[t]]++] = GLuint(t);
+        incidence[fill[i3[t]]++] = GLuint(t);
+    }
+
+    px.resize(np); py.resize(np); pz.resize(np);
+    vx.resize(np); vy.resize(np); vz.resize(np);
+    wx.resize(nt); wy.resize(nt); wz.resize(nt);
+    cx.resize(nt); cy.resize(nt); cz.resize(nt);
+    nx.assign(nt, 0.0f); ny.assign(nt, 0.0f); nz.assign(nt, 0.0f);
+    area.assign(nt, 0.0f);
+    fx.resize(nt); fy.resize(nt); fz.resize(nt);
+}
+
+template<bool Drag>
+void TrianglePass::run(const std::vector<Particle*>& particles, glm::vec3 windSpeed, Airflow* air, bool occlude, float share) {
+    const size_t np = particles.size();
+    const size_t nt = i1.size();
+
+    for(size_t i = 0; i < np; i++) {
+        const Particle* p = particles[i];
+        px[i] = p->position.x; py[i] = p->position.y; pz[i] = p->position.z;
+        if constexpr (Drag) {
+            vx[i] = p->velocity.x; vy[i] = p->velocity.y; vz[i] = p->velocity.z;
+        }
+    }
+
+    if constexpr (Drag) {
+        if(air || occlude) {
+            for(size_t t = 0; t < nt; t++) {
+                const GLuint a = i1[t], b = i2[t], c = i3[t];
+                cx[t] = (px[a] + px[b] + px[c]) * (1.0f / 3.0f);
+                cy[t] = (py[a] + py[b] + py[c]) * (1.0f / 3.0f);
+                cz[t] = (pz[a] + pz[b] + pz[c]) * (1.0f / 3.0f);
+            }
+        }
+        if(air) {
+            air->sample(cx.data(), cy.data(), cz.data(), nt, wx.data(), wy.data(), wz.data());
+        } else {
+            std::fill(wx.begin(), wx.end(), windSpeed.x);
+            std::fill(wy.begin(), wy.end(), windSpeed.y);
+            std::fill(wz.begin(), wz.end(), windSpeed.z);
+        }
+        // shadowing uses last step's normals and areas
+        if(occlude) {
+            occlusion.apply(cx.data(), cy.data(), cz.data(), nx.data(), ny.data(), nz.data(), area.data(),
+                            nt, wx.data(), wy.data(), wz.data());
+        }
+    }
+
+    // gather each block's corners into contiguous lanes, then run the math as
+    // straight-line loops the compiler can vectorize
+    float e1x[BLOCK], e1y[BLOCK], e1z[BLOCK];
+    float e2x[BLOCK], e2y[BLOCK], e2z[BLOCK];
+    float tvx[BLOCK], tvy[BLOCK], tvz[BLOCK];
+
+    for(size_t base = 0; base < nt; base += BLOCK) {
+        const int n = int(std::min<size_t>(BLOCK, nt - base));
+
+        for(int k = 0; k < n; k++) {
+            const size_t t = base + k;
+            const GLuint a = i1[t], b = i2[t], c = i3[t];
+            e1x[k] = px[b] - px[a]; e1y[k] = py[b] - py[a]; e1z[k] = pz[b] - pz[a];
+            e2x[k] = px[c] - px[a]; e2y[k] = py[c] - py[a]; e2z[k] = pz[c] - pz[a];
+            if constexpr (Drag) {
+                tvx[k] = (vx[a] + vx[b] + vx[c]) * (1.0f / 3.0f) - wx[t];
+                tvy[k] = (vy[a] + vy[b] + vy[c]) * (1.0f / 3.0f) - wy[t];
+                tvz[k] = (vz[a] + vz[b] + vz[c]) * (1.0f / 3.0f) - wz[t];
+            }
+        }
+
+        float* __restrict onx = nx.data() + base;
+        float* __restrict ony = ny.data() + base;
+        float* __restrict onz = nz.data() + base;
+        float* __restrict oar = area.data() + base;
+        float* __restrict ofx = fx.data() + base;
+        float* __restrict ofy = fy.data() + base;
+        float* __restrict ofz = fz.data() + base;
+        for(int k = 0; k < n; k++) {
+            const float qx = e1y[k] * e2z[k] - e1z[k] * e2y[k];
+            const float qy = e1z[k] * e2x[k] - e1x[k] * e2z[k];
+            const float qz = e1x[k] * e2y[k] - e1y[k] * e2x[k];
+            const float invLen = 1.0f / std::sqrt(std::max(qx * qx + qy * qy + qz * qz, 1e-20f));
+            onx[k] = qx * invLen;
+            ony[k] = qy * invLen;
+            onz[k] = qz * invLen;
+            oar[k] = 0.5f * (qx * qx + qy * qy + qz * qz) * invLen;
+            if constexpr (Drag) {
+                const float speed = std::sqrt(tvx[k] * tvx[k] + tvy[k] * tvy[k] + tvz[k] * tvz[k]);
+                const float s = -DRAG_SCALE * speed * (tvx[k] * qx + tvy[k] * qy + tvz[k] * qz) * invLen;
+                ofx[k] = s * qx;
+                ofy[k] = s * qy;
+                ofz[k] = s * qz;
+            }
+        }
+    }
+
+    // the air feels the opposite of the drag on all three corners
+    if constexpr (Drag) {
+        if(air && air->isCoupled()) {
+            air->addForce(cx.data(), cy.data(), cz.data(), fx.data(), fy.data(), fz.data(), nt, -3.0f * share);
+        }
+    }
+
+    // each particle sums its own triangles
+    for(size_t i = 0; i < np; i++) {
+        glm::vec3 normal(0);
+        glm::vec3 force(0);
+        for(GLuint e = incidenceStart[i]; e < incidenceStart[i + 1]; e++) {
+            const GLuint t = incidence[e];
+            normal += glm::vec3(nx[t], ny[t], nz[t]);
+            if constexpr (Drag) {
+                force += glm::vec3(fx[t], fy[t], fz[t]);
+            }
+        }
+        particles[i]->normal = glm::normalize(normal);
+        if constexpr (Drag) {
+            particles[i]->force += force;
+        }
+    }
+}
+
+template void TrianglePass::run<true>(const std::vector<Particle*>&, glm::vec3, Airflow*, bool, float);
+template void TrianglePass::run<false>(const std::vector<Particle*>&, glm::vec3, Airflow*, bool, float);
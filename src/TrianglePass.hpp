@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core.hpp"
+#include "WindOcclusion.hpp"
+
+struct Particle;
+struct Triangle;
+class Airflow;
+
+// Blocked SoA pass over all cloth triangles. The edge cross product of each
+// triangle is computed once and yields its normal, area and aerodynamic drag.
+// Results are gathered per particle through a particle -> triangle incidence
+// list, so every particle is written by exactly one iteration (no conflicts).
+
+class TrianglePass {
+public:
+    static constexpr int BLOCK = 64;
+
+    void build(const std::vector<Particle*>& particles, const std::vector<Triangle*>& triangles);
+
+    WindOcclusion occlusion;
+
+    // Sets every particle normal and, if Drag, adds the drag force. The wind is
+    // sampled per triangle centroid from air, or is windSpeed if air is null,
+    // and attenuated by occlusion if occlude; coupled air gets the reaction
+    // force back at the same points, scaled by the share of the air's step this
+    // run covers.
+    template<bool Drag>
+    void run(const std::vector<Particle*>& particles, glm::vec3 windSpeed, Airflow* air, bool occlude,
+             float share = 1.0f);
+
+    /// Triangle t's normal (xyz) and area (w) from the last run, which the next
+    /// run's shadowing reads; checkpoints carry them along with the occlusion.
+    glm::vec4 lastGeometry(size_t t) const { return glm::vec4(nx[t], ny[t], nz[t], area[t]); }
+    void setLastGeometry(size_t t, const glm::vec4& g) { nx[t] = g.x; ny[t] = g.y; nz[t] = g.z; area[t] = g.w; }
+
+private:
+    // triangle corners
+    std::vector<GLuint> i1, i2, i3;
+
+    // particle -> incident triangles (CSR)
+    std::vector<GLuint> incidenceStart;
+    std::vector<GLuint> incidence;
+
+    // particle state gathered once per step
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+
+    // per-triangle wind and sample points
+    std::vector<float> wx, wy, wz;
+    std::vector<float> cx, cy, cz;
+
+    // per-triangle results
+    std::vector<float> nx, ny, nz, area;
+    std::vector<float> fx, fy, fz;
+};
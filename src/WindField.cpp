@@ -0,0 +1,157 @@
+#include "WindField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+    // hashed value noise in [-1, 1]; much cheaper than glm::perlin and good
+    // enough as a potential since only its curl is used
+    inline float hashLattice(int x, int y, int z, int t) {
+        uint32_t h = uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u ^ uint32_t(z) * 0xcb1ab31fu ^ uint32_t(t) * 0x165667b1u;
+        h ^= h >> 15; h *= 0x2c1b3c6du;
+        h ^= h >> 12; h *= 0x297a2d39u;
+        h ^= h >> 15;
+        return float(h) * (2.0f / 4294967295.0f) - 1.0f;
+    }
+
+    inline float fade(float t) { return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f); }
+
+    float valueNoise3(glm::vec3 p, int slice) {
+        const glm::vec3 fl = glm::floor(p);
+        const int x = int(fl.x), y = int(fl.y), z = int(fl.z);
+        const float fx = fade(p.x - fl.x), fy = fade(p.y - fl.y), fz = fade(p.z - fl.z);
+        const float c00 = glm::mix(hashLattice(x, y, z, slice),         hashLattice(x + 1, y, z, slice),         fx);
+        const float c10 = glm::mix(hashLattice(x, y + 1, z, slice),     hashLattice(x + 1, y + 1, z, slice),     fx);
+        const float c01 = glm::mix(hashLattice(x, y, z + 1, slice),     hashLattice(x + 1, y, z + 1, slice),     fx);
+        const float c11 = glm::mix(hashLattice(x, y + 1, z + 1, slice), hashLattice(x + 1, y + 1, z + 1, slice), fx);
+        return glm::mix(glm::mix(c00, c10, fy), glm::mix(c01, c11, fy), fz);
+    }
+}
+
+WindField::WindField(glm::vec3 origin, glm::ivec3 dims, float cellSize, glm::vec3 baseWind)
+    : baseWind(baseWind), origin(origin), dims(glm::max(dims, glm::ivec3(2))), cellSize(cellSize) {
+    turbulence = 0.0f;
+    turbulenceScale = 2.0f;
+    turbulenceRate = 0.5f;
+    invCellSize = 1.0f / cellSize;
+    time = 0.0f;
+    cachedSlice = INT32_MIN;
+    cachedTurbulence = 0.0f;
+
+    const size_t count = size_t(this->dims.x) * this->dims.y * this->dims.z;
+    u.assign(count, baseWind.x);
+    v.assign(count, baseWind.y);
+    w.assign(count, baseWind.z);
+}
+
+void WindField::update(float timestep) {
+    time += timestep;
+
+    if (turbulence > 0.0f) {
+        evaluateTurbulence();   // writes the curl into u, v, w
+    }
+
+    for (int k = 0; k < dims.z; k++) {
+        for (int j = 0; j < dims.y; j++) {
+            for (int i = 0; i < dims.x; i++) {
+                const size_t n = node(i, j, k);
+                const glm::vec3 pos = origin + cellSize * glm::vec3(i, j, k);
+                glm::vec3 vel = baseWind;
+                if (turbulence > 0.0f) vel += glm::vec3(u[n], v[n], w[n]);
+
+                // gust fronts travelling downwind, sin^2 pulses
+                for (const WindGust& g : gusts) {
+                    float s = std::sin(2.0f * float(M_PI) * (glm::dot(pos, g.direction) - g.speed * time) / g.wavelength);
+                    s = std::max(s, 0.0f);
+                    vel += g.direction * (g.strength * s * s);
+                }
+
+                // Lamb-Oseen vortices
+                for (const WindVortex& vx : vortices) {
+                    glm::vec3 r = pos - vx.center;
+                    r -= vx.axis * glm::dot(r, vx.axis);
+                    const float r2 = glm::dot(r, r);
+                    if (r2 > 1e-8f) {
+                        const float falloff = 1.0f - std::exp(-r2 / (vx.radius * vx.radius));
+                        vel += glm::cross(vx.axis, r) * (vx.strength / (2.0f * float(M_PI)) * falloff / r2);
+                    }
+                }
+
+                u[n] = vel.x;
+                v[n] = vel.y;
+                w[n] = vel.z;
+            }
+        }
+    }
+}
+
+void WindField::evaluateSlice(std::vector<glm::vec3>& slice, int index) {
+    const float amp = turbulence * turbulenceScale;
+    const glm::vec3 off1(31.4f, 47.2f, 11.9f), off2(73.1f, 5.3f, 59.7f);
+    slice.resize(u.size());
+    for (int k = 0; k < dims.z; k++) {
+        for (int j = 0; j < dims.y; j++) {
+            for (int i = 0; i < dims.x; i++) {
+                const glm::vec3 p = (origin + cellSize * glm::vec3(i, j, k)) / turbulenceScale;
+                slice[node(i, j, k)] = amp * glm::vec3(valueNoise3(p, index),
+                                                       valueNoise3(p + off1, index),
+                                                       valueNoise3(p + off2, index));
+            }
+        }
+    }
+}
+
+void WindField::evaluateTurbulence() {
+    // vector potential from three decorrelated noise channels; its curl is
+    // divergence free. The noise evolves by blending integer time slices, and
+    // the two slices are cached until time moves past them.
+    const float t = time * turbulenceRate;
+    const int slice = int(std::floor(t));
+    if (slice != cachedSlice || turbulence != cachedTurbulence) {
+        if (slice == cachedSlice + 1 && turbulence == cachedTurbulence) {
+            std::swap(sliceA, sliceB);
+        } else {
+            evaluateSlice(sliceA, slice);
+        }
+        evaluateSlice(sliceB, slice + 1);
+        cachedSlice = slice;
+        cachedTurbulence = turbulence;
+    }
+
+    const size_t count = u.size();
+    const float a = fade(t - float(slice));
+    potential.resize(count);
+    for (size_t n = 0; n < count; n++) {
+        potential[n] = glm::mix(sliceA[n], sliceB[n], a);
+    }
+
+    // central differences, one-sided on the boundary
+    for (int k = 0; k < dims.z; k++) {
+        const int k0 = std::max(k - 1, 0), k1 = std::min(k + 1, dims.z - 1);
+        for (int j = 0; j < dims.y; j++) {
+            const int j0 = std::max(j - 1, 0), j1 = std::min(j + 1, dims.y - 1);
+            for (int i = 0; i < dims.x; i++) {
+                const int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, dims.x - 1);
+                const glm::vec3 dx = (potential[node(i1, j, k)] - potential[node(i0, j, k)]) / (cellSize * (i1 - i0));
+                const glm::vec3 dy = (potential[node(i, j1, k)] - potential[node(i, j0, k)]) / (cellSize * (j1 - j0));
+                const glm::vec3 dz = (potential[node(i, j, k1)] - potential[node(i, j, k0)]) / (cellSize * (k1 - k0));
+                const size_t n = node(i, j, k);
+                u[n] = dy.z - dz.y;
+                v[n] = dz.x - dx.z;
+                w[n] = dx.y - dy.x;
+            }
+        }
+    }
+}
+
+glm::vec3 WindField::sample(glm::vec3 position) const {
+    glm::vec3 out;
+    sample(&position.x, &position.y, &position.z, 1, &out.x, &out.y, &out.z);
+    return out;
+}
+
+void WindField::sample(const float* x, const float* y, const float* z, size_t n,
+                       float* outX, float* outY, float* outZ) const {
+    sampleLattice(u.data(), v.data(), w.data(), dims, origin, invCellSize, x, y, z, n, outX, outY, outZ);
+}
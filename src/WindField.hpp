@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Airflow.hpp"
+
+// Spatially varying wind. The field is evaluated once per step on a coarse
+// lattice (base wind + gusts + vortices + curl-noise turbulence), and cloths
+// sample it trilinearly per triangle. Many cloths can share one field.
+
+struct WindGust {
+    glm::vec3 direction;   // unit
+    float     strength;    // peak added speed (m/s)
+    float     wavelength;  // distance between gust fronts (m)
+    float     speed;       // speed the fronts travel along direction (m/s)
+};
+
+struct WindVortex {
+    glm::vec3 center;
+    glm::vec3 axis;        // unit
+    float     radius;      // core radius (m)
+    float     strength;    // circulation scale (m^2/s)
+};
+
+class WindField : public Airflow {
+public:
+    glm::vec3 baseWind;
+    std::vector<WindGust> gusts;
+    std::vector<WindVortex> vortices;
+
+    // curl-noise turbulence
+    float turbulence;       // amplitude (m/s), 0 disables it
+    float turbulenceScale;  // feature size (m)
+    float turbulenceRate;   // how fast the noise evolves (1/s)
+
+    // lattice spans [origin, origin + cellSize * (dims - 1)]
+    WindField(glm::vec3 origin, glm::ivec3 dims, float cellSize, glm::vec3 baseWind);
+
+    /// Advance time and re-evaluate every lattice node.
+    void update(float timestep);
+
+    /// Trilinear sample, clamped to the lattice bounds.
+    glm::vec3 sample(glm::vec3 position) const;
+
+    /// Sample n points (SoA). Consecutive points falling in the same cell reuse
+    /// its corner values, so spatially coherent batches (cloth triangles in
+    /// index order) cost one corner fetch per cell rather than per point.
+    void sample(const float* x, const float* y, const float* z, size_t n,
+                float* outX, float* outY, float* outZ) const override;
+
+    float getTime() const { return time; }
+
+private:
+    glm::vec3 origin;
+    glm::ivec3 dims;
+    float cellSize;
+    float invCellSize;
+    float time;
+
+    // node velocities, x fastest
+    std::vector<float> u, v, w;
+    // noise potential for the curl, blended from two cached time slices
+    std::vector<glm::vec3> potential;
+    std::vector<glm::vec3> sliceA, sliceB;
+    int cachedSlice;
+    float cachedTurbulence;
+
+    size_t node(int i, int j, int k) const { return (size_t(k) * dims.y + j) * dims.x + i; }
+    void evaluateSlice(std::vector<glm::vec3>& slice, int index);
+    void evaluateTurbulence();
+};
@@ -0,0 +1,174 @@
+#include "WindOcclusion.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+WindOcclusion::WindOcclusion() {
+    extinction = 2.0f;
+    resolution = 32;
+    refreshInterval = 4;
+    stepsSinceRefresh = 0;
+    d = e1 = e2 = glm::vec3(0);
+    boxMin = boxMax = invCell = glm::vec3(0);
+    gridResolution = 0;
+}
+
+void WindOcclusion::refit(glm::vec3 lo, glm::vec3 hi) {
+    const glm::vec3 pad = 0.25f * (hi - lo) + 0.05f;
+    boxMin = lo - pad;
+    boxMax = hi + pad;
+    gridResolution = resolution;
+
+    // cells along the wind are never thinner than across it, so a slanted sheet
+    // does not spread over many cells of its own column
+    const glm::vec3 cell = (boxMax - boxMin) / float(resolution);
+    invCell = 1.0f / glm::vec3(cell.x, cell.y, std::max(cell.z, std::max(cell.x, cell.y)));
+
+    const size_t columns = size_t(resolution) * resolution;
+    depth.assign(columns * resolution, 0.0f);
+    columnTouched.assign(columns, 0);
+    touched.clear();
+}
+
+WindOcclusion::State WindOcclusion::state() const {
+    return { d, e1, e2, boxMin, boxMax, invCell, gridResolution, stepsSinceRefresh, shade };
+}
+
+void WindOcclusion::restore(const State& state) {
+    d = state.d;
+    e1 = state.e1;
+    e2 = state.e2;
+    boxMin = state.boxMin;
+    boxMax = state.boxMax;
+    invCell = state.invCell;
+    gridResolution = state.gridResolution;
+    stepsSinceRefresh = state.stepsSinceRefresh;
+    shade = state.shade;
+
+    // an empty grid of the saved size; the next rebuild clears only touched columns
+    const size_t columns = size_t(gridResolution) * gridResolution;
+    depth.assign(columns * gridResolution, 0.0f);
+    columnTouched.assign(columns, 0);
+    touched.clear();
+}
+
+void WindOcclusion::apply(const float* cx, const float* cy, const float* cz,
+                          const float* nx, const float* ny, const float* nz, const float* area,
+                          size_t n, float* wx, float* wy, float* wz) {
+    if(n == 0) return;
+
+    // between refreshes the wind is scaled by the cached transmittance only
+    if(shade.size() == n && ++stepsSinceRefresh < refreshInterval) {
+        scale(n, wx, wy, wz);
+        return;
+    }
+    stepsSinceRefresh = 0;
+
+    glm::vec3 mean(0);
+    for(size_t t = 0; t < n; t++) {
+        mean += glm::vec3(wx[t], wy[t], wz[t]);
+    }
+    if(!(glm::dot(mean, mean) > 1e-6f * float(n) * float(n))) {
+        shade.assign(n, 1.0f);
+        return;
+    }
+    const glm::vec3 dir = glm::normalize(mean);
+
+    // re-orient only when the wind turns by more than ~5 degrees
+    bool stale = gridResolution != resolution;
+    if(glm::dot(dir, d) < 0.996f) {
+        d = dir;
+        e1 = glm::normalize(glm::cross(d, std::abs(d.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+        e2 = glm::cross(d, e1);
+        stale = true;
+    }
+
+    // frame coordinates once per triangle (locals, so stores cannot alias the frame)
+    fa.resize(n); fb.resize(n); fc.resize(n);
+    float* __restrict ta = fa.data();
+    float* __restrict tb = fb.data();
+    float* __restrict tc = fc.data();
+    const glm::vec3 u1 = e1, u2 = e2, u3 = d;
+    for(size_t t = 0; t < n; t++) {
+        ta[t] = cx[t] * u1.x + cy[t] * u1.y + cz[t] * u1.z;
+        tb[t] = cx[t] * u2.x + cy[t] * u2.y + cz[t] * u2.z;
+        tc[t] = cx[t] * u3.x + cy[t] * u3.y + cz[t] * u3.z;
+    }
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for(size_t t = 0; t < n; t++) {
+        lo.x = std::min(lo.x, ta[t]); hi.x = std::max(hi.x, ta[t]);
+        lo.y = std::min(lo.y, tb[t]); hi.y = std::max(hi.y, tb[t]);
+        lo.z = std::min(lo.z, tc[t]); hi.z = std::max(hi.z, tc[t]);
+    }
+    for(int k = 0; k < 3; k++) {
+        // refit when the cloth leaves the box or shrinks well inside it
+        const float need = hi[k] - lo[k];
+        if(lo[k] < boxMin[k] || hi[k] > boxMax[k] || boxMax[k] - boxMin[k] > 3.0f * need + 0.5f) stale = true;
+    }
+    if(stale) refit(lo, hi);
+
+    const int R = gridResolution;
+    for(int column : touched) {
+        std::fill(depth.begin() + size_t(column) * R, depth.begin() + size_t(column + 1) * R, 0.0f);
+        columnTouched[column] = 0;
+    }
+    touched.clear();
+
+    // deposit projected area as a fraction of the column's cross-section
+    voxel.resize(n);
+    int* __restrict tv = voxel.data();
+    float* __restrict grid = depth.data();
+    unsigned char* __restrict marks = columnTouched.data();
+    const glm::vec3 base = boxMin, inv = invCell;
+    const float perCellArea = inv.x * inv.y;
+    const float maxCoord = float(R) - 1e-3f;
+    for(size_t t = 0; t < n; t++) {
+        const int ia = int(std::min(std::max(0.0f, (ta[t] - base.x) * inv.x), maxCoord));
+        const int ib = int(std::min(std::max(0.0f, (tb[t] - base.y) * inv.y), maxCoord));
+        const int ic = int(std::min(std::max(0.0f, (tc[t] - base.z) * inv.z), maxCoord));
+        const int column = ib * R + ia;
+
+        const float projected = area[t] * std::abs(nx[t] * u3.x + ny[t] * u3.y + nz[t] * u3.z);
+        grid[column * R + ic] += projected * perCellArea;
+        if(!marks[column]) {
+            marks[column] = 1;
+            touched.push_back(column);
+        }
+        // look up the depth from more than one cell upstream, skipping the triangle's own layer
+        tv[t] = column * R + std::max(ic - 1, 0);
+    }
+
+    // exclusive prefix along the wind turned into transmittance, one column per
+    // task; exp only where the depth changes
+    const float k = extinction;
+    ThreadPool::shared().parallelFor(0, int(touched.size()), [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            float* col = depth.data() + size_t(touched[i]) * R;
+            float running = 0.0f, transmittance = 1.0f;
+            for(int c = 0; c < R; c++) {
+                const float value = col[c];
+                col[c] = transmittance;
+                if(value > 0.0f) {
+                    running += value;
+                    transmittance = std::exp(-k * running);
+                }
+            }
+        }
+    });
+
+    shade.resize(n);
+    for(size_t t = 0; t < n; t++) {
+        shade[t] = grid[tv[t]];
+    }
+    scale(n, wx, wy, wz);
+}
+
+void WindOcclusion::scale(size_t n, float* wx, float* wy, float* wz) const {
+    const float* __restrict s = shade.data();
+    for(size_t t = 0; t < n; t++) {
+        wx[t] *= s[t];
+        wy[t] *= s[t];
+        wz[t] *= s[t];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "core.hpp"
+
+// Cheap wind shadowing between cloth layers. The triangles are binned into a
+// coarse voxel grid aligned with the mean wind, their projected areas are
+// summed along the wind in every touched column, and each triangle's wind is
+// scaled by exp(-extinction * cloth depth upstream of it).
+//
+// The work is incremental: the grid is rebuilt every refreshInterval steps and
+// the per-triangle transmittance is reused in between, the grid frame is only
+// refitted when the wind turns or the cloth leaves it, and only columns touched
+// by the previous rebuild are cleared and scanned.
+
+class WindOcclusion {
+public:
+    static constexpr int MAX_RESOLUTION = 128;   // 8 MB of grid
+
+    float extinction;      // optical depth of one full layer of cloth
+    int resolution;        // cells per grid axis, at most MAX_RESOLUTION
+    int refreshInterval;   // steps between grid rebuilds
+
+    WindOcclusion();
+
+    /// Attenuate the per-triangle wind in place. Normals and areas may lag one
+    /// step behind the centroids; a change in n forces a rebuild.
+    void apply(const float* cx, const float* cy, const float* cz,
+               const float* nx, const float* ny, const float* nz, const float* area,
+               size_t n, float* wx, float* wy, float* wz);
+
+    // what apply() carries from one step to the next
+    struct State {
+        glm::vec3 d, e1, e2;
+        glm::vec3 boxMin, boxMax, invCell;
+        int gridResolution;
+        int stepsSinceRefresh;
+        std::vector<float> shade;
+    };
+
+    /// Checkpoints carry the state, so a restored run shades exactly as the
+    /// original would have. The grid itself is rebuilt at the next refresh.
+    State state() const;
+    void restore(const State& state);
+
+private:
+    // frame: d along the wind, e1/e2 across it
+    glm::vec3 d, e1, e2;
+    glm::vec3 boxMin, boxMax;   // in frame coordinates
+    glm::vec3 invCell;
+    int gridResolution;
+    int stepsSinceRefresh;
+
+    // depth per voxel, c (along the wind) fastest so each column is contiguous;
+    // after the scan it holds the transmittance seen from each cell
+    std::vector<float> depth;
+    std::vector<unsigned char> columnTouched;
+    std::vector<int> touched;
+    std::vector<float> fa, fb, fc;   // per triangle, frame coordinates
+    std::vector<int> voxel;          // per triangle, cell to read
+    std::vector<float> shade;        // per triangle transmittance from the last rebuild
+
+    void refit(glm::vec3 lo, glm::vec3 hi);
+    void scale(size_t n, float* wx, float* wy, float* wz) const;
+};
@@ -8,9 +8,22 @@
 #include <Cube.hpp>
 #include "Scene.hpp"
 #include "Shader.hpp"
+#include "ShaderCache.hpp"
 #include "core.hpp"
 #include "utils.hpp"
 #include "Cloth.hpp"
+#include "WindField.hpp"
+#include "AirSolver.hpp"
+#include "Subspace.hpp"
+#include "Checkpoint.hpp"
+#include "FrameCache.hpp"
+#include "SequenceExporter.hpp"
+#include "SceneFile.hpp"
+#include "BatchRunner.hpp"
+#include "InputLog.hpp"
+#include "MeshCache.hpp"
+
+#include <chrono>
 
 const int width = 800;
 const int height = 600;
@@ -20,35 +33,152 @@ int mouseX = 0, mouseY = 0;
 
 bool wireframe_mode = false;
 
-Scene* scene;
-Cloth* cloth;
+Scene* scene = nullptr;
+Cloth* cloth = nullptr;
+std::vector<Cloth*> sceneCloths;   // a scene file's cloths after the first, in the same wind
 std::map<std::string, Shader*> shaders;
+ShaderCache* shaderCache = nullptr;   // program binaries from earlier runs
 
-glm::vec3 windSpeed = DEFAULT_WIND_SPEED;
+WindField* wind;
+AirSolver* air = nullptr;
 
+// reduced-order background flags, all sharing one model
+SubspaceModel* flagModel = nullptr;
+std::vector<SubspaceCloth*> flags;
 
-void initialize() {
-    glClearColor(0.0f, 0.0f, 0.0f, 1);
-    glEnable(GL_DEPTH_TEST);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
-    shaders.insert(std::make_pair("Workbench", new Shader("Workbench", "shaders/shader.vs", "shaders/shader.fs")));
-    shaders.insert(std::make_pair("Grid", new Shader("Grid", "shaders/grid.vs", "shaders/grid.fs")));
+// 'c' saves the cloth here in the background, 'z' restores it; a recorded or
+// replayed session uses <log>.checkpoint, away from its startup file
+std::string checkpointFile = "cloth.checkpoint";
+CheckpointWriter* checkpoints = nullptr;
+
+// 's' starts and stops baking the cloth's positions here, one frame per update
+const char* frameCacheFile = "cloth.frames";
+FrameCacheWriter* frameCache = nullptr;
+
+// 'p' starts and stops exporting OBJ and PC2 frames into this directory
+const char* exportDirectory = "export";
+SequenceExporter* exporter = nullptr;
+
+// --record writes every input event here, stamped with the step it arrived
+// before; --replay hands a log's events back at the same steps
+uint64_t simStep = 0;   // updates since startup
+InputRecorder* recorder = nullptr;
+InputLog replay;
+size_t replayNext = 0;
+bool replaying = false;
+bool replayDiverged = false;
+bool headless = false;   // a --headless replay: no window, no GL
+
+
+/// Builds the cloths and wind of a scene file in place of the default cloth.
+/// The first cloth takes the keyboard controls.
+bool loadScene(const char* path) {
+    SceneDesc desc;
+    std::string error;
+    if (!loadSceneFile(path, desc, error) || desc.cloths.empty()) {
+        std::cerr << "loadSceneFile: " << (error.empty() ? std::string(path) + " has no cloth" : error) << std::endl;
+        return false;
+    }
+    for (const ClothDesc& c : desc.cloths) {
+        Cloth* built = buildCloth(desc, c, headless);
+        if (scene) { scene->objects.insert(std::make_pair(c.name, built)); }
+        if (cloth) { sceneCloths.push_back(built); } else { cloth = built; }
+    }
+    wind = buildWind(desc);
+    if (!wind) {
+        // still air, which the wind keys can still stir
+        wind = new WindField(glm::vec3(-3, -1, -3), glm::ivec3(17, 9, 17), 0.5f, glm::vec3(0));
+    }
+    std::cout << "Loaded " << path << "; " << desc.cloths.size() << " cloths" << std::endl;
+    return true;
+}
+
+
+void initialize(const char* sceneFile) {
+    // a headless replay has no context, so only the cloths and the air
+    if (!headless) {
+        glClearColor(0.0f, 0.0f, 0.0f, 1);
+        glEnable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_BLEND);
+        shaderCache = new ShaderCache("shadercache");
+        shaders.insert(std::make_pair("Workbench", shaderCache->load("Workbench", "shaders/shader.vs", "shaders/shader.fs")));
+        // the grid is scenery, so the first frames can go without it
+        shaders.insert(std::make_pair("Grid", shaderCache->loadAsync("Grid", "shaders/grid.vs", "shaders/grid.fs")));
+
+        // MARK: Example code to load from obj file
+        /*
+            const char* objFile = "assets/cube.obj";
+            scene = loadFromObj("Scene", objFile);
+        */
+
+        scene = new Scene("Scene");
+    }
+    if (!sceneFile || !loadScene(sceneFile)) {
+        cloth = new Cloth("Cloth", 15, MASS, PARTICLE_SPACING, glm::vec3(0, INITIAL_HEIGHT, 0), headless);
+        if (scene) { scene->objects.insert(std::make_pair("Cloth", cloth)); }
+
+        // wind lattice around the cloth, 0.5m cells
+        wind = new WindField(glm::vec3(-3, -1, -3), glm::ivec3(17, 9, 17), 0.5f, DEFAULT_WIND_SPEED);
+    }
+
+    checkpoints = new CheckpointWriter();
+}
+
+
+/// Restores the cloth from a checkpoint, reporting why if it can't.
+void restoreCloth(const std::string& path) {
+    std::string error;
+    if (restoreCheckpoint(*cloth, path, error)) {
+        std::cout << "Restored " << path << " at t = " << cloth->simTime << std::endl;
+    } else {
+        std::cerr << "restoreCheckpoint: " << error << std::endl;
+    }
+}
 
-    // MARK: Example code to load from obj file
-    /*
-        const char* objFile = "assets/cube.obj";
-        scene = loadFromObj("Scene", objFile);
-    */
 
-    scene = new Scene("Scene");
-    cloth = new Cloth("Cloth", 15, MASS);
-    scene->objects.insert(std::make_pair("Cloth", cloth));
+/// Starts from a scene file, a checkpoint, or with an empty argument the
+/// default cloth.
+void startup(const std::string& argument) {
+    const bool sceneFile = argument.size() > 6 && argument.compare(argument.size() - 6, 6, ".scene") == 0;
+    initialize(sceneFile ? argument.c_str() : nullptr);
+    if (!argument.empty() && !sceneFile) { restoreCloth(argument); }
+}
+
+
+/// A hash of every cloth's positions, which a replay compares against the
+/// recording's.
+uint64_t stateChecksum() {
+    std::vector<glm::vec3> positions;
+    for (const Particle* p : cloth->particles) { positions.push_back(p->position); }
+    for (const Cloth* other : sceneCloths) {
+        for (const Particle* p : other->particles) { positions.push_back(p->position); }
+    }
+    return MeshCache::hash(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(glm::vec3));
+}
+
+
+/// Trains the flag model on a full cloth in uniform, slowly varying wind.
+void trainFlags() {
+    Cloth trainer("Trainer", 15, MASS);
+    trainer.windOcclusion = false;   // the reduced drag sees the wind unshadowed
+    auto windAt = [](int t) {
+        return glm::vec3(3.0f * sinf(t * 0.031f), 0, 10.0f + 8.0f * sinf(t * 0.013f));
+    };
+    flagModel = new SubspaceModel();
+    for (int t = 0; t < 800; t++) {
+        trainer.update(windAt(t));
+        if (t >= 200 && t % 3 == 0) flagModel->record(trainer, windAt(t));
+    }
+    flagModel->build(trainer, 16, 100);
+    std::cout << "Flag model: " << flagModel->modes() << " modes, " << flagModel->samples()
+              << " cubature elements, fit error " << flagModel->fitError() << std::endl;
 }
 
 
 /// This is the display call back.
 void display_callback() {
+    shaderCache->poll();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     if (wireframe_mode) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -63,12 +193,84 @@ void display_callback() {
 
     // Draw the grid
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    scene->drawGrid(shaders["Grid"]);
+    if (shaders["Grid"]->ready()) { scene->drawGrid(shaders["Grid"]); }
 
     glutSwapBuffers();
 }
 
 
+/// One simulation step. It only depends on the input so far, which is what
+/// lets a replay repeat a session.
+void simulate() {
+    wind->update(TIME_STEP);
+    if (air) {
+        // two-way coupled air, driven by the base wind at its boundary
+        air->ambientWind = wind->baseWind;
+        cloth->update(*air);
+        air->step(TIME_STEP);
+    } else {
+        cloth->update(*wind);
+    }
+    for (Cloth* other : sceneCloths) {
+        other->update(*wind);
+    }
+    if (frameCache) {
+        frameCache->append(*cloth);
+    }
+    if (exporter) {
+        exporter->append(*cloth);
+    }
+    for (SubspaceCloth* flag : flags) {
+        flag->update(wind->baseWind);
+    }
+    simStep++;
+}
+
+
+void applyKey(unsigned char key);
+void applyMouseClick(int button, int state, int mod, int x, int y);
+void applyMouseDrag(int x, int y);
+
+
+/// Reports whether the replay reached the recording's end state; end is null
+/// for a log without an end record, e.g. from a session that crashed.
+void finishReplay(const InputEvent* end) {
+    replaying = false;
+    if (!end) {
+        std::cout << "Replay finished at step " << simStep << "; the log has no end record" << std::endl;
+    } else if (stateChecksum() == end->checksum) {
+        std::cout << "Replay matches the recording at step " << simStep << std::endl;
+    } else {
+        replayDiverged = true;
+        std::cerr << "Replay diverged from the recording by step " << simStep << std::endl;
+    }
+}
+
+
+/// Hands the logged events for this step to the handlers, ahead of its update.
+void replayInput() {
+    while (replaying && replayNext < replay.events.size() && replay.events[replayNext].step <= simStep) {
+        const InputEvent& e = replay.events[replayNext++];
+        switch (e.type) {
+            case InputEvent::KEY:
+                applyKey(e.key);
+                break;
+            case InputEvent::CLICK:
+                // the mouse only moves the camera, which a headless replay lacks
+                if (scene) { applyMouseClick(e.button, e.state, e.modifiers, e.x, e.y); }
+                break;
+            case InputEvent::DRAG:
+                if (scene) { applyMouseDrag(e.x, e.y); }
+                break;
+            case InputEvent::END:
+                finishReplay(&e);
+                break;
+        }
+    }
+    if (replaying && replayNext == replay.events.size()) { finishReplay(nullptr); }
+}
+
+
 /// The idle call back.
 void idle_callback() {
     // MARK: Perform any background tasks here
@@ -78,28 +280,135 @@ void idle_callback() {
         object.second->update();
     }
     */
-    cloth->update(windSpeed);
+    if (replaying) { replayInput(); }
+
+    // pick the render level before the update that uploads it
+    cloth->lod.select(*scene->camera, cloth->particles);
+    for (Cloth* other : sceneCloths) {
+        other->lod.select(*scene->camera, other->particles);
+    }
+
+    simulate();
     glutPostRedisplay();
 }
 
 
-/// Keystroke callback.
-void handle_keypress(unsigned char key, int x, int y) {
+/// Acts on a key, live or replayed.
+void applyKey(unsigned char key) {
     switch (key) {
         case 27: // ESC
+            if (recorder) { recorder->close(simStep, stateChecksum()); }
+            checkpoints->flush();
+            if (frameCache) { frameCache->close(); }
+            if (exporter) { exporter->close(); }
             exit(0);
             break;
         case 'r':
-            scene->camera->reset();
+            if (scene) { scene->camera->reset(); }
             break;
         case 'w':
             wireframe_mode = !wireframe_mode;
             break;
         case 'q':
-            windSpeed.z += 1.0f;
+            wind->baseWind.z += 1.0f;
             break;
         case 'a':
-            windSpeed.z -= 1.0f;
+            wind->baseWind.z -= 1.0f;
+            break;
+        case 't':
+            wind->turbulence = wind->turbulence > 0.0f ? 0.0f : 5.0f;
+            break;
+        case 'm':
+            cloth->stretchModel = cloth->stretchModel == STRETCH_SPRINGS ? STRETCH_MEMBRANE : STRETCH_SPRINGS;
+            break;
+        case 'x':
+            cloth->strainLimiting = !cloth->strainLimiting;
+            break;
+        case 'e':
+            cloth->tearingEnabled = !cloth->tearingEnabled;
+            break;
+        case 'n':
+            cloth->remeshing = !cloth->remeshing;
+            break;
+        case 'd':
+            cloth->lod.enabled = !cloth->lod.enabled;
+            break;
+        case 'c':
+            checkpoints->save(*cloth, checkpointFile);
+            break;
+        case 'z':
+            // the last save may still be in flight
+            checkpoints->flush();
+            restoreCloth(checkpointFile);
+            break;
+        case 's':
+            if (frameCache) {
+                frameCache->close();
+                if (frameCache->ok()) {
+                    std::cout << "Baked " << frameCache->frames() << " frames to " << frameCacheFile << " ("
+                              << frameCache->bytes() << " bytes)" << std::endl;
+                } else {
+                    std::cerr << "FrameCacheWriter: " << frameCache->error() << std::endl;
+                }
+                delete frameCache;
+                frameCache = nullptr;
+            } else {
+                frameCache = new FrameCacheWriter(frameCacheFile);
+                if (!frameCache->ok()) {
+                    std::cerr << "FrameCacheWriter: " << frameCache->error() << std::endl;
+                    delete frameCache;
+                    frameCache = nullptr;
+                }
+            }
+            break;
+        case 'p':
+            if (exporter) {
+                exporter->close();
+                if (exporter->ok()) {
+                    std::cout << "Exported " << exporter->frames() - exporter->dropped() << " frames to "
+                              << exportDirectory << " (" << exporter->dropped() << " dropped)" << std::endl;
+                } else {
+                    std::cerr << "SequenceExporter: " << exporter->error() << std::endl;
+                }
+                delete exporter;
+                exporter = nullptr;
+            } else {
+                exporter = new SequenceExporter(exportDirectory, "cloth");
+            }
+            break;
+        case 'f':
+            if (!scene) { break; }   // scenery, which needs GL
+            if (flags.empty()) {
+                if (!flagModel) { trainFlags(); }
+                // a row of flags behind the cloth, each starting from a different frame
+                for (int i = 0; i < 8; i++) {
+                    std::string name = "Flag " + std::to_string(i);
+                    SubspaceCloth* flag = new SubspaceCloth(name, flagModel, size_t(i) * 23);
+                    flag->matrix_world = glm::translate(glm::mat4(1), glm::vec3(3.5f * (i - 3.5f), 0, -8));
+                    scene->objects.insert(std::make_pair(name, flag));
+                    flags.push_back(flag);
+                }
+            } else {
+                for (SubspaceCloth* flag : flags) {
+                    scene->objects.erase(flag->name);
+                    delete flag;
+                }
+                flags.clear();
+            }
+            break;
+        case 'b':
+            cloth->bendingEnabled = !cloth->bendingEnabled;
+            break;
+        case 'v':
+            cloth->windOcclusion = !cloth->windOcclusion;
+            break;
+        case 'g':
+            if (air) {
+                delete air;
+                air = nullptr;
+            } else {
+                air = new AirSolver(glm::vec3(-3, -1, -3), glm::vec3(8, 4, 8), 0.25f, wind->baseWind);
+            }
             break;
         case 'i':
             cloth->translateFixed(glm::vec3(0,0.1f,0));
@@ -126,13 +435,21 @@ void handle_keypress(unsigned char key, int x, int y) {
         default:
             return;
     }
+}
+
+
+/// Keystroke callback.
+void handle_keypress(unsigned char key, int x, int y) {
+    // live input would take a replay off its recording, so only ESC gets through
+    if (replaying && key != 27) { return; }
+    if (recorder && key != 27) { recorder->key(simStep, key); }
+    applyKey(key);
     glutPostRedisplay();
 }
 
 
-/// Mouse button callback
-void handle_mouse_click(int button, int state, int x, int y) {
-    GLuint mod = glutGetModifiers();
+/// Acts on a mouse button, live or replayed.
+void applyMouseClick(int button, int state, int mod, int x, int y) {
     switch (button) {
         case GLUT_LEFT_BUTTON:
             actPan = (mod & GLUT_ACTIVE_SHIFT) && (state == GLUT_DOWN);
@@ -148,8 +465,17 @@ void handle_mouse_click(int button, int state, int x, int y) {
 }
 
 
-/// Called when the mouse is moving with at least one button pressed
-void handle_mouse_drag(int x, int y) {
+/// Mouse button callback
+void handle_mouse_click(int button, int state, int x, int y) {
+    if (replaying) { return; }
+    const int mod = glutGetModifiers();
+    if (recorder) { recorder->click(simStep, button, state, mod, x, y); }
+    applyMouseClick(button, state, mod, x, y);
+}
+
+
+/// Moves the camera with a drag, live or replayed.
+void applyMouseDrag(int x, int y) {
     const int dmax = 100;
     const int dx = glm::clamp(x - mouseX, -dmax, dmax);
     const int dy = glm::clamp(y - mouseY, -dmax, dmax);
@@ -172,17 +498,92 @@ void handle_mouse_drag(int x, int y) {
     }
     
     scene->camera->update();
+}
+
+
+/// Called when the mouse is moving with at least one button pressed
+void handle_mouse_drag(int x, int y) {
+    if (replaying) { return; }
+    if (recorder) { recorder->drag(simStep, x, y); }
+    applyMouseDrag(x, y);
     glutPostRedisplay();
 }
 
 
 void cleanup() {
-    if (scene) { delete scene; }
+    if (scene) {
+        delete scene;
+    } else {
+        // without a scene nothing else owns the cloths
+        delete cloth;
+        for (Cloth* other : sceneCloths) { delete other; }
+    }
+    if (wind) { delete wind; }
+    if (air) { delete air; }
+    if (flagModel) { delete flagModel; }
+    if (checkpoints) { delete checkpoints; }   // finishes pending writes
+    if (frameCache) { delete frameCache; }     // writes the frame index
+    if (exporter) { delete exporter; }         // writes what is queued
+    if (recorder) { delete recorder; }
+    if (shaderCache) { delete shaderCache; }   // drops programs still compiling
     shaders.clear();
 }
 
 
 int main(int argc, char * argv[]) {
+    // headless batch runs of scene files, without a window:
+    // ClothSimulation --batch [-j jobs] scene...
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        unsigned jobs = 0;
+        std::vector<std::string> paths;
+        for (int i = 2; i < argc; i++) {
+            if (std::string(argv[i]) == "-j" && i + 1 < argc) {
+                jobs = unsigned(std::max(0, atoi(argv[++i])));
+            } else {
+                paths.push_back(argv[i]);
+            }
+        }
+        return runBatch(paths, jobs) == 0 ? 0 : 1;
+    }
+
+    // record a session's input, or play one back, with or without a window:
+    // ClothSimulation --record log [scene | checkpoint]
+    // ClothSimulation --replay log [--headless]
+    std::string argument = argc > 1 ? argv[1] : "";
+    std::string recordFile;
+    if (argc > 2 && std::string(argv[1]) == "--record") {
+        recordFile = argv[2];
+        argument = argc > 3 ? argv[3] : "";
+        checkpointFile = recordFile + ".checkpoint";
+    } else if (argc > 2 && std::string(argv[1]) == "--replay") {
+        std::string error;
+        if (!loadInputLog(argv[2], replay, error)) {
+            std::cerr << "loadInputLog: " << error << std::endl;
+            return 1;
+        }
+        argument = replay.startup;
+        checkpointFile = std::string(argv[2]) + ".checkpoint";
+        replaying = true;
+        headless = argc > 3 && std::string(argv[3]) == "--headless";
+    }
+
+    if (headless) {
+        // as fast as it goes, for bisecting a regression or timing a session
+        startup(argument);
+        const auto start = std::chrono::steady_clock::now();
+        for (;;) {
+            replayInput();
+            if (!replaying) { break; }
+            simulate();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Replayed " << simStep << " steps in " << seconds << " s ("
+                  << (simStep ? 1000.0 * seconds / simStep : 0.0) << " ms per step)" << std::endl;
+        checkpoints->flush();
+        cleanup();
+        return replayDiverged ? 1 : 0;
+    }
+
     // Initialize glue window
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_3_2_CORE_PROFILE | GLUT_RGBA | GLUT_DEPTH);
@@ -191,9 +592,19 @@ int main(int argc, char * argv[]) {
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
 
     //print controls
-    std::cout << "Controls:\nq: increase Windspeed\na: decrease Windspeed\ni: move upward\nk: move downward\nj:move leftward\nl:move rightward\nu: move forward\no: move backward" << std::endl;
+    std::cout << "Controls:\nq: increase Windspeed\na: decrease Windspeed\nt: toggle turbulence\ng: toggle coupled air solver\nv: toggle wind occlusion\nb: toggle bending\nm: toggle springs / membrane elements\nx: toggle strain limiting\ne: toggle tearing\nn: toggle adaptive remeshing\nd: toggle render level of detail\nf: toggle reduced background flags\nc: save checkpoint\nz: restore checkpoint\ns: start / stop baking frames\np: start / stop exporting OBJ / PC2 frames\ni: move upward\nk: move downward\nj:move leftward\nl:move rightward\nu: move forward\no: move backward" << std::endl;
 
-    initialize();
+    // a scene file in place of the default cloth, or a saved state to start
+    // from, e.g. a settled pose for a benchmark or shot
+    startup(argument);
+    if (!recordFile.empty()) {
+        recorder = new InputRecorder(recordFile, argument);
+        if (recorder->ok()) {
+            std::cout << "Recording input to " << recordFile << std::endl;
+        } else {
+            std::cerr << "InputRecorder: " << recorder->error() << std::endl;
+        }
+    }
 
     /// see link: https://www.opengl.org/resources/libraries/glut/spec3/node46.html
     glutDisplayFunc(display_callback);
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include "ObjLoader.hpp"
+#include "MeshCache.hpp"
+
 inline void print_mat4(const glm::mat4 &mtx, const std::string name) {
     std::cout << name << ": " << std::endl;
     std::cout << "[" << mtx[0][0] << "\t" << mtx[1][0] << "\t" << mtx[2][0] << "\t" << mtx[3][0] << "]" << std::endl;
@@ -16,29 +19,49 @@ inline void print_mat4(const glm::mat4 &mtx, const std::string name) {
 }
 
 Scene* loadFromObj(const std::string &name, const std::string &filepath) {
-    tinyobj::ObjReader reader;
-    if (!reader.ParseFromFile(filepath)) {
-        if (!reader.Error().empty()) {
-            std::cerr << "TinyObjReader: " << reader.Error();
+    // MARK: Map the binary cache, parsing and (re)writing it if missing or stale
+    std::shared_ptr<const MeshCache> cache = MeshCache::open(filepath);
+    ObjData obj;
+    if (!cache) {
+        std::string error;
+        if (!loadObj(filepath, obj, error)) {
+            std::cerr << "loadObj: " << error << std::endl;
             throw std::runtime_error("loadFromObj failed");
         }
-    }
-    if (!reader.Warning().empty()) {
-        std::cout << "TinyObjReader: " << reader.Warning();
+        if (MeshCache::write(filepath, obj, error)) {
+            cache = MeshCache::open(filepath);
+        } else {
+            std::cerr << "MeshCache: " << error << std::endl;
+        }
     }
 
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-
     // MARK: Create new scene object, add mesh objects
     Scene* scene = new Scene(name);
     size_t numVerts = 0, numFaces = 0;
-    for (const auto& shape : shapes) {
-        assert(!shape.name.empty());
-        Mesh* newMesh = new Mesh(shape.name, attrib, shape.mesh, tinyobj::material_t());
-        scene->objects.insert(std::make_pair(shape.name, newMesh));
-        numVerts += static_cast<Mesh*>(scene->objects[shape.name])->verts.size();
-        numFaces += static_cast<Mesh*>(scene->objects[shape.name])->faces.size();
+    if (cache) {
+        // GPU-only meshes, uploaded straight from the mapping
+        for (const auto& shape : cache->shapes()) {
+            assert(!shape.name.empty());
+            Mesh* newMesh = new Mesh(shape.name);
+            newMesh->uploadBuffers(cache->positions(), cache->normals(), cache->vertexCount(),
+                                   cache->indices() + 3 * shape.firstTriangle, 3 * shape.triangleCount);
+            newMesh->cache = cache;
+            scene->objects.insert(std::make_pair(shape.name, newMesh));
+            numVerts += cache->vertexCount();
+            numFaces += shape.triangleCount;
+            std::cout << "Mapped " << shape.name << "; ";
+            std::cout << cache->vertexCount() << " vertices, " << shape.triangleCount << " faces. " << std::endl;
+        }
+    } else {
+        for (const auto& shape : obj.shapes) {
+            assert(!shape.name.empty());
+            GLuints indices(obj.indices.begin() + 3 * shape.firstTriangle,
+                            obj.indices.begin() + 3 * (shape.firstTriangle + shape.triangleCount));
+            Mesh* newMesh = new Mesh(shape.name, obj.positions, obj.normals, indices);
+            scene->objects.insert(std::make_pair(shape.name, newMesh));
+            numVerts += newMesh->verts.size();
+            numFaces += newMesh->faces.size();
+        }
     }
 
     std::cout << "Summary: " << numVerts << " vertices, " << numFaces << " faces. " << std::endl;
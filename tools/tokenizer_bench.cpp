@@ -0,0 +1,99 @@
+// Tokenizer throughput, stdio against the mapped file. Reads an OBJ-like file
+// three ways: through stdio as before mapping, mapped with GetToken(char*),
+// and mapped with string_view tokens. "v" and "vn" lines are read as three
+// floats and everything else is skipped by line, the way the loaders do, and
+// each pass prints its best MB/s with a checksum that should agree across all
+// three. Not part of the app; build it from the repository root with
+//
+//     c++ -O2 -std=c++17 -Iinclude -Isrc tools/tokenizer_bench.cpp src/Tokenizer.cpp -o tokenizer_bench
+//     ./tokenizer_bench model.obj [runs]
+
+#include "Tokenizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+    enum Mode { STDIO, MAPPED, VIEWS };
+
+    struct Result {
+        double seconds;
+        double sum;     // of every float read
+        long lines;     // of "v" and "vn"
+    };
+
+    bool isVertex(const char* token, size_t length) {
+        return (length == 1 && token[0] == 'v') || (length == 2 && token[0] == 'v' && token[1] == 'n');
+    }
+
+    bool pass(const char* path, Mode mode, Result& result) {
+        const auto start = std::chrono::steady_clock::now();
+        Tokenizer in;
+        if(!in.Open(path, mode != STDIO)) return false;
+        if(mode != STDIO && !in.IsMapped()) {
+            printf("'%s' can't be mapped\n", path);
+            in.Close();
+            return false;
+        }
+
+        result.sum = 0.0;
+        result.lines = 0;
+        char token[256];
+        for(;;) {
+            in.SkipWhitespace();
+            if(in.CheckChar() == char(EOF)) break;
+            bool vertex;
+            if(mode == VIEWS) {
+                const std::string_view t = in.GetToken();
+                vertex = isVertex(t.data(), t.size());
+            } else {
+                in.GetToken(token);
+                vertex = isVertex(token, strlen(token));
+            }
+            if(vertex) {
+                result.sum += in.GetFloat();
+                result.sum += in.GetFloat();
+                result.sum += in.GetFloat();
+                result.lines++;
+            }
+            in.SkipLine();
+        }
+        in.Close();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        printf("usage: %s file.obj [runs]\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[1];
+    const int runs = argc > 2 ? std::max(1, atoi(argv[2])) : 5;
+
+    struct stat info;
+    if(stat(path, &info) != 0 || info.st_size == 0) {
+        printf("can't read '%s'\n", path);
+        return 1;
+    }
+    const double megabytes = double(info.st_size) / (1024.0 * 1024.0);
+    printf("%s: %.1f MB, best of %d\n", path, megabytes, runs);
+
+    const char* names[] = { "stdio", "mapped, GetToken(char*)", "mapped, string_view tokens" };
+    for(Mode mode : { STDIO, MAPPED, VIEWS }) {
+        Result best = {};
+        for(int r = 0; r < runs; r++) {
+            Result result;
+            if(!pass(path, mode, result)) return 1;
+            if(r == 0 || result.seconds < best.seconds) best = result;
+        }
+        printf("  %-28s %8.1f MB/s   %ld vertex lines, sum %.6g\n",
+               names[mode], megabytes / best.seconds, best.lines, best.sum);
+    }
+    return 0;
+}